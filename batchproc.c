@@ -0,0 +1,372 @@
+/* Batch processing of many dialog template files on a pool of worker
+   threads.
+
+   The tasks are numbered from zero, and each worker thread starts out
+   owning an equal contiguous range of task numbers.  A worker takes
+   tasks from the front of its own range.  Once its range is empty, it
+   steals the back half of the largest remaining range of another
+   worker.  Since a range is just two numbers, stealing is cheap, and
+   since the task numbers are known in advance, the caller can store
+   each task's results by task number and combine them in a fixed
+   order no matter which thread ran which task.  */
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include "xthread.h" /* Includes windows.h before subwindef.h */
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include "xthread.h"
+#endif
+
+#include "xmalloc.h"
+#include "strarena.h"
+#include "batchproc.h"
+
+/* MSVC >= 8.0 pragmas */
+#if _MSC_VER >= 1400
+#pragma warning (disable: 4996) /* Disable deprecate */
+#pragma warning (disable: 4267) /* Disable size_t warnings */
+#endif
+
+/* The range of tasks [head, tail) that a worker has left to run */
+struct WorkRange_t
+{
+	xmutex_t lock;
+	unsigned head;
+	unsigned tail;
+};
+
+typedef struct WorkRange_t WorkRange;
+
+struct BatchPool_t
+{
+	WorkRange* ranges;
+	unsigned numThreads;
+	BatchFunc func;
+	void* userData;
+};
+
+typedef struct BatchPool_t BatchPool;
+
+struct BatchWorker_t
+{
+	BatchPool* pool;
+	unsigned threadNum;
+};
+
+typedef struct BatchWorker_t BatchWorker;
+
+static BOOL HasTemplateExt(const char* filename);
+static void AddBatchPath(BatchPath_array* files, const char* path);
+static int CmpBatchPaths(const void* a, const void* b);
+static BOOL TakeTask(WorkRange* range, unsigned* taskNum);
+static BOOL StealTasks(BatchPool* pool, unsigned threadNum);
+static void BatchWorkerProc(void* arg);
+
+/* Returns TRUE if the file name ends in ".dlg" or ".rc". */
+static BOOL HasTemplateExt(const char* filename)
+{
+	const char* ext;
+	ext = strrchr(filename, '.');
+	if (ext == NULL)
+		return FALSE;
+	ext++;
+	if ((ext[0] == 'd' || ext[0] == 'D') &&
+		(ext[1] == 'l' || ext[1] == 'L') &&
+		(ext[2] == 'g' || ext[2] == 'G') && ext[3] == '\0')
+		return TRUE;
+	if ((ext[0] == 'r' || ext[0] == 'R') &&
+		(ext[1] == 'c' || ext[1] == 'C') && ext[2] == '\0')
+		return TRUE;
+	return FALSE;
+}
+
+static void AddBatchPath(BatchPath_array* files, const char* path)
+{
+	files->d[files->len] = (char*)xmalloc(strlen(path) + 1);
+	strcpy(files->d[files->len], path);
+	EA_ADD(BatchPath, *files);
+}
+
+/* Adds "path" to the list of files.  If "path" is a directory, all of
+   the dialog template files (*.dlg and *.rc) below it are added
+   instead.  Symbolic links and junctions to directories are not
+   followed below "path", so a link back up the tree cannot make the
+   walk go on forever.  The array must have been initialized with
+   EA_INIT().  Returns FALSE if "path" does not exist. */
+BOOL CollectTemplateFiles(BatchPath_array* files, const char* path)
+{
+#ifdef _WIN32
+	WIN32_FIND_DATAA findData;
+	HANDLE hFind;
+	char* pattern;
+	DWORD attrs;
+
+	attrs = GetFileAttributesA(path);
+	if (attrs == INVALID_FILE_ATTRIBUTES)
+		return FALSE;
+	if (!(attrs & FILE_ATTRIBUTE_DIRECTORY))
+	{
+		AddBatchPath(files, path);
+		return TRUE;
+	}
+
+	pattern = (char*)xmalloc(strlen(path) + 3);
+	strcpy(pattern, path);
+	strcat(pattern, "\\*");
+	hFind = FindFirstFileA(pattern, &findData);
+	xfree(pattern);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return TRUE;
+	do
+	{
+		char* subPath;
+		if (strcmp(findData.cFileName, ".") == 0 ||
+			strcmp(findData.cFileName, "..") == 0)
+			continue;
+		subPath = (char*)xmalloc(strlen(path) + 1 +
+								 strlen(findData.cFileName) + 1);
+		sprintf(subPath, "%s\\%s", path, findData.cFileName);
+		if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			if (!(findData.dwFileAttributes &
+				  FILE_ATTRIBUTE_REPARSE_POINT))
+				CollectTemplateFiles(files, subPath);
+		}
+		else if (HasTemplateExt(findData.cFileName))
+			AddBatchPath(files, subPath);
+		xfree(subPath);
+	} while (FindNextFileA(hFind, &findData));
+	FindClose(hFind);
+	return TRUE;
+#else
+	struct stat st;
+	DIR* dir;
+	struct dirent* ent;
+
+	if (stat(path, &st) != 0)
+		return FALSE;
+	if (!S_ISDIR(st.st_mode))
+	{
+		AddBatchPath(files, path);
+		return TRUE;
+	}
+
+	dir = opendir(path);
+	if (dir == NULL)
+		return TRUE;
+	while ((ent = readdir(dir)) != NULL)
+	{
+		char* subPath;
+		if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+			continue;
+		subPath = (char*)xmalloc(strlen(path) + 1 + strlen(ent->d_name) + 1);
+		sprintf(subPath, "%s/%s", path, ent->d_name);
+		/* A link is only followed to a file */
+		if (lstat(subPath, &st) == 0)
+		{
+			if (S_ISDIR(st.st_mode))
+				CollectTemplateFiles(files, subPath);
+			else if (HasTemplateExt(ent->d_name) &&
+					 (!S_ISLNK(st.st_mode) ||
+					  (stat(subPath, &st) == 0 && !S_ISDIR(st.st_mode))))
+				AddBatchPath(files, subPath);
+		}
+		xfree(subPath);
+	}
+	closedir(dir);
+	return TRUE;
+#endif
+}
+
+static int CmpBatchPaths(const void* a, const void* b)
+{
+	return strcmp(*(const BatchPath*)a, *(const BatchPath*)b);
+}
+
+/* Sorts the list of files by name so that results come out in the
+   same order on every run. */
+void SortBatchPaths(BatchPath_array* files)
+{
+	qsort(files->d, files->len, sizeof(BatchPath), CmpBatchPaths);
+}
+
+void FreeBatchPaths(BatchPath_array* files)
+{
+	unsigned i;
+	for (i = 0; i < files->len; i++)
+		xfree(files->d[i]);
+	EA_DESTROY(BatchPath, *files);
+}
+
+/* Returns the number of worker threads to use.  If "numThreads" is
+   zero, one thread per processor is used.  There is never more than
+   one thread per task. */
+unsigned BatchNumThreads(unsigned numThreads, unsigned numTasks)
+{
+	if (numThreads == 0)
+		numThreads = xthread_num_cpus();
+	if (numThreads > numTasks)
+		numThreads = numTasks;
+	if (numThreads == 0)
+		numThreads = 1;
+	return numThreads;
+}
+
+/* Takes the next task from the front of a worker's own range. */
+static BOOL TakeTask(WorkRange* range, unsigned* taskNum)
+{
+	BOOL found;
+	xmutex_lock(&range->lock);
+	found = (range->head < range->tail);
+	if (found == TRUE)
+		*taskNum = range->head++;
+	xmutex_unlock(&range->lock);
+	return found;
+}
+
+/* Moves the back half of the largest range of another worker into the
+   given worker's range.  Returns FALSE if there is no work left
+   anywhere. */
+static BOOL StealTasks(BatchPool* pool, unsigned threadNum)
+{
+	for (;;)
+	{
+		unsigned victim;
+		unsigned maxLeft;
+		unsigned i;
+		WorkRange* vRange;
+		WorkRange* myRange;
+		unsigned mid;
+		unsigned tail;
+
+		/* Find the worker with the most work left */
+		victim = threadNum;
+		maxLeft = 0;
+		for (i = 0; i < pool->numThreads; i++)
+		{
+			unsigned left;
+			if (i == threadNum)
+				continue;
+			xmutex_lock(&pool->ranges[i].lock);
+			left = pool->ranges[i].tail - pool->ranges[i].head;
+			xmutex_unlock(&pool->ranges[i].lock);
+			if (left > maxLeft)
+			{
+				maxLeft = left;
+				victim = i;
+			}
+		}
+		if (maxLeft == 0)
+			return FALSE;
+
+		/* Take the back half, rounding up so that a single remaining
+		   task can be stolen too */
+		vRange = &pool->ranges[victim];
+		xmutex_lock(&vRange->lock);
+		if (vRange->head >= vRange->tail)
+		{
+			/* Someone else got there first, try again */
+			xmutex_unlock(&vRange->lock);
+			continue;
+		}
+		tail = vRange->tail;
+		mid = vRange->head + (tail - vRange->head) / 2;
+		vRange->tail = mid;
+		xmutex_unlock(&vRange->lock);
+
+		myRange = &pool->ranges[threadNum];
+		xmutex_lock(&myRange->lock);
+		myRange->head = mid;
+		myRange->tail = tail;
+		xmutex_unlock(&myRange->lock);
+		return TRUE;
+	}
+}
+
+static void BatchWorkerProc(void* arg)
+{
+	BatchWorker* worker;
+	BatchPool* pool;
+	unsigned taskNum;
+
+	worker = (BatchWorker*)arg;
+	pool = worker->pool;
+	do
+	{
+		while (TakeTask(&pool->ranges[worker->threadNum], &taskNum))
+			pool->func(pool->userData, taskNum, worker->threadNum);
+	} while (StealTasks(pool, worker->threadNum));
+	/* The string arena blocks and pooled memory that this thread
+	   recycled between files are not needed once it exits.  The
+	   calling thread keeps its blocks for the next batch. */
+	if (worker->threadNum != 0)
+	{
+		FreeStrArenaCache();
+		xalloc_thread_flush();
+	}
+}
+
+/* Runs "func" once for every task number from zero to "numTasks"
+   minus one, spread over "numThreads" worker threads (see
+   BatchNumThreads()).  Returns once all of the tasks have finished.
+   With a single thread, the tasks are run in order on the calling
+   thread. */
+void RunBatch(unsigned numTasks, unsigned numThreads,
+			  BatchFunc func, void* userData)
+{
+	BatchPool pool;
+	BatchWorker* workers;
+	xthread_t* threads;
+	unsigned numStarted;
+	unsigned i;
+
+	if (numTasks == 0)
+		return;
+	numThreads = BatchNumThreads(numThreads, numTasks);
+	if (numThreads == 1)
+	{
+		for (i = 0; i < numTasks; i++)
+			func(userData, i, 0);
+		return;
+	}
+
+	pool.numThreads = numThreads;
+	pool.func = func;
+	pool.userData = userData;
+	pool.ranges = (WorkRange*)xmalloc(sizeof(WorkRange) * numThreads);
+	workers = (BatchWorker*)xmalloc(sizeof(BatchWorker) * numThreads);
+	threads = (xthread_t*)xmalloc(sizeof(xthread_t) * numThreads);
+	for (i = 0; i < numThreads; i++)
+	{
+		xmutex_init(&pool.ranges[i].lock);
+		pool.ranges[i].head = (unsigned)((double)numTasks * i / numThreads);
+		pool.ranges[i].tail =
+			(unsigned)((double)numTasks * (i + 1) / numThreads);
+		workers[i].pool = &pool;
+		workers[i].threadNum = i;
+	}
+
+	/* The calling thread is worker zero */
+	numStarted = 1;
+	for (i = 1; i < numThreads; i++)
+	{
+		if (xthread_create(&threads[i], BatchWorkerProc, &workers[i]) != 0)
+			break;
+		numStarted++;
+	}
+	/* Any worker that could not be started has its range stolen by
+	   the others */
+	BatchWorkerProc(&workers[0]);
+	for (i = 1; i < numStarted; i++)
+		xthread_join(threads[i]);
+
+	for (i = 0; i < numThreads; i++)
+		xmutex_destroy(&pool.ranges[i].lock);
+	xfree(threads);
+	xfree(workers);
+	xfree(pool.ranges);
+}
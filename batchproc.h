@@ -0,0 +1,32 @@
+/* Batch processing of many dialog template files on a pool of worker
+   threads.  */
+
+#ifndef BATCHPROC_H
+#define BATCHPROC_H
+
+#include "xmalloc.h"
+#define ea_malloc xmalloc
+#define ea_realloc xrealloc
+#define ea_free xfree
+#include "exparray.h"
+/* Include Windows data types (BOOL) */
+#include "subwindef.h"
+
+typedef char* BatchPath; /* Heap-allocated file name */
+
+EA_TYPE(BatchPath);
+
+/* Called once for each task.  "threadNum" is the number of the worker
+   thread that runs the task, counting from zero, so that the function
+   can use per-thread scratch data. */
+typedef void (*BatchFunc)(void* userData, unsigned taskNum,
+						  unsigned threadNum);
+
+BOOL CollectTemplateFiles(BatchPath_array* files, const char* path);
+void SortBatchPaths(BatchPath_array* files);
+void FreeBatchPaths(BatchPath_array* files);
+unsigned BatchNumThreads(unsigned numThreads, unsigned numTasks);
+void RunBatch(unsigned numTasks, unsigned numThreads,
+			  BatchFunc func, void* userData);
+
+#endif /* not BATCHPROC_H */
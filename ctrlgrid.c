@@ -0,0 +1,394 @@
+/* Spatial index of the controls of a dialog template.
+
+   This is platform independent code.  The grid is built the first
+   time that it is queried, sized so that a few controls share each
+   cell, and is then kept up to date as controls are added, removed,
+   moved, and resized.  Each cell keeps its controls in a HitRects set
+   (see hitrects.h), so a point query is one vectorized scan of one
+   cell. */
+
+#include <stdlib.h>
+
+#include "xmalloc.h"
+#include "ctrlgrid.h"
+
+/* Number of controls that should share a cell if the controls are
+   spread out evenly */
+#define CTRLS_PER_CELL 4
+
+/* Private Declarations */
+static int CellSide(double area);
+static void BuildCtrlGrid(DlgTemplate* dlg);
+static unsigned CellCol(CtrlGrid* grid, int x);
+static unsigned CellRow(CtrlGrid* grid, int y);
+static void GetCellSpan(CtrlGrid* grid, DlgItem* pCtrl, CellSpan* span);
+static unsigned FindCtrl(HitRects* cell, unsigned ctrlNum);
+static void ListCtrl(CtrlGrid* grid, unsigned ctrlNum, DlgItem* pCtrl);
+static void UnlistCtrl(CtrlGrid* grid, unsigned ctrlNum);
+static int CompareCtrlNums(const void* a, const void* b);
+
+/* Returns the side of a square with the given area, rounded up */
+static int CellSide(double area)
+{
+	double side;
+	unsigned i;
+	if (area <= 1)
+		return 1;
+	if (area >= 1.0e18)
+		return 1000000000;
+	side = area;
+	for (i = 0; i < 64 && side * side > area + 1; i++)
+		side = (side + area / side) / 2;
+	return (int)side + 1;
+}
+
+static void BuildCtrlGrid(DlgTemplate* dlg)
+{
+	CtrlGrid* grid;
+	unsigned numCtrls;
+	unsigned i;
+	int minX, minY, maxX, maxY;
+	double sumCx, sumCy;
+	int side, avgCx, avgCy;
+	double numCells;
+
+	numCtrls = dlg->controls.len;
+	minX = 0; minY = 0; maxX = 1; maxY = 1;
+	sumCx = 0; sumCy = 0;
+	for (i = 0; i < numCtrls; i++)
+	{
+		DlgItem* pCtrl;
+		pCtrl = &dlg->controls.d[i];
+		if (i == 0 || pCtrl->x < minX)
+			minX = pCtrl->x;
+		if (i == 0 || pCtrl->y < minY)
+			minY = pCtrl->y;
+		if (i == 0 || pCtrl->x + pCtrl->cx > maxX)
+			maxX = pCtrl->x + pCtrl->cx;
+		if (i == 0 || pCtrl->y + pCtrl->cy > maxY)
+			maxY = pCtrl->y + pCtrl->cy;
+		if (pCtrl->cx > 0)
+			sumCx += pCtrl->cx;
+		if (pCtrl->cy > 0)
+			sumCy += pCtrl->cy;
+	}
+	if (maxX <= minX)
+		maxX = minX + 1;
+	if (maxY <= minY)
+		maxY = minY + 1;
+
+	grid = (CtrlGrid*)xmalloc(sizeof(CtrlGrid));
+	grid->originX = minX;
+	grid->originY = minY;
+	/* Give each cell the area of a few controls, but do not make the
+	   cells smaller than the average control */
+	avgCx = 1; avgCy = 1;
+	if (numCtrls > 0)
+	{
+		avgCx = (int)(sumCx / numCtrls) + 1;
+		avgCy = (int)(sumCy / numCtrls) + 1;
+	}
+	side = CellSide((double)(maxX - minX) * (maxY - minY) *
+					CTRLS_PER_CELL / (numCtrls + 1));
+	grid->cellCx = (side > avgCx) ? side : avgCx;
+	grid->cellCy = (side > avgCy) ? side : avgCy;
+	while (1)
+	{
+		grid->cols = (unsigned)(((double)maxX - minX + grid->cellCx - 1) /
+								grid->cellCx);
+		grid->rows = (unsigned)(((double)maxY - minY + grid->cellCy - 1) /
+								grid->cellCy);
+		numCells = (double)grid->cols * grid->rows;
+		/* Very long and thin layouts can still ask for too many
+		   cells */
+		if (numCells <= 2.0 * numCtrls + 16)
+			break;
+		grid->cellCx *= 2;
+		grid->cellCy *= 2;
+	}
+	if (grid->cols == 0)
+		grid->cols = 1;
+	if (grid->rows == 0)
+		grid->rows = 1;
+
+	grid->cells = (HitRects*)xmalloc(sizeof(HitRects) *
+									 grid->cols * grid->rows);
+	for (i = 0; i < grid->cols * grid->rows; i++)
+		InitHitRects(&grid->cells[i]);
+	EA_INIT(CellSpan, grid->spans, numCtrls + 1);
+	grid->spans.len = numCtrls;
+	grid->builtLen = numCtrls;
+	for (i = 0; i < numCtrls; i++)
+		ListCtrl(grid, i, &dlg->controls.d[i]);
+	dlg->grid = grid;
+}
+
+/* Returns the column of the cell that the given X coordinate falls
+   in.  Coordinates outside of the grid go to the nearest column. */
+static unsigned CellCol(CtrlGrid* grid, int x)
+{
+	unsigned col;
+	if (x < grid->originX)
+		return 0;
+	col = ((unsigned)x - (unsigned)grid->originX) / (unsigned)grid->cellCx;
+	if (col >= grid->cols)
+		col = grid->cols - 1;
+	return col;
+}
+
+static unsigned CellRow(CtrlGrid* grid, int y)
+{
+	unsigned row;
+	if (y < grid->originY)
+		return 0;
+	row = ((unsigned)y - (unsigned)grid->originY) / (unsigned)grid->cellCy;
+	if (row >= grid->rows)
+		row = grid->rows - 1;
+	return row;
+}
+
+static void GetCellSpan(CtrlGrid* grid, DlgItem* pCtrl, CellSpan* span)
+{
+	span->col0 = CellCol(grid, pCtrl->x);
+	span->row0 = CellRow(grid, pCtrl->y);
+	/* Empty controls never match, so one cell is enough for them */
+	if (pCtrl->cx > 0)
+		span->col1 = CellCol(grid, pCtrl->x + pCtrl->cx - 1);
+	else
+		span->col1 = span->col0;
+	if (pCtrl->cy > 0)
+		span->row1 = CellRow(grid, pCtrl->y + pCtrl->cy - 1);
+	else
+		span->row1 = span->row0;
+}
+
+/* Returns the position of the first control in the cell whose number
+   is not less than "ctrlNum" */
+static unsigned FindCtrl(HitRects* cell, unsigned ctrlNum)
+{
+	unsigned lo, hi;
+	lo = 0;
+	hi = cell->len;
+	while (lo < hi)
+	{
+		unsigned mid;
+		mid = lo + (hi - lo) / 2;
+		if (cell->ids[mid] < ctrlNum)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* Adds a control to the cells that it overlaps and records its
+   span */
+static void ListCtrl(CtrlGrid* grid, unsigned ctrlNum, DlgItem* pCtrl)
+{
+	CellSpan* span;
+	unsigned col, row;
+	span = &grid->spans.d[ctrlNum];
+	GetCellSpan(grid, pCtrl, span);
+	for (row = span->row0; row <= span->row1; row++)
+	{
+		for (col = span->col0; col <= span->col1; col++)
+		{
+			HitRects* cell;
+			cell = &grid->cells[row * grid->cols + col];
+			InsertHitRect(cell, FindCtrl(cell, ctrlNum), ctrlNum,
+						  pCtrl->x, pCtrl->y,
+						  pCtrl->x + pCtrl->cx, pCtrl->y + pCtrl->cy);
+		}
+	}
+}
+
+/* Removes a control from the cells of its recorded span */
+static void UnlistCtrl(CtrlGrid* grid, unsigned ctrlNum)
+{
+	CellSpan* span;
+	unsigned col, row;
+	span = &grid->spans.d[ctrlNum];
+	for (row = span->row0; row <= span->row1; row++)
+	{
+		for (col = span->col0; col <= span->col1; col++)
+		{
+			HitRects* cell;
+			cell = &grid->cells[row * grid->cols + col];
+			RemoveHitRect(cell, FindCtrl(cell, ctrlNum));
+		}
+	}
+}
+
+static int CompareCtrlNums(const void* a, const void* b)
+{
+	unsigned numA, numB;
+	numA = *(const unsigned*)a;
+	numB = *(const unsigned*)b;
+	if (numA < numB)
+		return -1;
+	return (numA > numB) ? 1 : 0;
+}
+
+/* Returns the spatial index of the dialog template's controls,
+   building it if it does not exist yet. */
+CtrlGrid* GetCtrlGrid(DlgTemplate* dlg)
+{
+	if (dlg->grid == NULL)
+		BuildCtrlGrid(dlg);
+	return dlg->grid;
+}
+
+/* Returns the number of the topmost control that contains the given
+   point in dialog units, or -1 if there is none.  Later controls are
+   painted over earlier ones, so the topmost control is the last one
+   in the control list. */
+int HitTestCtrls(DlgTemplate* dlg, int x, int y)
+{
+	CtrlGrid* grid;
+	HitRects* cell;
+	int pos;
+	grid = GetCtrlGrid(dlg);
+	cell = &grid->cells[CellRow(grid, y) * grid->cols + CellCol(grid, x)];
+	pos = HitTestRects(cell, x, y);
+	if (pos == -1)
+		return -1;
+	return (int)cell->ids[pos];
+}
+
+/* Finds the controls that overlap the given rectangle in dialog
+   units, which includes the left and top edges but not the right and
+   bottom edges.  The control numbers are written to "result" in
+   increasing order, which is the painting order.  "result" must have
+   been initialized with EA_INIT(). */
+void QueryCtrlRect(DlgTemplate* dlg, int left, int top,
+				   int right, int bottom, unsigned_array* result)
+{
+	CtrlGrid* grid;
+	unsigned col0, row0, col1, row1;
+	unsigned col, row;
+	result->len = 0;
+	if (right <= left || bottom <= top)
+		return;
+	grid = GetCtrlGrid(dlg);
+	col0 = CellCol(grid, left);
+	row0 = CellRow(grid, top);
+	col1 = CellCol(grid, right - 1);
+	row1 = CellRow(grid, bottom - 1);
+	for (row = row0; row <= row1; row++)
+	{
+		for (col = col0; col <= col1; col++)
+		{
+			HitRects* cell;
+			unsigned i;
+			cell = &grid->cells[row * grid->cols + col];
+			for (i = 0; i < cell->len; i++)
+			{
+				CellSpan* span;
+				if (cell->left[i] >= right || cell->right[i] <= left ||
+					cell->top[i] >= bottom || cell->bottom[i] <= top)
+					continue;
+				/* A control that spans several cells is only reported
+				   from the first of them that the query covers */
+				span = &grid->spans.d[cell->ids[i]];
+				if (col != ((span->col0 > col0) ? span->col0 : col0) ||
+					row != ((span->row0 > row0) ? span->row0 : row0))
+					continue;
+				EA_APPEND(unsigned, *result, cell->ids[i]);
+			}
+		}
+	}
+	if (col0 != col1 || row0 != row1)
+		qsort(result->d, result->len, sizeof(unsigned), CompareCtrlNums);
+}
+
+/* Adds the last control of the dialog template to the index.  The
+   control must already be filled in. */
+void CtrlGridAdd(DlgTemplate* dlg)
+{
+	CtrlGrid* grid;
+	unsigned ctrlNum;
+	grid = dlg->grid;
+	if (grid == NULL)
+		return;
+	ctrlNum = dlg->controls.len - 1;
+	/* A grid sized for far fewer controls is slow, so build a new
+	   one when it is needed */
+	if (ctrlNum > grid->builtLen * 2 + 64)
+	{
+		FreeCtrlGrid(dlg);
+		return;
+	}
+	EA_ADD(CellSpan, grid->spans);
+	ListCtrl(grid, ctrlNum, &dlg->controls.d[ctrlNum]);
+}
+
+/* Removes a control from the index.  The controls after it are
+   renumbered to match the control list. */
+void CtrlGridRemove(DlgTemplate* dlg, unsigned ctrlNum)
+{
+	CtrlGrid* grid;
+	unsigned i;
+	grid = dlg->grid;
+	if (grid == NULL)
+		return;
+	UnlistCtrl(grid, ctrlNum);
+	EA_REMOVE(CellSpan, grid->spans, ctrlNum);
+	for (i = 0; i < grid->cols * grid->rows; i++)
+	{
+		HitRects* cell;
+		unsigned pos;
+		cell = &grid->cells[i];
+		for (pos = FindCtrl(cell, ctrlNum); pos < cell->len; pos++)
+			cell->ids[pos]--;
+	}
+}
+
+/* Updates the index after a control was moved or resized. */
+void CtrlGridMove(DlgTemplate* dlg, unsigned ctrlNum)
+{
+	CtrlGrid* grid;
+	DlgItem* pCtrl;
+	CellSpan newSpan;
+	CellSpan* span;
+	grid = dlg->grid;
+	if (grid == NULL)
+		return;
+	pCtrl = &dlg->controls.d[ctrlNum];
+	span = &grid->spans.d[ctrlNum];
+	GetCellSpan(grid, pCtrl, &newSpan);
+	if (newSpan.col0 == span->col0 && newSpan.row0 == span->row0 &&
+		newSpan.col1 == span->col1 && newSpan.row1 == span->row1)
+	{
+		/* Still in the same cells, so just update the rectangles */
+		unsigned col, row;
+		for (row = span->row0; row <= span->row1; row++)
+		{
+			for (col = span->col0; col <= span->col1; col++)
+			{
+				HitRects* cell;
+				cell = &grid->cells[row * grid->cols + col];
+				SetHitRect(cell, FindCtrl(cell, ctrlNum),
+						   pCtrl->x, pCtrl->y,
+						   pCtrl->x + pCtrl->cx, pCtrl->y + pCtrl->cy);
+			}
+		}
+		return;
+	}
+	UnlistCtrl(grid, ctrlNum);
+	ListCtrl(grid, ctrlNum, pCtrl);
+}
+
+void FreeCtrlGrid(DlgTemplate* dlg)
+{
+	CtrlGrid* grid;
+	unsigned i;
+	grid = dlg->grid;
+	if (grid == NULL)
+		return;
+	for (i = 0; i < grid->cols * grid->rows; i++)
+		FreeHitRects(&grid->cells[i]);
+	xfree(grid->cells);
+	EA_DESTROY(CellSpan, grid->spans);
+	xfree(grid);
+	dlg->grid = NULL;
+}
@@ -0,0 +1,50 @@
+/* Spatial index of the controls of a dialog template.  The index is
+   a uniform grid over the control rectangles, in dialog units, that
+   answers point and rectangle queries without looking at every
+   control. */
+
+#ifndef CTRLGRID_H
+#define CTRLGRID_H
+
+#include "tmplparser.h"
+#include "hitrects.h"
+
+EA_TYPE(unsigned);
+
+/* The range of cells that a control is listed in */
+struct CellSpan_t
+{
+	unsigned col0, row0;
+	unsigned col1, row1; /* Inclusive */
+};
+
+typedef struct CellSpan_t CellSpan;
+
+EA_TYPE(CellSpan);
+
+/* Each cell lists the controls that overlap it, in increasing order
+   of control number, which is also the painting order.  Controls
+   outside of the grid are listed in the nearest cells on the edge, so
+   the grid stays correct when a control moves out of it. */
+struct CtrlGrid_t
+{
+	int originX, originY; /* Top-left corner of cell (0, 0) */
+	int cellCx, cellCy;
+	unsigned cols, rows;
+	HitRects* cells; /* "cols" * "rows" cells, row by row */
+	CellSpan_array spans; /* One for each control */
+	unsigned builtLen; /* Number of controls that the grid was sized for */
+};
+
+typedef struct CtrlGrid_t CtrlGrid;
+
+CtrlGrid* GetCtrlGrid(DlgTemplate* dlg);
+int HitTestCtrls(DlgTemplate* dlg, int x, int y);
+void QueryCtrlRect(DlgTemplate* dlg, int left, int top,
+				   int right, int bottom, unsigned_array* result);
+void CtrlGridAdd(DlgTemplate* dlg);
+void CtrlGridRemove(DlgTemplate* dlg, unsigned ctrlNum);
+void CtrlGridMove(DlgTemplate* dlg, unsigned ctrlNum);
+void FreeCtrlGrid(DlgTemplate* dlg);
+
+#endif /* not CTRLGRID_H */
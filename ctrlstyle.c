@@ -0,0 +1,118 @@
+/* Window style constants and style expressions.
+
+   This is platform independent code.  The constants are listed in
+   styletab.def, and styletab.h holds their perfect hash table, which
+   is generated from the list by mkstyletab. */
+
+#include <string.h>
+
+#include "ctrlstyle.h"
+#include "tmpllex.h"
+#include "rcexpr.h"
+#include "styletab.h"
+
+struct StyleConst_t
+{
+	const char* name;
+	unsigned value;
+};
+
+typedef struct StyleConst_t StyleConst;
+
+/* Indexes in the hash table count from one, so the first entry is
+   unused */
+#define STYLE_CONST(name, value) {#name, value},
+static const StyleConst styleConsts[NUM_STYLE_CONSTS+1] =
+{
+	{"", 0},
+#include "styletab.def"
+};
+#undef STYLE_CONST
+
+/* Finds the value of a style constant.  Returns FALSE if the
+   identifier is not a known constant.  Constants are case
+   sensitive. */
+BOOL LookupStyleConst(const char* str, unsigned len, unsigned* pValue)
+{
+	unsigned long h;
+	unsigned slot;
+	unsigned i;
+	const StyleConst* sc;
+	if (len == 0 || len > MAX_STYLE_CONST_LEN)
+		return FALSE;
+	h = 0;
+	for (i = 0; i < len; i++)
+		h = (h * STYLE_HASH_MULT + (unsigned char)str[i]) & 0xffffffffUL;
+	slot = (STYLE_HASH_SLOT(h) + styleHashDisp[STYLE_HASH_BUCKET(h)]) &
+		(STYLE_TABLE_SIZE - 1);
+	if (styleHashTable[slot] == 0)
+		return FALSE;
+	sc = &styleConsts[styleHashTable[slot]];
+	if (strncmp(sc->name, str, len) != 0 || sc->name[len] != '\0')
+		return FALSE;
+	*pValue = sc->value;
+	return TRUE;
+}
+
+/* Applies a style expression to the style in "pStyle", which should
+   hold the default style of the window on entry.  The terms of the
+   expression are separated by '|' and each one sets its bits, except
+   that a term after NOT clears its bits, as the resource compiler
+   does.  Parentheses are ignored.
+
+   Returns FALSE if the expression has identifiers that are not known
+   style constants, or operators other than '|'.  Those terms are
+   skipped, and the other terms are still applied. */
+BOOL EvalStyleExpr(const char* src, unsigned len, unsigned* pStyle)
+{
+	TmplLexer lex;
+	TmplToken tok;
+	unsigned style;
+	BOOL negate;
+	BOOL resolved;
+	style = *pStyle;
+	negate = FALSE;
+	resolved = TRUE;
+	InitTmplLexer(&lex, src, len, 0, 1);
+	NextTmplToken(&lex, &tok);
+	while (tok.type != TOK_EOF)
+	{
+		unsigned value;
+		BOOL known;
+		known = FALSE;
+		if (tok.keyword == KW_NOT)
+		{
+			negate = TRUE;
+			NextTmplToken(&lex, &tok);
+			continue;
+		}
+		if (IS_PUNCT(tok, '|') || IS_PUNCT(tok, '(') || IS_PUNCT(tok, ')'))
+		{
+			NextTmplToken(&lex, &tok);
+			continue;
+		}
+		if (tok.type == TOK_IDENT)
+			known = LookupStyleConst(tok.str, tok.len, &value);
+		else if (tok.type == TOK_NUMBER)
+		{
+			unsigned used;
+			long numVal;
+			known = (BOOL)(ParseIntText(tok.str, tok.len, &used, &numVal) ==
+						   EXPR_OK);
+			value = (unsigned)numVal;
+		}
+		if (known == TRUE)
+		{
+			if (negate == TRUE)
+				style &= ~value;
+			else
+				style |= value;
+		}
+		else
+			resolved = FALSE;
+		negate = FALSE;
+		NextTmplToken(&lex, &tok);
+	}
+	*pStyle = style;
+	return resolved;
+}
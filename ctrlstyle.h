@@ -0,0 +1,15 @@
+/* Window style constants and style expressions.  STYLE and EXSTYLE
+   expressions, such as "WS_CHILD | NOT WS_VISIBLE | BS_AUTORADIOBUTTON",
+   are decoded into numeric masks with a perfect hash table of the
+   WS_, WS_EX_, DS_, BS_, SS_, ES_, SBS_, LBS_, and CBS_ constants. */
+
+#ifndef CTRLSTYLE_H
+#define CTRLSTYLE_H
+
+/* Include Windows data types (BOOL) */
+#include "subwindef.h"
+
+BOOL LookupStyleConst(const char* str, unsigned len, unsigned* pValue);
+BOOL EvalStyleExpr(const char* src, unsigned len, unsigned* pStyle);
+
+#endif /* not CTRLSTYLE_H */
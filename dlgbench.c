@@ -0,0 +1,662 @@
+/* Scaling benchmark for the dialog template library.
+
+   Generates dialog templates with a given number of controls from a
+   seeded random number generator, so that every run with the same
+   seed measures the same input, and times each phase of loading,
+   formatting, and hit-testing them.  The results are written as
+   JSON, and can be compared with a saved baseline to find
+   regressions.
+
+   This is platform independent code. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xmalloc.h"
+#include "tmplparser.h"
+#include "ctrlgrid.h"
+#include "nlconv.h"
+#include "strintern.h"
+#include "strarena.h"
+#include "dlgprof.h"
+
+/* MSVC >= 8.0 pragmas */
+#if _MSC_VER >= 1400
+#pragma warning (disable: 4996) /* Disable deprecate */
+#endif
+
+#define MAX_COUNTS 16
+#define NUM_HIT_POINTS 100000
+
+/* The phases that are timed, in the order that they are run */
+enum BenchPhase
+{
+	PH_NL_CONV, /* SetUnixNlChars() on the whole template */
+	PH_PARSE_HEAD, /* ParseDlgHead() */
+	PH_PARSE, /* ParseDlgTemplate(), mostly ParseControl() */
+	PH_FMT_CONTROLS, /* FmtControlText() for every control */
+	PH_SERIALIZE, /* FmtDlgTemplateNl(), what saving a template does */
+	PH_GRID_BUILD, /* Building the spatial index */
+	PH_HIT_TEST, /* NUM_HIT_POINTS point queries */
+	NUM_PHASES
+};
+
+static const char* phaseNames[NUM_PHASES] =
+{
+	"nl_conv", "parse_head", "parse", "fmt_controls", "serialize",
+	"grid_build", "hit_test"
+};
+
+struct BenchOpts_t
+{
+	unsigned counts[MAX_COUNTS];
+	unsigned numCounts;
+	unsigned long seed;
+	unsigned reps;
+	const char* outName; /* NULL for standard output */
+	const char* genName; /* Only write a generated template */
+	const char* baseName; /* Baseline to compare with */
+	double threshold; /* Allowed slowdown, as a fraction */
+};
+
+typedef struct BenchOpts_t BenchOpts;
+
+/* The fastest time of each phase, in milliseconds */
+struct BenchResult_t
+{
+	unsigned numCtrls;
+	unsigned textLen;
+	double ms[NUM_PHASES];
+};
+
+typedef struct BenchResult_t BenchResult;
+
+/* Text that is appended to a growing buffer */
+struct GenBuf_t
+{
+	char* d;
+	unsigned len;
+	unsigned cap;
+};
+
+typedef struct GenBuf_t GenBuf;
+
+static unsigned long rngState;
+
+static void PrintUsage(FILE* fp);
+static BOOL ParseOptions(BenchOpts* opts, int argc, char* argv[]);
+static void SeedRand(unsigned long seed);
+static unsigned NextRand(unsigned limit);
+static void GenPut(GenBuf* buf, const char* text, unsigned len);
+static void GenPutStr(GenBuf* buf, const char* text);
+static void GenPutInt(GenBuf* buf, int value);
+static void GenCaption(GenBuf* buf);
+static heap_char GenTemplate(unsigned numCtrls, unsigned long seed,
+							 unsigned* pLen);
+static void RunBench(BenchOpts* opts, unsigned numCtrls,
+					 BenchResult* result);
+static void WriteResults(FILE* fp, BenchOpts* opts,
+						 BenchResult* results, unsigned numResults);
+static BOOL FindBaseline(const char* text, unsigned numCtrls,
+						 const char* phase, double* pMs);
+static int CompareResults(BenchOpts* opts, BenchResult* results,
+						  unsigned numResults);
+
+int main(int argc, char* argv[])
+{
+	BenchOpts opts;
+	BenchResult results[MAX_COUNTS];
+	unsigned i;
+	int retVal;
+
+	if (!ParseOptions(&opts, argc - 1, argv + 1))
+		return 2;
+
+	if (opts.genName != NULL)
+	{
+		char* text;
+		unsigned textLen;
+		FILE* fp;
+		text = GenTemplate(opts.counts[0], opts.seed, &textLen);
+		fp = fopen(opts.genName, "wb");
+		if (fp == NULL)
+		{
+			fprintf(stderr, "%s: Cannot open file for writing.\n",
+					opts.genName);
+			xfree(text);
+			return 1;
+		}
+		fwrite(text, textLen, 1, fp);
+		fclose(fp);
+		xfree(text);
+		return 0;
+	}
+
+	for (i = 0; i < opts.numCounts; i++)
+	{
+		fprintf(stderr, "dlgbench: %u controls...\n", opts.counts[i]);
+		RunBench(&opts, opts.counts[i], &results[i]);
+	}
+
+	retVal = 0;
+	if (opts.outName != NULL)
+	{
+		FILE* fp;
+		fp = fopen(opts.outName, "w");
+		if (fp == NULL)
+		{
+			fprintf(stderr, "%s: Cannot open file for writing.\n",
+					opts.outName);
+			retVal = 1;
+		}
+		else
+		{
+			WriteResults(fp, &opts, results, opts.numCounts);
+			fclose(fp);
+		}
+	}
+	else
+		WriteResults(stdout, &opts, results, opts.numCounts);
+
+	if (opts.baseName != NULL && retVal == 0)
+		retVal = CompareResults(&opts, results, opts.numCounts);
+	FreeInternTable();
+	FreeStrArenaCache();
+	return retVal;
+}
+
+static void PrintUsage(FILE* fp)
+{
+	fputs("Usage: dlgbench [OPTION]...\n"
+		  "\n"
+		  "Times the dialog template library on generated templates and\n"
+		  "writes the fastest time of each phase as JSON.\n"
+		  "\n"
+		  "Options:\n"
+		  "  -n N[,N]...  Numbers of controls to generate (default:\n"
+		  "               10,100,1000,10000,100000).\n"
+		  "  -s SEED      Seed for the template generator (default: 1).\n"
+		  "  -r N         Run each phase N times (default: 3).\n"
+		  "  -o FILE      Write the results to FILE.\n"
+		  "  -c FILE      Compare the results with a baseline written by\n"
+		  "               `-o', and exit with status 1 on a regression.\n"
+		  "  -t PERCENT   Slowdown that counts as a regression (default: 10).\n"
+		  "  -g FILE      Only write a template with the first number of\n"
+		  "               controls to FILE.\n",
+		  fp);
+}
+
+static BOOL ParseOptions(BenchOpts* opts, int argc, char* argv[])
+{
+	opts->counts[0] = 10;
+	opts->counts[1] = 100;
+	opts->counts[2] = 1000;
+	opts->counts[3] = 10000;
+	opts->counts[4] = 100000;
+	opts->numCounts = 5;
+	opts->seed = 1;
+	opts->reps = 3;
+	opts->outName = NULL;
+	opts->genName = NULL;
+	opts->baseName = NULL;
+	opts->threshold = 0.10;
+	while (argc > 0)
+	{
+		if (strcmp(argv[0], "--help") == 0)
+		{
+			PrintUsage(stdout);
+			exit(0);
+		}
+		if (argc < 2 || argv[0][0] != '-' || argv[0][1] == '\0' ||
+			argv[0][2] != '\0')
+			goto usageError;
+		switch (argv[0][1])
+		{
+		case 'n':
+		{
+			char* cur;
+			opts->numCounts = 0;
+			cur = argv[1];
+			while (*cur != '\0' && opts->numCounts < MAX_COUNTS)
+			{
+				long num;
+				num = strtol(cur, &cur, 10);
+				if (num <= 0 || num > 10000000 ||
+					(*cur != ',' && *cur != '\0'))
+					goto usageError;
+				opts->counts[opts->numCounts++] = (unsigned)num;
+				if (*cur == ',')
+					cur++;
+			}
+			if (opts->numCounts == 0)
+				goto usageError;
+			break;
+		}
+		case 's': opts->seed = strtoul(argv[1], NULL, 10); break;
+		case 'r':
+			opts->reps = (unsigned)atoi(argv[1]);
+			if (opts->reps == 0)
+				goto usageError;
+			break;
+		case 'o': opts->outName = argv[1]; break;
+		case 'c': opts->baseName = argv[1]; break;
+		case 't': opts->threshold = atof(argv[1]) / 100; break;
+		case 'g': opts->genName = argv[1]; break;
+		default: goto usageError;
+		}
+		argc -= 2;
+		argv += 2;
+	}
+	return TRUE;
+usageError:
+	PrintUsage(stderr);
+	return FALSE;
+}
+
+/* The generator uses its own xorshift random number generator, so
+   that a seed gives the same templates everywhere. */
+static void SeedRand(unsigned long seed)
+{
+	rngState = (seed & 0xffffffffUL) ^ 0x9e3779b9UL;
+	if (rngState == 0)
+		rngState = 1;
+}
+
+/* Returns a random number below "limit" */
+static unsigned NextRand(unsigned limit)
+{
+	rngState ^= (rngState << 13) & 0xffffffffUL;
+	rngState ^= rngState >> 17;
+	rngState ^= (rngState << 5) & 0xffffffffUL;
+	return (unsigned)(rngState % limit);
+}
+
+static void GenPut(GenBuf* buf, const char* text, unsigned len)
+{
+	if (buf->len + len > buf->cap)
+	{
+		while (buf->len + len > buf->cap)
+			buf->cap *= 2;
+		buf->d = (char*)xrealloc(buf->d, buf->cap);
+	}
+	memcpy(buf->d + buf->len, text, len);
+	buf->len += len;
+}
+
+static void GenPutStr(GenBuf* buf, const char* text)
+{
+	GenPut(buf, text, strlen(text));
+}
+
+static void GenPutInt(GenBuf* buf, int value)
+{
+	char num[16];
+	sprintf(num, "%d", value);
+	GenPutStr(buf, num);
+}
+
+/* Writes a quoted caption.  Most captions are a few words long, some
+   are sentences, and some contain escape codes. */
+static void GenCaption(GenBuf* buf)
+{
+	static const char* words[] =
+	{
+		"OK", "Cancel", "&Apply", "Name", "Options", "Advanced",
+		"Enable logging", "File", "Browse...", "Show hidden files",
+		"Color", "Default", "Font size:", "Use &proxy server",
+		"Properties", "Automatically check for updates"
+	};
+	static const char* escapes[] =
+	{
+		"\\n", "\\t", "\"\"", "\\\\", "\\\"", "\\101"
+	};
+	unsigned numWords, i;
+	unsigned kind;
+	kind = NextRand(100);
+	if (kind < 70)
+		numWords = 1 + NextRand(3);
+	else if (kind < 95)
+		numWords = 4 + NextRand(8);
+	else
+		numWords = 12 + NextRand(30);
+	GenPut(buf, "\"", 1);
+	for (i = 0; i < numWords; i++)
+	{
+		if (i > 0)
+		{
+			if (NextRand(100) < 5)
+				GenPutStr(buf, escapes[NextRand(6)]);
+			else
+				GenPut(buf, " ", 1);
+		}
+		GenPutStr(buf, words[NextRand(16)]);
+	}
+	GenPut(buf, "\"", 1);
+}
+
+/* Generates a dialog template with CRLF line endings.  The controls
+   are laid out in rows over a large dialog, with a realistic mix of
+   types, captions, IDs, and styles.  The caller must free the
+   returned text. */
+static heap_char GenTemplate(unsigned numCtrls, unsigned long seed,
+							 unsigned* pLen)
+{
+	static const char* textTypes[] =
+	{
+		"LTEXT", "LTEXT", "LTEXT", "RTEXT", "CTEXT", "PUSHBUTTON",
+		"PUSHBUTTON", "DEFPUSHBUTTON", "AUTOCHECKBOX", "CHECKBOX",
+		"AUTORADIOBUTTON", "RADIOBUTTON", "GROUPBOX", "AUTO3STATE"
+	};
+	static const char* boxTypes[] = { "EDITTEXT", "COMBOBOX", "LISTBOX" };
+	static const char* styles[] =
+	{
+		"WS_TABSTOP", "WS_TABSTOP | WS_GROUP", "NOT WS_VISIBLE",
+		"BS_CENTER | WS_TABSTOP", "ES_AUTOHSCROLL | WS_BORDER",
+		"WS_VSCROLL | NOT WS_TABSTOP", "SS_NOPREFIX"
+	};
+	GenBuf buf;
+	unsigned numCols;
+	unsigned i;
+
+	SeedRand(seed);
+	buf.cap = 256 + numCtrls * 64;
+	buf.d = (char*)xmalloc(buf.cap);
+	buf.len = 0;
+	/* Keep the dialog roughly square */
+	numCols = 1;
+	while (numCols * numCols * 4 < numCtrls)
+		numCols++;
+
+	GenPutStr(&buf, "IDD_BENCH DIALOGEX 0, 0, ");
+	GenPutInt(&buf, numCols * 64 + 8);
+	GenPutStr(&buf, ", ");
+	GenPutInt(&buf, (numCtrls / numCols + 1) * 16 + 8);
+	GenPutStr(&buf, "\r\nCAPTION \"Generated \\\"benchmark\\\" dialog\"\r\n"
+			  "STYLE WS_POPUP | WS_SYSMENU | WS_CAPTION | DS_MODALFRAME\r\n"
+			  "FONT 8, \"MS Shell Dlg\"\r\n{\r\n");
+	for (i = 0; i < numCtrls; i++)
+	{
+		unsigned kind;
+		int x, y, cx, cy;
+		x = (i % numCols) * 64 + 8 + NextRand(4);
+		y = (i / numCols) * 16 + 8;
+		cx = 20 + NextRand(50);
+		cy = 8 + NextRand(8);
+		kind = NextRand(100);
+		GenPut(&buf, "\t", 1);
+		if (kind < 65)
+		{
+			GenPutStr(&buf, textTypes[NextRand(14)]);
+			GenPut(&buf, " ", 1);
+			GenCaption(&buf);
+		}
+		else if (kind < 85)
+			GenPutStr(&buf, boxTypes[NextRand(3)]);
+		else if (kind < 88)
+		{
+			GenPutStr(&buf, "ICON IDI_APP");
+			cx = cy = 16;
+		}
+		else if (kind < 92)
+		{
+			GenPutStr(&buf, "SCROLLBAR");
+			cx = 8;
+		}
+		else
+		{
+			GenPutStr(&buf, "CONTROL ");
+			GenCaption(&buf);
+		}
+		/* Types without a caption or icon take the ID first */
+		if ((kind >= 65 && kind < 85) || (kind >= 88 && kind < 92))
+			GenPut(&buf, " ", 1);
+		else
+			GenPutStr(&buf, ", ");
+		/* Most controls have symbolic IDs */
+		if (NextRand(10) < 8)
+		{
+			GenPutStr(&buf, "IDC_CTRL");
+			GenPutInt(&buf, i);
+		}
+		else
+			GenPutInt(&buf, 1000 + i);
+		if (kind >= 92)
+		{
+			GenPutStr(&buf, ", \"SysListView32\", ");
+			GenPutStr(&buf, styles[NextRand(7)]);
+		}
+		GenPutStr(&buf, ", ");
+		GenPutInt(&buf, x);
+		GenPutStr(&buf, ", ");
+		GenPutInt(&buf, y);
+		GenPutStr(&buf, ", ");
+		GenPutInt(&buf, cx);
+		GenPutStr(&buf, ", ");
+		GenPutInt(&buf, cy);
+		if (kind >= 88 && kind < 92)
+			GenPutStr(&buf, NextRand(2) ? ", SBS_VERT" : ", SBS_HORZ");
+		else if (kind < 88 && NextRand(10) < 3)
+		{
+			GenPutStr(&buf, ", ");
+			GenPutStr(&buf, styles[NextRand(7)]);
+		}
+		GenPutStr(&buf, "\r\n");
+	}
+	GenPutStr(&buf, "}\r\n");
+	/* Leave room for a null character */
+	GenPut(&buf, "", 1);
+	*pLen = buf.len - 1;
+	return buf.d;
+}
+
+/* Keeps the smaller of the two times */
+#define KEEP_MIN(var, ms) if ((var) < 0 || (ms) < (var)) (var) = (ms)
+
+static void RunBench(BenchOpts* opts, unsigned numCtrls,
+					 BenchResult* result)
+{
+	char* text;
+	char* work;
+	unsigned textLen;
+	int* hitPoints;
+	unsigned rep, i;
+
+	text = GenTemplate(numCtrls, opts->seed, &textLen);
+	work = (char*)xmalloc(textLen + 1);
+	result->numCtrls = numCtrls;
+	result->textLen = textLen;
+	for (i = 0; i < NUM_PHASES; i++)
+		result->ms[i] = -1;
+
+	/* Spread the query points over the dialog and a margin around
+	   it */
+	SeedRand(opts->seed + numCtrls);
+	hitPoints = (int*)xmalloc(sizeof(int) * 2 * NUM_HIT_POINTS);
+	{
+		unsigned dlgCx, dlgCy;
+		dlgCx = 1;
+		while (dlgCx * dlgCx * 4 < numCtrls)
+			dlgCx++;
+		dlgCy = (numCtrls / dlgCx + 1) * 16 + 32;
+		dlgCx = dlgCx * 64 + 32;
+		for (i = 0; i < NUM_HIT_POINTS; i++)
+		{
+			hitPoints[i*2] = (int)NextRand(dlgCx) - 8;
+			hitPoints[i*2+1] = (int)NextRand(dlgCy) - 8;
+		}
+	}
+
+	for (rep = 0; rep < opts->reps; rep++)
+	{
+		DlgTemplate dlg;
+		ParseCtx ctx;
+		double start;
+		unsigned outLen;
+		char* out;
+		int numHits;
+
+		memcpy(work, text, textLen + 1);
+		start = ProfClock();
+		SetUnixNlChars(work, textLen);
+		KEEP_MIN(result->ms[PH_NL_CONV], (ProfClock() - start) * 1000);
+
+		InitDlgData(&dlg);
+		InitParseCtx(&ctx, &dlg);
+		start = ProfClock();
+		ParseDlgHead(&ctx, text, textLen);
+		KEEP_MIN(result->ms[PH_PARSE_HEAD], (ProfClock() - start) * 1000);
+		FreeDlgData(&dlg);
+
+		InitDlgData(&dlg);
+		InitParseCtx(&ctx, &dlg);
+		start = ProfClock();
+		if (!ParseDlgTemplate(&ctx, text, textLen))
+		{
+			fprintf(stderr, "dlgbench: generated template does not "
+					"parse, line %u: %s\n", ctx.curLine, ctx.errorDesc);
+			exit(1);
+		}
+		KEEP_MIN(result->ms[PH_PARSE], (ProfClock() - start) * 1000);
+
+		start = ProfClock();
+		for (i = 0; i < dlg.controls.len; i++)
+			xfree(FmtControlText(&ctx, i));
+		KEEP_MIN(result->ms[PH_FMT_CONTROLS],
+				 (ProfClock() - start) * 1000);
+
+		start = ProfClock();
+		out = FmtDlgTemplateNl(&ctx, NL_CRLF, &outLen);
+		KEEP_MIN(result->ms[PH_SERIALIZE], (ProfClock() - start) * 1000);
+		xfree(out);
+
+		start = ProfClock();
+		GetCtrlGrid(&dlg);
+		KEEP_MIN(result->ms[PH_GRID_BUILD], (ProfClock() - start) * 1000);
+
+		numHits = 0;
+		start = ProfClock();
+		for (i = 0; i < NUM_HIT_POINTS; i++)
+		{
+			if (HitTestCtrls(&dlg, hitPoints[i*2], hitPoints[i*2+1]) != -1)
+				numHits++;
+		}
+		KEEP_MIN(result->ms[PH_HIT_TEST], (ProfClock() - start) * 1000);
+		/* Keep the compiler from dropping the queries */
+		if (numHits > NUM_HIT_POINTS)
+			fputs("", stderr);
+
+		FreeDlgData(&dlg);
+	}
+
+	xfree(hitPoints);
+	xfree(work);
+	xfree(text);
+}
+
+static void WriteResults(FILE* fp, BenchOpts* opts,
+						 BenchResult* results, unsigned numResults)
+{
+	unsigned i, j;
+	fprintf(fp, "{\n  \"seed\": %lu,\n  \"reps\": %u,\n"
+			"  \"kernels\": { \"nlconv\": \"%s\", \"hitrects\": \"%s\" },\n"
+			"  \"results\": [\n",
+			opts->seed, opts->reps, NlConvKernelName(),
+			HitRectsKernelName());
+	for (i = 0; i < numResults; i++)
+	{
+		fprintf(fp, "    { \"controls\": %u, \"bytes\": %u, \"ms\": {",
+				results[i].numCtrls, results[i].textLen);
+		for (j = 0; j < NUM_PHASES; j++)
+		{
+			fprintf(fp, "%s\n        \"%s\": %.4f", (j > 0) ? "," : "",
+					phaseNames[j], results[i].ms[j]);
+		}
+		fprintf(fp, " } }%s\n", (i + 1 < numResults) ? "," : "");
+	}
+	fputs("  ]\n}\n", fp);
+}
+
+/* Finds the time of a phase in a baseline written by WriteResults().
+   Returns FALSE if the baseline has no such time. */
+static BOOL FindBaseline(const char* text, unsigned numCtrls,
+						 const char* phase, double* pMs)
+{
+	const char* cur;
+	char key[64];
+	cur = text;
+	while ((cur = strstr(cur, "\"controls\":")) != NULL)
+	{
+		const char* end;
+		const char* found;
+		cur += 11;
+		if (strtoul(cur, NULL, 10) != numCtrls)
+			continue;
+		/* Only look within this result */
+		end = strchr(cur, '}');
+		if (end != NULL)
+			end = strchr(end + 1, '}');
+		sprintf(key, "\"%s\":", phase);
+		found = strstr(cur, key);
+		if (found == NULL || (end != NULL && found > end))
+			return FALSE;
+		*pMs = atof(found + strlen(key));
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/* Prints how each phase compares with the baseline.  Returns 1 if
+   any phase got slower by more than the threshold. */
+static int CompareResults(BenchOpts* opts, BenchResult* results,
+						  unsigned numResults)
+{
+	FILE* fp;
+	long size;
+	char* text;
+	unsigned i, j;
+	int retVal;
+
+	fp = fopen(opts->baseName, "rb");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "%s: No such file or directory.\n", opts->baseName);
+		return 1;
+	}
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	text = (char*)xmalloc(size + 1);
+	size = fread(text, 1, size, fp);
+	text[size] = '\0';
+	fclose(fp);
+
+	retVal = 0;
+	fprintf(stderr, "%10s %-14s %12s %12s %8s\n",
+			"controls", "phase", "baseline", "current", "change");
+	for (i = 0; i < numResults; i++)
+	{
+		for (j = 0; j < NUM_PHASES; j++)
+		{
+			double baseMs, curMs, change;
+			const char* flag;
+			if (!FindBaseline(text, results[i].numCtrls, phaseNames[j],
+							  &baseMs))
+				continue;
+			curMs = results[i].ms[j];
+			change = (baseMs > 0) ? (curMs - baseMs) / baseMs : 0;
+			/* Differences of a few microseconds are timer noise */
+			flag = "";
+			if (change > opts->threshold && curMs - baseMs > 0.05)
+			{
+				flag = "  REGRESSION";
+				retVal = 1;
+			}
+			fprintf(stderr, "%10u %-14s %9.3f ms %9.3f ms %+7.1f%%%s\n",
+					results[i].numCtrls, phaseNames[j], baseMs, curMs,
+					change * 100, flag);
+		}
+	}
+	xfree(text);
+	return retVal;
+}
@@ -9,6 +9,9 @@
 
 #include "xmalloc.h"
 #include "tmplparser.h"
+#include "tmplfile.h"
+#include "ctrlgrid.h"
+#include "strintern.h"
 #include "graphhit.h"
 #include "ufsys.h"
 
@@ -32,6 +35,9 @@ HWND textHwnd; /* Container window for text editor */
 HWND textBox; /* Actual text edit control */
 HFONT teFont = NULL; /* Text edit window font */
 
+/* Document variables */
+DlgTemplate curDlg; /* The dialog template being edited */
+
 LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
 								LPARAM lParam);
 LRESULT CALLBACK TextWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
@@ -39,7 +45,7 @@ LRESULT CALLBACK TextWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
 INT_PTR CALLBACK AboutBoxProc(HWND hDlg, UINT uMsg, WPARAM wParam,
 							  LPARAM lParam);
 
-BOOL LoadDialogTemplate(char* filename, BOOL useNewTmpl);
+BOOL LoadDialogTemplate(ParseCtx* ctx, char* filename, BOOL useNewTmpl);
 BOOL SaveDialogTemplate(char* filename);
 
 void SetDlgHFont(HDC hDC);
@@ -150,18 +156,19 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
 	{
 	case WM_CREATE:
 	{
+		ParseCtx ctx;
 		HDC hDC;
 		dlgFont = NULL;
 
 		/* Create a hidden pseudo-window (for drawing the caption) */
-		dlgHasCaption = TRUE;
+		curDlg.hasCaption = TRUE;
 		pseudoHwnd = CreateWindowEx(0, "DEPseudoWindow", "Error",
 			WS_OVERLAPPEDWINDOW, CW_USEDEFAULT, CW_USEDEFAULT,
 			CW_USEDEFAULT, CW_USEDEFAULT, NULL, NULL, g_hInstance, NULL);
 
-		LoadDialogTemplate(curFilename, TRUE);
-		if (dlgHasCaption == TRUE)
-			SetWindowText(pseudoHwnd, dlgCaption);
+		LoadDialogTemplate(&ctx, curFilename, TRUE);
+		if (curDlg.hasCaption == TRUE)
+			SetWindowText(pseudoHwnd, curDlg.caption);
 		hDC = GetDC(hwnd);
 		SetDlgHFont(hDC);
 		UpdateFont(hDC);
@@ -177,7 +184,7 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
 			DestroyWindow(textHwnd);
 		DestroyWindow(pseudoHwnd);
 		DeleteObject(dlgFont);
-		FreeDlgData();
+		FreeDlgData(&curDlg);
 		PostQuitMessage(0);
 		break;
 	case WM_PAINT:
@@ -190,20 +197,20 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
 		SelectObject(hDC, dlgFont);
 		{
 			POINT scPos;
-			scPos.x = DLG2SCR_X(dlgPos.x);
-			scPos.y = DLG2SCR_Y(dlgPos.y);
-			if (dlgHasCaption == TRUE)
+			scPos.x = DLG2SCR_X(curDlg.pos.x);
+			scPos.y = DLG2SCR_Y(curDlg.pos.y);
+			if (curDlg.hasCaption == TRUE)
 				scPos.y += GetSystemMetrics(SM_CYCAPTION);
 			SetViewportOrgEx(hDC, scPos.x, scPos.y, NULL);
 		}
 
 		/* Draw the caption (if visible) */
-		if (dlgHasCaption == TRUE)
+		if (curDlg.hasCaption == TRUE)
 		{
 			rt.left = 0;
 			rt.top = 0 - GetSystemMetrics(SM_CYCAPTION);
 			rt.bottom = 0;
-			rt.right = DLG2SCR_X(dlgWidth);
+			rt.right = DLG2SCR_X(curDlg.width);
 			DrawCaption(pseudoHwnd, hDC, &rt, DC_ACTIVE | DC_ICON | DC_TEXT);
 			/* To keep things simple, don't draw the system buttons */
 			/*rt.left = rt.right - GetSystemMetrics(SM_CXSIZE) -
@@ -218,21 +225,33 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
 		hBr = GetSysColorBrush(COLOR_3DFACE);
 		rt.left = 0;
 		rt.top = 0;
-		rt.right = DLG2SCR_X(dlgWidth);
-		rt.bottom = DLG2SCR_Y(dlgHeight);
+		rt.right = DLG2SCR_X(curDlg.width);
+		rt.bottom = DLG2SCR_Y(curDlg.height);
 		FillRect(hDC, &rt, hBr);
 		if (activeCtrl == -1 && clickHit == FALSE)
 		{
 			/* Draw the selection around the dialog */
-			if (dlgHasCaption == TRUE)
+			if (curDlg.hasCaption == TRUE)
 				rt.top -= GetSystemMetrics(SM_CYCAPTION);
 			DrawSelRect(hDC, &rt);
 		}
 
+		/* Only draw the controls that overlap the update region,
+		   counting their selection borders */
 		{
+			unsigned_array visCtrls;
 			unsigned i;
-			for (i = 0; i < dlgControls.len; i++)
-				DrawDlgItemDispatch(hDC, i);
+			CopyRect(&rt, &ps.rcPaint);
+			DPtoLP(hDC, (POINT*)&rt, 2);
+			InflateRect(&rt, GetSystemMetrics(SM_CXEDGE) * 2,
+						GetSystemMetrics(SM_CYEDGE) * 2);
+			ScrUnitMap(&rt);
+			EA_INIT(unsigned, visCtrls, 16);
+			QueryCtrlRect(&curDlg, rt.left, rt.top, rt.right, rt.bottom,
+						  &visCtrls);
+			for (i = 0; i < visCtrls.len; i++)
+				DrawDlgItemDispatch(hDC, visCtrls.d[i]);
+			EA_DESTROY(unsigned, visCtrls);
 		}
 		EndPaint(hwnd, &ps);
 		break;
@@ -260,17 +279,17 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
 		winHeight = HIWORD(lParam);
 		xSmIcon = GetSystemMetrics(SM_CXSMICON);
 		ySmIcon = GetSystemMetrics(SM_CYSMICON);
-		if (dlgPos.x >= (winWidth - xSmIcon))
+		if (curDlg.pos.x >= (winWidth - xSmIcon))
 		{
-			dlgPos.x = winWidth - xSmIcon;
-			if (dlgPos.x <= 0)
-				dlgPos.x = 1;
+			curDlg.pos.x = winWidth - xSmIcon;
+			if (curDlg.pos.x <= 0)
+				curDlg.pos.x = 1;
 		}
-		if (dlgPos.y >= (winHeight - ySmIcon))
+		if (curDlg.pos.y >= (winHeight - ySmIcon))
 		{
-			dlgPos.y = winHeight - ySmIcon;
-			if (dlgPos.y <= 0)
-				dlgPos.y = 1;
+			curDlg.pos.y = winHeight - ySmIcon;
+			if (curDlg.pos.y <= 0)
+				curDlg.pos.y = 1;
 		}
 		break;
 	}*/
@@ -279,13 +298,14 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
 		{
 		case M_NEW:
 		{
+			ParseCtx ctx;
 			HDC hDC;
 			if (!AskForSave(hwnd))
 				break;
-			FreeDlgData();
-			LoadDialogTemplate(curFilename, TRUE);
-			if (dlgHasCaption == TRUE)
-				SetWindowText(pseudoHwnd, dlgCaption);
+			FreeDlgData(&curDlg);
+			LoadDialogTemplate(&ctx, curFilename, TRUE);
+			if (curDlg.hasCaption == TRUE)
+				SetWindowText(pseudoHwnd, curDlg.caption);
 			hDC = GetDC(hwnd);
 			SetDlgHFont(hDC);
 			UpdateFont(hDC);
@@ -294,19 +314,20 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
 			break;
 		}
 		case M_OPEN:
+		{
+			ParseCtx ctx;
 			if (!AskForSave(hwnd))
 				break;
 			curFilename[0] = '\0';
 			if (GetFilenameDialog(curFilename, "Open", hwnd, 0))
 			{
-				FreeDlgData();
-				curLine = 0;
-				if (LoadDialogTemplate(curFilename, FALSE))
+				FreeDlgData(&curDlg);
+				if (LoadDialogTemplate(&ctx, curFilename, FALSE))
 				{
 					HDC hDC;
 					noFileLoaded = FALSE;
-					if (dlgHasCaption == TRUE)
-						SetWindowText(pseudoHwnd, dlgCaption);
+					if (curDlg.hasCaption == TRUE)
+						SetWindowText(pseudoHwnd, curDlg.caption);
 					hDC = GetDC(hwnd);
 					SetDlgHFont(hDC);
 					UpdateFont(hDC);
@@ -316,13 +337,13 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
 				}
 				else
 				{
-					if (curLine != 0)
+					if (ctx.curLine != 0)
 					{
 						char* errorMsg;
 						errorMsg = (char*)xmalloc(22 + 11 +
-												 strlen(errorDesc) + 1);
+												 strlen(ctx.errorDesc) + 1);
 						wsprintf(errorMsg, "Parse error on line %i. %s",
-							curLine, errorDesc);
+							ctx.curLine, ctx.errorDesc);
 						MessageBox(hwnd, errorMsg, NULL,
 								   MB_OK | MB_ICONEXCLAMATION);
 						xfree(errorMsg);
@@ -336,10 +357,10 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
 					/* Load the default dialog template */
 					{
 						HDC hDC;
-						FreeDlgData();
-						LoadDialogTemplate(curFilename, TRUE);
-						if (dlgHasCaption == TRUE)
-							SetWindowText(pseudoHwnd, dlgCaption);
+						FreeDlgData(&curDlg);
+						LoadDialogTemplate(&ctx, curFilename, TRUE);
+						if (curDlg.hasCaption == TRUE)
+							SetWindowText(pseudoHwnd, curDlg.caption);
 						hDC = GetDC(hwnd);
 						SetDlgHFont(hDC);
 						UpdateFont(hDC);
@@ -349,6 +370,7 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
 				}
 			}
 			break;
+		}
 		case M_SAVE:
 			if (noFileLoaded == TRUE)
 			{
@@ -369,46 +391,45 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
 			break;
 		case M_PARSETEXT:
 		{
+			ParseCtx ctx;
 			char* textBuf;
 			unsigned textLen;
 
 			fileChanged = TRUE;
 			textLen = GetWindowTextLength(textBox);
-			textBuf = (char*)malloc(textLen + 1);
+			textBuf = (char*)xmalloc(textLen + 1);
 			GetWindowText(textBox, textBuf, textLen + 1);
-			textLen = SetUnixNlChars(textBuf, textLen);
-			/* Add extra space for parser */
-			textLen++;
-			textBuf = (char*)xrealloc(textBuf, textLen + 1);
-			textBuf[textLen-1] = '\0';
-			textBuf[textLen] = '\0';
+			/* The parser accepts the edit control's line endings and
+			   does not need a newline after the last statement */
+			InitParseCtx(&ctx, &curDlg);
 			if (activeCtrl == -1)
 			{
 				char* oldHead;
 				/* Save old header in case of a parse error */
-				oldHead = dlgHead;
-				dlgHead = NULL;
-				xfree(dlgFontFam);
-				dlgFontFam = NULL;
-				if (!ParseDlgHead(textBuf, textLen))
+				oldHead = curDlg.head;
+				curDlg.head = NULL;
+				xfree(curDlg.fontFam);
+				curDlg.fontFam = NULL;
+				if (!ParseDlgHead(&ctx, textBuf, textLen))
 				{
 					char* errorMsg;
-					errorMsg = (char*)xmalloc(22 + 11 + strlen(errorDesc) + 1);
+					errorMsg = (char*)xmalloc(22 + 11 +
+											  strlen(ctx.errorDesc) + 1);
 					wsprintf(errorMsg, "Parse error on line %i. %s",
-						curLine, errorDesc);
+						ctx.curLine, ctx.errorDesc);
 					MessageBox(hwnd, errorMsg, NULL,
 							   MB_OK | MB_ICONEXCLAMATION);
 					xfree(errorMsg);
-					/* Set "dlgHead" to the old header */
-					dlgHead = oldHead;
+					/* Set "curDlg.head" to the old header */
+					curDlg.head = oldHead;
 				}
 				else
 				{
 					HDC hDC;
 					xfree(oldHead); /* The new header was sucessfully set */
 					/* Set the caption */
-					if (dlgHasCaption == TRUE)
-						SetWindowText(pseudoHwnd, dlgCaption);
+					if (curDlg.hasCaption == TRUE)
+						SetWindowText(pseudoHwnd, curDlg.caption);
 					/* Set the font automatically */
 					hDC = GetDC(hwnd);
 					SetDlgHFont(hDC);
@@ -418,33 +439,28 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
 			}
 			else
 			{
-				DlgItem* pCtrl;
-				pCtrl = &dlgControls.d[activeCtrl];
-				curPos = 0;
-				/* Delete dynamic allocations in control before parsing */
-				xfree(pCtrl->id);
-				pCtrl->id = NULL;
-				xfree(pCtrl->style);
-				pCtrl->style = NULL;
-				xfree(pCtrl->exStyle);
-				pCtrl->exStyle = NULL;
-				if (!ParseControl(textBuf, textLen, activeCtrl))
+				DlgItemStrs* pStrs;
+				pStrs = &curDlg.ctrlStrs.d[activeCtrl];
+				/* Let go of the old strings before parsing */
+				FreeDlgItemStrs(&curDlg, activeCtrl);
+				if (!ParseControl(&ctx, textBuf, textLen, activeCtrl))
 				{
 					char* errorMsg;
-					errorMsg = (char*)xmalloc(29 + strlen(errorDesc) + 1);
+					errorMsg = (char*)xmalloc(29 + strlen(ctx.errorDesc) + 1);
 					wsprintf(errorMsg, "Parse error in control line. %s",
-						errorDesc);
+						ctx.errorDesc);
 					MessageBox(hwnd, errorMsg, NULL,
 							   MB_OK | MB_ICONEXCLAMATION);
 					xfree(errorMsg);
-					/* Allocate empty strings to avoid crashes */
-					pCtrl->id = (char*)xmalloc(1);
-					pCtrl->id[0] = '\0';
-					pCtrl->style = (char*)xmalloc(1);
-					pCtrl->style[0] = '\0';
-					pCtrl->exStyle = (char*)xmalloc(1);
-					pCtrl->exStyle[0] = '\0';
+					/* Replace what was parsed with empty strings to
+					   avoid crashes */
+					FreeDlgItemStrs(&curDlg, activeCtrl);
+					pStrs->id = InternStr("", 0);
+					pStrs->style = InternStr("", 0);
+					pStrs->exStyle = InternStr("", 0);
+					pStrs->wndClass = InternStr("", 0);
 				}
+				UpdateDlgItemRect(&curDlg, activeCtrl);
 			}
 			xfree(textBuf);
 			InvalidateRect(hwnd, NULL, TRUE);
@@ -452,6 +468,7 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
 		}
 		case M_ADDCTRL:
 		{
+			ParseCtx ctx;
 			char* textBuf;
 			unsigned textLen;
 
@@ -459,36 +476,25 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
 			textLen = GetWindowTextLength(textBox);
 			textBuf = (char*)xmalloc(textLen + 1);
 			GetWindowText(textBox, textBuf, textLen + 1);
-			textLen = SetUnixNlChars(textBuf, textLen);
-
-			curPos = 0;
-			/* Add extra space for parser */
-			textLen++;
-			textBuf = (char*)xrealloc(textBuf, textLen + 1);
-			textBuf[textLen-1] = '\0';
-			textBuf[textLen] = '\0';
-			if (!ParseControl(textBuf, textLen, dlgControls.len))
+
+			InitParseCtx(&ctx, &curDlg);
+			if (!ParseControl(&ctx, textBuf, textLen, curDlg.controls.len))
 			{
 				char* errorMsg;
 				unsigned newCtrl;
-				errorMsg = (char*)xmalloc(29 + strlen(errorDesc) + 1);
+				errorMsg = (char*)xmalloc(29 + strlen(ctx.errorDesc) + 1);
 				wsprintf(errorMsg, "Parse error in control line. %s",
-					errorDesc);
+					ctx.errorDesc);
 				MessageBox(hwnd, errorMsg, NULL, MB_OK | MB_ICONEXCLAMATION);
 				xfree(errorMsg);
-				/* Delete dynamic allocations, if any */
-				newCtrl = dlgControls.len;
-				xfree(dlgControls.d[newCtrl].id);
-				dlgControls.d[newCtrl].id = NULL;
-				xfree(dlgControls.d[newCtrl].style);
-				dlgControls.d[newCtrl].style = NULL;
-				xfree(dlgControls.d[newCtrl].exStyle);
-				dlgControls.d[newCtrl].exStyle = NULL;
+				/* Let go of the strings, if any */
+				newCtrl = curDlg.controls.len;
+				FreeDlgItemStrs(&curDlg, newCtrl);
 			}
 			else
 			{
-				activeCtrl = dlgControls.len;
-				EA_ADD(DlgItem, dlgControls);
+				activeCtrl = curDlg.controls.len;
+				AddDlgItem(&curDlg);
 			}
 
 			xfree(textBuf);
@@ -498,16 +504,8 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
 		case M_DELCTRL:
 			if (activeCtrl != -1)
 			{
-				DlgItem* pCtrl;
-				pCtrl = &dlgControls.d[activeCtrl];
-				/* Delete dynamic allocations */
-				xfree(pCtrl->id);
-				pCtrl->id = NULL;
-				xfree(pCtrl->style);
-				pCtrl->style = NULL;
-				xfree(pCtrl->exStyle);
-				pCtrl->exStyle = NULL;
-				EA_REMOVE(DlgItem, dlgControls, activeCtrl);
+				/* This also releases the control's strings */
+				RemoveDlgItem(&curDlg, activeCtrl);
 				activeCtrl = -1;
 				InvalidateRect(hwnd, NULL, TRUE);
 			}
@@ -574,16 +572,8 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
 		case VK_BACK:
 			if (activeCtrl != -1)
 			{
-				DlgItem* pCtrl;
-				pCtrl = &dlgControls.d[activeCtrl];
-				/* Delete dynamic allocations */
-				xfree(pCtrl->id);
-				pCtrl->id = NULL;
-				xfree(pCtrl->style);
-				pCtrl->style = NULL;
-				xfree(pCtrl->exStyle);
-				pCtrl->exStyle = NULL;
-				EA_REMOVE(DlgItem, dlgControls, activeCtrl);
+				/* This also releases the control's strings */
+				RemoveDlgItem(&curDlg, activeCtrl);
 				activeCtrl = -1;
 				InvalidateRect(hwnd, NULL, TRUE);
 			}
@@ -605,13 +595,13 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
 			if (GetKeyState(VK_SHIFT) & 0x8000)
 			{
 				if (activeCtrl == -1)
-					activeCtrl = dlgControls.len - 1;
+					activeCtrl = curDlg.controls.len - 1;
 				else
 					activeCtrl--;
 			}
 			else
 			{
-				if (activeCtrl == dlgControls.len  - 1)
+				if (activeCtrl == curDlg.controls.len  - 1)
 					activeCtrl = -1;
 				else
 					activeCtrl++;
@@ -763,137 +753,45 @@ INT_PTR CALLBACK AboutBoxProc(HWND hDlg, UINT uMsg, WPARAM wParam,
 	return FALSE;
 }
 
-#define SKIP_WHITESPACE() \
-	while (curPos < dataSize && \
-		(buffer[curPos] == ' ' || buffer[curPos] == '\t')) \
-		curPos++;
-#define CHECK_CHAR(chcode) (buffer[curPos] == chcode)
-
-BOOL LoadDialogTemplate(char* filename, BOOL useNewTmpl)
+/* Loads a dialog template into "curDlg".  "ctx" is initialized by
+   this function and holds the parse error, if any, on return. */
+BOOL LoadDialogTemplate(ParseCtx* ctx, char* filename, BOOL useNewTmpl)
 {
-	char* buffer;
-	unsigned fileSize;
-	unsigned dataSize;
-	FILE* fp;
+	HRSRC hRes;
+	HGLOBAL hResData;
+	const char* resMem;
+	unsigned resSize;
 
+	InitParseCtx(ctx, &curDlg);
 	if (useNewTmpl == FALSE)
-	{
-		/* Read the file */
-		fp = fopen(filename, "rb");
-		if (fp == NULL)
-			return FALSE;
-		fseek(fp, 0, SEEK_END);
-		fileSize = ftell(fp);
-		fseek(fp, 0, SEEK_SET);
-		buffer = (char*)xmalloc(fileSize + 1);
-		if (buffer == NULL)
-		{
-			fclose(fp);
-			return FALSE;
-		}
-		fread(buffer, fileSize, 1, fp);
-		buffer[fileSize] = '\0';
-		fclose(fp);
-	}
-	else
-	{
-		/* Initialize edit variables */
-		strcpy(curFilename, "Untitled.dlg");
-		noFileLoaded = TRUE;
-		fileChanged = FALSE;
-		dlgHead = NULL;
-		dlgFontFam = NULL;
-		activeCtrl = -1;
-
-		/* Load a default template */
-		{
-			HRSRC hRes;
-			HGLOBAL hResData;
-			char* resMem;
-			hRes = FindResource(NULL, (LPCTSTR)NEW_TEMPLATE, RT_RCDATA);
-			hResData = LoadResource(NULL, hRes);
-			fileSize = SizeofResource(NULL, hRes);
-			resMem = (char*)LockResource(hResData);
-			/* Create a writeable copy of the memory */
-			buffer = (char*)xmalloc(fileSize + 1);
-			strncpy(buffer, resMem, fileSize);
-			buffer[fileSize] = '\0';
-		}
-	}
+		return LoadDlgTemplateFile(ctx, filename);
 
-	/* Since we read the whole file this way, we will have to properly
-	   format newlines. */
-	dataSize = SetUnixNlChars(buffer, fileSize);
-
-	/* Parse the file */
-	EA_INIT(DlgItem, dlgControls, 16);
-	if (!ParseDlgHead(buffer, dataSize))
-	{
-		xfree(buffer);
-		return FALSE;
-	}
-	while (curPos < dataSize)
-	{
-		unsigned lastPos;
-		if (!ParseControl(buffer, dataSize, dlgControls.len))
-		{
-			/* Do fully safe cleanup */
-			EA_ADD(DlgItem, dlgControls);
-			xfree(buffer);
-			FreeDlgData();
-			return FALSE;
-		}
-		EA_ADD(DlgItem, dlgControls);
-		/* Check for "END" or '}' */
-		lastPos = curPos;
-		SKIP_WHITESPACE();
-		if (curPos >= fileSize)
-		{
-			/* Do fully safe cleanup */
-			EA_ADD(DlgItem, dlgControls);
-			xfree(buffer);
-			FreeDlgData();
-			return FALSE;
-		}
-		if ((CHECK_CHAR('}') || strncmp("END", &buffer[curPos], 3) == 0))
-			break;
-		else
-			curPos = lastPos;
-	}
-	xfree(buffer);
-	return TRUE;
+	/* Initialize edit variables */
+	strcpy(curFilename, "Untitled.dlg");
+	noFileLoaded = TRUE;
+	fileChanged = FALSE;
+	curDlg.head = NULL;
+	curDlg.fontFam = NULL;
+	activeCtrl = -1;
+
+	/* Load a default template.  The parser does not write to the
+	   buffer and accepts any line endings, so the resource memory can
+	   be parsed directly. */
+	hRes = FindResource(NULL, (LPCTSTR)NEW_TEMPLATE, RT_RCDATA);
+	hResData = LoadResource(NULL, hRes);
+	resSize = SizeofResource(NULL, hRes);
+	resMem = (const char*)LockResource(hResData);
+	return ParseDlgTemplate(ctx, resMem, resSize);
 }
 
-#undef SKIP_WHITESPACE
-#undef CHECK_CHAR
-
 BOOL SaveDialogTemplate(char* filename)
 {
-	FILE* fp;
-	/* Temporary variables */
-	unsigned i;
+	ParseCtx ctx;
 
-	fp = fopen(filename, "wt");
-	if (fp == NULL)
+	InitParseCtx(&ctx, &curDlg);
+	if (!SaveDlgTemplateFile(&ctx, filename))
 		return FALSE;
 
-	/* Write the header */
-	fputs(dlgHead, fp);
-	/* Write the controls */
-	for (i = 0; i < dlgControls.len; i++)
-	{
-		char* ctrlLine;
-		ctrlLine = FmtControlText(i);
-		fputs(ctrlLine, fp);
-		xfree(ctrlLine);
-	}
-	/* Write the end marker */
-	if (dlgHead[strlen(dlgHead)-2] == '{')
-		fputs("}\n", fp);
-	else
-		fputs("END\n", fp);
-	fclose(fp);
-
 	/* Update flags */
 	fileChanged = FALSE;
 	return TRUE;
@@ -903,20 +801,22 @@ void SetDlgHFont(HDC hDC)
 {
 	DeleteObject(dlgFont);
 	dlgFont = CreateFont(
-		-MulDiv(dlgPointSize, GetDeviceCaps(hDC, LOGPIXELSY), 72),
+		-MulDiv(curDlg.pointSize, GetDeviceCaps(hDC, LOGPIXELSY), 72),
 		0, 0, 0, FW_DONTCARE, FALSE, FALSE, FALSE, ANSI_CHARSET,
 		OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, DEFAULT_QUALITY,
-		DEFAULT_PITCH | FF_DONTCARE, dlgFontFam);
+		DEFAULT_PITCH | FF_DONTCARE, curDlg.fontFam);
 	SelectObject(hDC, dlgFont);
 }
 
 void UpdateTextWindow()
 {
+	ParseCtx ctx;
+	InitParseCtx(&ctx, &curDlg);
 	if (activeCtrl == -1)
 	{
 		char* winBuff;
-		FmtDlgHeader();
-		winBuff = GenWinNlChars(dlgHead, strlen(dlgHead));
+		FmtDlgHeader(&ctx);
+		winBuff = GenWinNlChars(curDlg.head, strlen(curDlg.head));
 		SetWindowText(textBox, winBuff);
 		xfree(winBuff);
 	}
@@ -924,7 +824,7 @@ void UpdateTextWindow()
 	{
 		char* newText;
 		unsigned textLen;
-		newText = FmtControlText(activeCtrl);
+		newText = FmtControlText(&ctx, activeCtrl);
 		/* Make sure that the line endings are in CR+LF form */
 		textLen = strlen(newText);
 		newText = (char*)xrealloc(newText, textLen + 2);
@@ -947,7 +847,7 @@ void KbdMoveProc(HWND hwnd, WPARAM wParam)
 	InvalSelItem(hwnd);
 
 	if (activeCtrl != -1)
-		pCtrl = &dlgControls.d[activeCtrl];
+		pCtrl = &curDlg.controls.d[activeCtrl];
 	if (GetKeyState(VK_CONTROL) & 0x8000)
 		stride = 1;
 	else
@@ -959,10 +859,10 @@ void KbdMoveProc(HWND hwnd, WPARAM wParam)
 		{
 			switch (wParam)
 			{
-			case VK_UP: dlgHeight -= stride; break;
-			case VK_DOWN: dlgHeight += stride; break;
-			case VK_LEFT: dlgWidth -= stride; break;
-			case VK_RIGHT: dlgWidth += stride; break;
+			case VK_UP: curDlg.height -= stride; break;
+			case VK_DOWN: curDlg.height += stride; break;
+			case VK_LEFT: curDlg.width -= stride; break;
+			case VK_RIGHT: curDlg.width += stride; break;
 			default: noModify = TRUE; break;
 			}
 		}
@@ -970,10 +870,10 @@ void KbdMoveProc(HWND hwnd, WPARAM wParam)
 		{
 			switch (wParam)
 			{
-			case VK_UP: dlgPos.y -= stride; break;
-			case VK_DOWN: dlgPos.y += stride; break;
-			case VK_LEFT: dlgPos.x -= stride; break;
-			case VK_RIGHT: dlgPos.x += stride; break;
+			case VK_UP: curDlg.pos.y -= stride; break;
+			case VK_DOWN: curDlg.pos.y += stride; break;
+			case VK_LEFT: curDlg.pos.x -= stride; break;
+			case VK_RIGHT: curDlg.pos.x += stride; break;
 			default: noModify = TRUE; break;
 			}
 		}
@@ -1006,6 +906,8 @@ void KbdMoveProc(HWND hwnd, WPARAM wParam)
 	if (noModify == FALSE)
 	{
 		fileChanged = TRUE;
+		if (activeCtrl != -1)
+			UpdateDlgItemRect(&curDlg, activeCtrl);
 		InvalSelItem(hwnd);
 		UpdateTextWindow();
 	}
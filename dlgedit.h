@@ -1,12 +1,12 @@
 /* Header for main source file.  Only declares functions that should
    have public definitions. */
-/* This is platform dependent code: include windows.h before this
-   header. */
+/* This is platform dependent code: include windows.h and
+   tmplparser.h before this header. */
 
 #ifndef DLGEDIT_H
 #define DLGEDIT_H
 
-BOOL LoadDialogTemplate(char* filename, BOOL useNewTmpl);
+BOOL LoadDialogTemplate(ParseCtx* ctx, char* filename, BOOL useNewTmpl);
 BOOL SaveDialogTemplate(char* filename);
 
 void SetDlgHFont(HDC hDC);
@@ -14,5 +14,6 @@ void UpdateTextWindow();
 void KbdMoveProc(HWND hwnd, WPARAM wParam);
 
 extern HINSTANCE g_hInstance;
+extern DlgTemplate curDlg;
 
 #endif /* DLGEDIT_H */
@@ -0,0 +1,250 @@
+/* Per-phase profiling of dialog template loading and saving.
+
+   This is platform independent code.  The library marks the phases
+   of loading and saving with ProfBegin() and ProfEnd().  Each phase
+   records its wall time, the bytes that it processed, and the
+   xmalloc() calls that the thread made during it.  The totals of each
+   phase are summed over all threads, so with several worker threads,
+   the total time of a phase can be longer than the run.
+
+   Events are kept in one list under a lock.  The list is only
+   appended to at the end of a phase, which is a few times per
+   template, so the lock is seldom contended. */
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+
+#include "xmalloc.h"
+#include "xthread.h"
+#include "dlgprof.h"
+#define ea_malloc xmalloc
+#define ea_realloc xrealloc
+#define ea_free xfree
+#include "exparray.h"
+
+/* MSVC >= 8.0 pragmas */
+#if _MSC_VER >= 1400
+#pragma warning (disable: 4996) /* Disable deprecate */
+#endif
+
+/* One phase of one thread, for the trace */
+struct ProfEvent_t
+{
+	const char* label;
+	double start;
+	double duration;
+	unsigned long bytes;
+	unsigned long allocs;
+	unsigned threadNum;
+	int phase;
+};
+
+typedef struct ProfEvent_t ProfEvent;
+
+EA_TYPE(ProfEvent);
+
+/* The totals of one phase */
+struct ProfTotal_t
+{
+	unsigned long count;
+	double time;
+	double bytes;
+	double allocs;
+	double allocBytes;
+};
+
+typedef struct ProfTotal_t ProfTotal;
+
+/* Nonzero if profiling is enabled, see EnableProfiling() */
+int profFlags = 0;
+
+static const char* phaseNames[NUM_PROF_PHASES] =
+{
+	"read", "nl_norm", "parse_head", "parse_controls", "format", "write"
+};
+
+static xmutex_t profLock;
+static xonce_t profOnce = XONCE_INIT;
+static double profStart;
+static ProfTotal totals[NUM_PROF_PHASES];
+static ProfEvent_array events;
+static unsigned numThreads = 0;
+static XTHREAD_LOCAL unsigned threadNum = 0; /* Zero until first used */
+static XTHREAD_LOCAL const char* threadLabel = NULL;
+
+static void InitProfLock();
+static void PutJsonString(FILE* fp, const char* str);
+
+/* Returns a monotonic time in seconds */
+double ProfClock()
+{
+#ifdef _WIN32
+	LARGE_INTEGER count, freq;
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+	return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1.0e9;
+#endif
+}
+
+static void InitProfLock()
+{
+	xmutex_init(&profLock);
+}
+
+/* Turns on profiling with the given PROF_* flags, and clears all
+   data that has been recorded.  This must be called before any
+   phases start, not while other threads are loading templates. */
+void EnableProfiling(int flags)
+{
+	xthread_once(&profOnce, InitProfLock);
+	FreeProfData();
+	memset(totals, 0, sizeof(totals));
+	EA_INIT(ProfEvent, events, 256);
+	profStart = ProfClock();
+	profFlags = flags;
+}
+
+/* Sets the label of the calling thread's events, usually the name of
+   the file that it is working on.  The string must stay valid until
+   the trace is written. */
+void SetProfLabel(const char* label)
+{
+	threadLabel = label;
+}
+
+void ProfBeginReal(ProfMark* mark)
+{
+	xalloc_thread_totals(&mark->allocs, &mark->allocBytes);
+	mark->start = ProfClock();
+}
+
+void ProfEndReal(ProfMark* mark, int phase, unsigned long bytes)
+{
+	double end;
+	unsigned long allocs, allocBytes;
+	ProfTotal* total;
+
+	end = ProfClock();
+	xalloc_thread_totals(&allocs, &allocBytes);
+	allocs -= mark->allocs;
+	allocBytes -= mark->allocBytes;
+
+	xmutex_lock(&profLock);
+	if (threadNum == 0)
+		threadNum = ++numThreads;
+	total = &totals[phase];
+	total->count++;
+	total->time += end - mark->start;
+	total->bytes += bytes;
+	total->allocs += allocs;
+	total->allocBytes += allocBytes;
+	if ((profFlags & PROF_EVENTS) != 0)
+	{
+		ProfEvent* event;
+		EA_ADD(ProfEvent, events);
+		event = &events.d[events.len-1];
+		event->label = threadLabel;
+		event->start = mark->start - profStart;
+		event->duration = end - mark->start;
+		event->bytes = bytes;
+		event->allocs = allocs;
+		event->threadNum = threadNum;
+		event->phase = phase;
+	}
+	xmutex_unlock(&profLock);
+}
+
+/* Prints a table of the totals of each phase */
+void PrintProfile(FILE* fp)
+{
+	double allTime;
+	unsigned i;
+	allTime = 0;
+	for (i = 0; i < NUM_PROF_PHASES; i++)
+		allTime += totals[i].time;
+	fprintf(fp, "%-15s %8s %11s %6s %12s %9s %10s %12s\n",
+			"phase", "calls", "time (ms)", "%", "bytes", "MB/s",
+			"allocs", "alloc bytes");
+	for (i = 0; i < NUM_PROF_PHASES; i++)
+	{
+		ProfTotal* total;
+		total = &totals[i];
+		fprintf(fp, "%-15s %8lu %11.3f %6.1f %12.0f %9.1f %10.0f %12.0f\n",
+				phaseNames[i], total->count, total->time * 1000,
+				(allTime > 0) ? total->time * 100 / allTime : 0.0,
+				total->bytes,
+				(total->time > 0) ? total->bytes / total->time / 1.0e6 : 0.0,
+				total->allocs, total->allocBytes);
+	}
+}
+
+static void PutJsonString(FILE* fp, const char* str)
+{
+	fputc('"', fp);
+	for (; *str != '\0'; str++)
+	{
+		if (*str == '"' || *str == '\\')
+			fprintf(fp, "\\%c", *str);
+		else if ((unsigned char)*str < 0x20)
+			fprintf(fp, "\\u%04x", (unsigned char)*str);
+		else
+			fputc(*str, fp);
+	}
+	fputc('"', fp);
+}
+
+/* Writes the recorded events as a Chrome trace event file, which can
+   be opened in chrome://tracing or Perfetto.  Each worker thread gets
+   its own track.  Returns FALSE if the file could not be written. */
+BOOL WriteProfTrace(const char* filename)
+{
+	FILE* fp;
+	unsigned i;
+	fp = fopen(filename, "w");
+	if (fp == NULL)
+		return FALSE;
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", fp);
+	fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+		  "\"args\":{\"name\":\"dlgtool\"}}", fp);
+	for (i = 0; i < events.len; i++)
+	{
+		ProfEvent* event;
+		event = &events.d[i];
+		fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"dlg\",\"ph\":\"X\","
+				"\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+				"\"args\":{\"bytes\":%lu,\"allocs\":%lu",
+				phaseNames[event->phase], event->threadNum,
+				event->start * 1.0e6, event->duration * 1.0e6,
+				event->bytes, event->allocs);
+		if (event->label != NULL)
+		{
+			fputs(",\"file\":", fp);
+			PutJsonString(fp, event->label);
+		}
+		fputs("}}", fp);
+	}
+	fputs("\n]}\n", fp);
+	if (ferror(fp))
+	{
+		fclose(fp);
+		return FALSE;
+	}
+	return fclose(fp) == 0;
+}
+
+/* Frees the recorded events.  The totals stay until the next
+   EnableProfiling(). */
+void FreeProfData()
+{
+	EA_DESTROY(ProfEvent, events);
+}
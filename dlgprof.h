@@ -0,0 +1,65 @@
+/* Per-phase profiling of dialog template loading and saving.  When
+   profiling is enabled, the library records the wall time, bytes
+   processed, and allocations of each phase, both as totals and,
+   optionally, as a list of events that can be written as a Chrome
+   trace file.  When it is disabled, each phase only costs a test of
+   a global flag. */
+
+#ifndef DLGPROF_H
+#define DLGPROF_H
+
+#include <stdio.h>
+
+/* Include Windows data types (BOOL) */
+#include "subwindef.h"
+
+enum ProfPhase
+{
+	PROF_READ, /* Reading or mapping the file */
+	PROF_NL_NORM, /* Detecting or converting line endings */
+	PROF_HEAD, /* Parsing the template header */
+	PROF_CONTROLS, /* Parsing the control list */
+	PROF_FORMAT, /* Formatting the template as text */
+	PROF_WRITE, /* Writing the text out */
+	NUM_PROF_PHASES
+};
+
+/* Flags for EnableProfiling() */
+#define PROF_TOTALS 1 /* Keep the totals of each phase */
+#define PROF_EVENTS 2 /* Keep every phase as an event for tracing */
+
+/* The state at the beginning of a phase */
+struct ProfMark_t
+{
+	double start;
+	unsigned long allocs;
+	unsigned long allocBytes;
+};
+
+typedef struct ProfMark_t ProfMark;
+
+extern int profFlags;
+
+double ProfClock();
+void EnableProfiling(int flags);
+void SetProfLabel(const char* label);
+void ProfBeginReal(ProfMark* mark);
+void ProfEndReal(ProfMark* mark, int phase, unsigned long bytes);
+void PrintProfile(FILE* fp);
+BOOL WriteProfTrace(const char* filename);
+void FreeProfData();
+
+/* Marks the beginning and end of a phase.  "bytes" is the amount of
+   data that the phase processed. */
+#define ProfBegin(mark)						\
+{											\
+	if (profFlags != 0)						\
+		ProfBeginReal((mark));				\
+}
+#define ProfEnd(mark, phase, bytes)			\
+{											\
+	if (profFlags != 0)						\
+		ProfEndReal((mark), (phase), (bytes));	\
+}
+
+#endif /* not DLGPROF_H */
@@ -0,0 +1,754 @@
+/* Command-line dialog template tool.
+
+   Runs the dialog template parser and formatter without the dialog
+   editor's graphical user interface, so that templates can be
+   checked and reformatted in bulk.  Directories given on the command
+   line are searched for *.dlg and *.rc files, and the files are
+   processed in parallel.  Results are always printed in the order of
+   the sorted file list, no matter which thread processed which file.
+
+   This is platform independent code. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xmalloc.h"
+#include "tmplparser.h"
+#include "tmplfile.h"
+#include "batchproc.h"
+#include "symtab.h"
+#include "rcpp.h"
+#include "strintern.h"
+#include "dlgprof.h"
+
+/* MSVC >= 8.0 pragmas */
+#if _MSC_VER >= 1400
+#pragma warning (disable: 4996) /* Disable deprecate */
+#pragma warning (disable: 4267) /* Disable size_t warnings */
+#endif
+
+enum ToolCmd
+{
+	CMD_PARSE,
+	CMD_VALIDATE,
+	CMD_FORMAT,
+	CMD_STATS,
+	CMD_IDS
+};
+
+#define MAX_INCLUDE_DIRS 16
+
+/* Command-line options */
+struct ToolOpts_t
+{
+	int cmd;
+	unsigned numThreads; /* Zero means one per processor */
+	char* outName; /* Output file name for "format -o" */
+	BOOL inPlace; /* Rewrite files in place for "format -i" */
+	BOOL profile; /* Print the time spent in each phase */
+	char* traceName; /* Chrome trace output file name, or NULL */
+	BOOL allocStats; /* Print allocation statistics at exit */
+	char* symName; /* Header with the symbols of the IDs, or NULL */
+	char* symCacheDir; /* Directory of the symbol cache, or NULL */
+	/* "#include" directories, NULL terminated */
+	const char* includeDirs[MAX_INCLUDE_DIRS+1];
+	unsigned numIncludeDirs;
+	BOOL allErrors; /* Report every parse error of a template */
+};
+
+typedef struct ToolOpts_t ToolOpts;
+
+/* The results of processing one file */
+struct FileResult_t
+{
+	BOOL loaded;
+	BOOL ok;
+	unsigned errLine;
+	const char* errorDesc;
+	ParseDiag_array diags; /* Every parse error, with --all-errors */
+	heap_char output; /* Text to write to standard output */
+	unsigned outLen;
+	unsigned outAlloc; /* Size of "output" when it is built in pieces */
+	unsigned numCtrls;
+	unsigned typeCounts[NUM_CTRL_TYPES];
+	unsigned numIdProblems;
+};
+
+typedef struct FileResult_t FileResult;
+
+struct ToolJob_t
+{
+	ToolOpts* opts;
+	BatchPath_array* files;
+	FileResult* results;
+	SymTable* symbols; /* Shared by all threads, or NULL */
+};
+
+typedef struct ToolJob_t ToolJob;
+
+/* A control ID and its value, for finding duplicates */
+struct IdRef_t
+{
+	long value;
+	unsigned ctrlNum;
+};
+
+typedef struct IdRef_t IdRef;
+
+static void PrintUsage(FILE* fp);
+static BOOL ParseOptions(ToolOpts* opts, int* pArgc, char*** pArgv);
+static void PrintEscaped(FILE* fp, const char* str);
+static void PrintDiags(FILE* fp, const char* filename,
+					   const ParseDiag_array* diags);
+static void ReportError(const char* filename, FileResult* result);
+static void AddIdProblem(FileResult* result, const char* filename,
+						 unsigned ctrlNum, const char* id,
+						 const char* desc);
+static int CompareIdRefs(const void* a, const void* b);
+static void CheckCtrlIds(ParseCtx* ctx, const char* filename,
+						 FileResult* result);
+static void ProcessFile(void* userData, unsigned taskNum,
+						unsigned threadNum);
+static int CmdParse(BatchPath_array* files, SymTable* symbols,
+					const char* const* includeDirs, BOOL allErrors);
+static int ReportResults(ToolOpts* opts, BatchPath_array* files,
+						 FileResult* results);
+static int FinishProfile(ToolOpts* opts);
+
+int main(int argc, char* argv[])
+{
+	ToolOpts opts;
+	BatchPath_array files;
+	FileResult* results;
+	ToolJob job;
+	SymTable symbols;
+	SymTable* pSymbols;
+	int retVal;
+	int i;
+
+	if (argc < 2)
+	{
+		PrintUsage(stderr);
+		return 2;
+	}
+	if (strcmp(argv[1], "parse") == 0)
+		opts.cmd = CMD_PARSE;
+	else if (strcmp(argv[1], "validate") == 0)
+		opts.cmd = CMD_VALIDATE;
+	else if (strcmp(argv[1], "format") == 0)
+		opts.cmd = CMD_FORMAT;
+	else if (strcmp(argv[1], "stats") == 0)
+		opts.cmd = CMD_STATS;
+	else if (strcmp(argv[1], "ids") == 0)
+		opts.cmd = CMD_IDS;
+	else if (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "help") == 0)
+	{
+		PrintUsage(stdout);
+		return 0;
+	}
+	else
+	{
+		fprintf(stderr, "dlgtool: unknown command `%s'.\n", argv[1]);
+		PrintUsage(stderr);
+		return 2;
+	}
+	argc -= 2;
+	argv += 2;
+	if (!ParseOptions(&opts, &argc, &argv))
+		return 2;
+	if (opts.profile == TRUE || opts.traceName != NULL)
+		EnableProfiling(PROF_TOTALS |
+						((opts.traceName != NULL) ? PROF_EVENTS : 0));
+
+	/* Read the symbols once for all of the templates */
+	pSymbols = NULL;
+	if (opts.symName != NULL || opts.cmd == CMD_IDS)
+	{
+		InitSymTable(&symbols);
+		AddStdSymbols(&symbols);
+		if (opts.symName != NULL &&
+			!LoadSymHeader(&symbols, opts.symName, opts.symCacheDir))
+		{
+			fprintf(stderr, "%s: Cannot read file.\n", opts.symName);
+			FreeSymTable(&symbols);
+			return 2;
+		}
+		pSymbols = &symbols;
+	}
+
+	/* Expand directories into the template files below them */
+	retVal = 0;
+	EA_INIT(BatchPath, files, 16);
+	for (i = 0; i < argc; i++)
+	{
+		if (!CollectTemplateFiles(&files, argv[i]))
+		{
+			fprintf(stderr, "%s: No such file or directory.\n", argv[i]);
+			retVal = 1;
+		}
+	}
+	SortBatchPaths(&files);
+	if (opts.outName != NULL && files.len != 1)
+	{
+		fputs("dlgtool: `-o' requires exactly one input file.\n", stderr);
+		FreeBatchPaths(&files);
+		if (pSymbols != NULL)
+			FreeSymTable(pSymbols);
+		return 2;
+	}
+
+	if (opts.cmd == CMD_PARSE)
+	{
+		if (CmdParse(&files, pSymbols, opts.includeDirs,
+					 opts.allErrors) != 0)
+			retVal = 1;
+		if (FinishProfile(&opts) != 0)
+			retVal = 1;
+		FreeBatchPaths(&files);
+		if (pSymbols != NULL)
+			FreeSymTable(pSymbols);
+		FreeIncludeCache();
+		FreeInternTable();
+		FreeStrArenaCache();
+		if (opts.allocStats == TRUE)
+			xalloc_dump_stats(stderr);
+		return retVal;
+	}
+
+	results = (FileResult*)xmalloc(sizeof(FileResult) * (files.len + 1));
+	memset(results, 0, sizeof(FileResult) * (files.len + 1));
+	job.opts = &opts;
+	job.files = &files;
+	job.results = results;
+	job.symbols = pSymbols;
+	RunBatch(files.len, opts.numThreads, ProcessFile, &job);
+	if (ReportResults(&opts, &files, results) != 0)
+		retVal = 1;
+
+	for (i = 0; (unsigned)i < files.len; i++)
+	{
+		xfree(results[i].output);
+		EA_DESTROY(ParseDiag, results[i].diags);
+	}
+	xfree(results);
+	if (FinishProfile(&opts) != 0)
+		retVal = 1;
+	FreeBatchPaths(&files);
+	if (pSymbols != NULL)
+		FreeSymTable(pSymbols);
+	FreeIncludeCache();
+	FreeInternTable();
+	FreeStrArenaCache();
+	if (opts.allocStats == TRUE)
+		xalloc_dump_stats(stderr);
+	return retVal;
+}
+
+static void PrintUsage(FILE* fp)
+{
+	fputs("Usage: dlgtool COMMAND [OPTION]... FILE|DIRECTORY...\n"
+		  "\n"
+		  "Commands:\n"
+		  "  parse      Print the parsed contents of each template.\n"
+		  "  validate   Check that each template parses.\n"
+		  "  format     Write each template back out in canonical form.\n"
+		  "  stats      Print control statistics for each template.\n"
+		  "  ids        Report control IDs that are undefined or that\n"
+		  "             have the same value as another control's.\n"
+		  "\n"
+		  "Directories are searched for *.dlg and *.rc files.\n"
+		  "\n"
+		  "Options:\n"
+		  "  -j N       Use N worker threads (default: one per processor).\n"
+		  "  -o FILE    Write the formatted template to FILE (format only).\n"
+		  "  -i         Rewrite each template in place (format only).\n"
+		  "  --profile  Print the time, bytes, and allocations of each\n"
+		  "             loading and saving phase to standard error.\n"
+		  "  --trace FILE\n"
+		  "             Write each phase as a Chrome trace event to FILE.\n"
+		  "  --symbols FILE\n"
+		  "             Read the numeric #define symbols of FILE, such as\n"
+		  "             resource.h, for the IDs and numeric arguments.\n"
+		  "  --sym-cache DIR\n"
+		  "             Cache the symbols of the --symbols file in DIR.\n"
+		  "  -I DIR     Look for #include files in DIR.  This may be\n"
+		  "             given more than once.\n"
+		  "  --all-errors\n"
+		  "             Go on after a parse error and report every error\n"
+		  "             of a template as FILE:LINE:COLUMN: KIND: MESSAGE.\n"
+		  "  --alloc-stats\n"
+		  "             Print allocation statistics to standard error at\n"
+		  "             exit (needs a build with XMALLOC_STATS defined).\n",
+		  fp);
+}
+
+/* Reads the options in front of the file names and removes them from
+   the argument list.  Returns FALSE on a usage error. */
+static BOOL ParseOptions(ToolOpts* opts, int* pArgc, char*** pArgv)
+{
+	int argc;
+	char** argv;
+
+	argc = *pArgc;
+	argv = *pArgv;
+	opts->numThreads = 0;
+	opts->outName = NULL;
+	opts->inPlace = FALSE;
+	opts->profile = FALSE;
+	opts->traceName = NULL;
+	opts->allocStats = FALSE;
+	opts->symName = NULL;
+	opts->symCacheDir = NULL;
+	opts->numIncludeDirs = 0;
+	opts->includeDirs[0] = NULL;
+	opts->allErrors = FALSE;
+	while (argc > 0 && argv[0][0] == '-')
+	{
+		if (strcmp(argv[0], "-j") == 0 && argc >= 2)
+		{
+			opts->numThreads = (unsigned)atoi(argv[1]);
+			argc--; argv++;
+		}
+		else if (strncmp(argv[0], "-j", 2) == 0 && argv[0][2] != '\0')
+			opts->numThreads = (unsigned)atoi(&argv[0][2]);
+		else if (strcmp(argv[0], "-o") == 0 && argc >= 2 &&
+				 opts->cmd == CMD_FORMAT)
+		{
+			opts->outName = argv[1];
+			argc--; argv++;
+		}
+		else if (strcmp(argv[0], "-i") == 0 && opts->cmd == CMD_FORMAT)
+			opts->inPlace = TRUE;
+		else if (strcmp(argv[0], "--profile") == 0)
+			opts->profile = TRUE;
+		else if (strcmp(argv[0], "--alloc-stats") == 0)
+			opts->allocStats = TRUE;
+		else if (strcmp(argv[0], "--trace") == 0 && argc >= 2)
+		{
+			opts->traceName = argv[1];
+			argc--; argv++;
+		}
+		else if (strcmp(argv[0], "--symbols") == 0 && argc >= 2)
+		{
+			opts->symName = argv[1];
+			argc--; argv++;
+		}
+		else if (strcmp(argv[0], "--sym-cache") == 0 && argc >= 2)
+		{
+			opts->symCacheDir = argv[1];
+			argc--; argv++;
+		}
+		else if (strcmp(argv[0], "-I") == 0 && argc >= 2)
+		{
+			if (opts->numIncludeDirs == MAX_INCLUDE_DIRS)
+			{
+				fputs("dlgtool: too many `-I' directories.\n", stderr);
+				return FALSE;
+			}
+			opts->includeDirs[opts->numIncludeDirs++] = argv[1];
+			opts->includeDirs[opts->numIncludeDirs] = NULL;
+			argc--; argv++;
+		}
+		else if (strcmp(argv[0], "--all-errors") == 0)
+			opts->allErrors = TRUE;
+		else if (strcmp(argv[0], "--") == 0)
+		{
+			argc--; argv++;
+			break;
+		}
+		else
+		{
+			fprintf(stderr, "dlgtool: invalid option `%s'.\n", argv[0]);
+			PrintUsage(stderr);
+			return FALSE;
+		}
+		argc--; argv++;
+	}
+	if (opts->outName != NULL && opts->inPlace == TRUE)
+	{
+		fputs("dlgtool: `-o' and `-i' cannot be used together.\n", stderr);
+		return FALSE;
+	}
+	if (opts->symCacheDir != NULL && opts->symName == NULL)
+	{
+		fputs("dlgtool: `--sym-cache' requires `--symbols'.\n", stderr);
+		return FALSE;
+	}
+	*pArgc = argc;
+	*pArgv = argv;
+	return TRUE;
+}
+
+/* Prints a string with special characters written as escape
+   codes. */
+static void PrintEscaped(FILE* fp, const char* str)
+{
+	char* escStr;
+	unsigned len;
+	len = strlen(str);
+	escStr = (char*)xmalloc(len + 1);
+	strcpy(escStr, str);
+	escStr = UntransEscChars(escStr, len);
+	fputs(escStr, fp);
+	xfree(escStr);
+}
+
+/* Prints the parse errors of a template that were recorded in
+   recovery mode, one per line */
+static void PrintDiags(FILE* fp, const char* filename,
+					   const ParseDiag_array* diags)
+{
+	unsigned i;
+	for (i = 0; i < diags->len; i++)
+	{
+		const ParseDiag* diag;
+		diag = &diags->d[i];
+		fprintf(fp, "%s:%u:%u: %s: %s\n", filename, diag->line, diag->col,
+				ParseDiagName(diag->code), diag->message);
+	}
+}
+
+static void ReportError(const char* filename, FileResult* result)
+{
+	if (result->diags.len > 0)
+		PrintDiags(stderr, filename, &result->diags);
+	else if (result->errLine != 0)
+		fprintf(stderr, "%s:%u: %s\n", filename, result->errLine,
+				result->errorDesc);
+	else
+		fprintf(stderr, "%s: %s\n", filename, result->errorDesc);
+}
+
+/* Adds a line about a control ID to the output of a file */
+static void AddIdProblem(FileResult* result, const char* filename,
+						 unsigned ctrlNum, const char* id,
+						 const char* desc)
+{
+	unsigned len;
+	len = strlen(filename) + strlen(id) + strlen(desc) + 32;
+	if (result->outLen + len > result->outAlloc)
+	{
+		result->outAlloc = (result->outAlloc == 0) ? 256 : result->outAlloc;
+		while (result->outLen + len > result->outAlloc)
+			result->outAlloc *= 2;
+		result->output = (char*)xrealloc(result->output, result->outAlloc);
+	}
+	result->outLen += sprintf(&result->output[result->outLen],
+							  "%s: control %u, ID %s: %s\n",
+							  filename, ctrlNum, id, desc);
+	result->numIdProblems++;
+}
+
+static int CompareIdRefs(const void* a, const void* b)
+{
+	const IdRef* refA;
+	const IdRef* refB;
+	refA = (const IdRef*)a;
+	refB = (const IdRef*)b;
+	if (refA->value != refB->value)
+		return (refA->value < refB->value) ? -1 : 1;
+	if (refA->ctrlNum != refB->ctrlNum)
+		return (refA->ctrlNum < refB->ctrlNum) ? -1 : 1;
+	return 0;
+}
+
+/* Reports the control IDs of a template that cannot be evaluated and
+   the ones that share a value.  IDC_STATIC (-1) and its 16-bit form
+   may be shared. */
+static void CheckCtrlIds(ParseCtx* ctx, const char* filename,
+						 FileResult* result)
+{
+	DlgTemplate* dlg;
+	IdRef* refs;
+	unsigned numRefs;
+	unsigned i;
+
+	dlg = ctx->dlg;
+	refs = (IdRef*)xmalloc(sizeof(IdRef) * (dlg->controls.len + 1));
+	numRefs = 0;
+	for (i = 0; i < dlg->controls.len; i++)
+	{
+		long value;
+		int exprResult;
+		exprResult = EvalCtrlId(ctx, i, &value);
+		if (exprResult != EXPR_OK)
+		{
+			AddIdProblem(result, filename, i, GetCtrlId(dlg, i),
+						 ExprErrorDesc(exprResult));
+			continue;
+		}
+		if (value == -1 || value == 0xffff)
+			continue;
+		refs[numRefs].value = value;
+		refs[numRefs].ctrlNum = i;
+		numRefs++;
+	}
+	qsort(refs, numRefs, sizeof(IdRef), CompareIdRefs);
+	for (i = 1; i < numRefs; i++)
+	{
+		char desc[64];
+		if (refs[i].value != refs[i-1].value)
+			continue;
+		sprintf(desc, "Same value (%ld) as control %u.",
+				refs[i].value, refs[i-1].ctrlNum);
+		AddIdProblem(result, filename, refs[i].ctrlNum,
+					 GetCtrlId(dlg, refs[i].ctrlNum), desc);
+	}
+	xfree(refs);
+}
+
+/* Batch function: processes one file and stores its results.  This
+   runs on the worker threads, so it must only touch its own
+   result. */
+static void ProcessFile(void* userData, unsigned taskNum,
+						unsigned threadNum)
+{
+	ToolJob* job;
+	FileResult* result;
+	const char* filename;
+	DlgTemplate dlg;
+	ParseCtx ctx;
+	TmplFileMap map;
+	unsigned i;
+
+	(void)threadNum; /* The results are per task, not per thread */
+	job = (ToolJob*)userData;
+	result = &job->results[taskNum];
+	filename = job->files->d[taskNum];
+	SetProfLabel(filename);
+
+	/* Parse lazily, since most commands never read the text fields */
+	InitDlgData(&dlg);
+	InitParseCtx(&ctx, &dlg);
+	if (job->symbols != NULL)
+	{
+		ctx.symLookup = LookupSym;
+		ctx.symParam = job->symbols;
+	}
+	ctx.includeDirs = job->opts->includeDirs;
+	if (job->opts->allErrors == TRUE)
+	{
+		EA_INIT(ParseDiag, result->diags, 4);
+		ctx.diags = &result->diags;
+	}
+	if (!LoadDlgTemplateLazy(&ctx, &map, filename))
+	{
+		result->ok = FALSE;
+		result->errLine = ctx.curLine;
+		result->errorDesc = ctx.errorDesc;
+		return;
+	}
+	result->loaded = TRUE;
+	result->ok = TRUE;
+	result->numCtrls = dlg.controls.len;
+
+	switch (job->opts->cmd)
+	{
+	case CMD_FORMAT:
+		if (job->opts->inPlace == TRUE || job->opts->outName != NULL)
+		{
+			const char* outName;
+			outName = (job->opts->inPlace == TRUE) ?
+				filename : job->opts->outName;
+			/* The file may be overwritten, so let go of it first */
+			DecodeDlgFields(&dlg);
+			UnmapTmplFile(&map);
+			if (!SaveDlgTemplateFile(&ctx, outName))
+			{
+				result->ok = FALSE;
+				result->errorDesc = "Could not write the file.";
+			}
+		}
+		else
+			result->output = FmtDlgTemplate(&ctx, &result->outLen);
+		break;
+	case CMD_STATS:
+		for (i = 0; i < dlg.controls.len; i++)
+		{
+			int typeIdx;
+			typeIdx = CTRL_TYPE_INDEX(&dlg.controls.d[i]);
+			if (typeIdx >= 0 && typeIdx < NUM_CTRL_TYPES)
+				result->typeCounts[typeIdx]++;
+		}
+		break;
+	case CMD_IDS:
+		CheckCtrlIds(&ctx, filename, result);
+		break;
+	}
+	FreeDlgData(&dlg);
+	UnmapTmplFile(&map);
+}
+
+static int CmdParse(BatchPath_array* files, SymTable* symbols,
+					const char* const* includeDirs, BOOL allErrors)
+{
+	ParseDiag_array diags;
+	int retVal;
+	unsigned i;
+	retVal = 0;
+	EA_INIT(ParseDiag, diags, 4);
+	for (i = 0; i < files->len; i++)
+	{
+		DlgTemplate dlg;
+		ParseCtx ctx;
+		unsigned j;
+
+		InitDlgData(&dlg);
+		InitParseCtx(&ctx, &dlg);
+		if (symbols != NULL)
+		{
+			ctx.symLookup = LookupSym;
+			ctx.symParam = symbols;
+		}
+		ctx.includeDirs = includeDirs;
+		if (allErrors == TRUE)
+		{
+			diags.len = 0;
+			ctx.diags = &diags;
+		}
+		SetProfLabel(files->d[i]);
+		if (!LoadDlgTemplateFile(&ctx, files->d[i]))
+		{
+			if (diags.len > 0)
+				PrintDiags(stderr, files->d[i], &diags);
+			else if (ctx.curLine != 0)
+				fprintf(stderr, "%s:%u: %s\n", files->d[i], ctx.curLine,
+						ctx.errorDesc);
+			else
+				fprintf(stderr, "%s: %s\n", files->d[i], ctx.errorDesc);
+			retVal = 1;
+			continue;
+		}
+		printf("%s:\n", files->d[i]);
+		printf("  rect: %li, %li, %li, %li\n",
+			   dlg.pos.x, dlg.pos.y, dlg.width, dlg.height);
+		if (dlg.hasCaption == TRUE)
+		{
+			fputs("  caption: \"", stdout);
+			PrintEscaped(stdout, dlg.caption);
+			fputs("\"\n", stdout);
+		}
+		if (dlg.fontFam != NULL)
+			printf("  font: %u, \"%s\"\n", dlg.pointSize, dlg.fontFam);
+		printf("  controls: %u\n", dlg.controls.len);
+		for (j = 0; j < dlg.controls.len; j++)
+		{
+			DlgItem* pCtrl;
+			const char* text;
+			const char* style;
+			const char* exStyle;
+			long idValue;
+			pCtrl = &dlg.controls.d[j];
+			printf("  [%u] %s id=%s",
+				   j, CtrlTypeName(pCtrl->rendClass, pCtrl->rendType),
+				   GetCtrlId(&dlg, j));
+			/* Show what the symbol stands for */
+			if ((symbols != NULL || dlg.syms != NULL) &&
+				EvalCtrlId(&ctx, j, &idValue) == EXPR_OK)
+				printf(" idval=%li", idValue);
+			printf(" rect=%i,%i,%i,%i",
+				   pCtrl->x, pCtrl->y, pCtrl->cx, pCtrl->cy);
+			text = GetCtrlText(&dlg, j);
+			if (text[0] != '\0')
+			{
+				fputs(" text=\"", stdout);
+				PrintEscaped(stdout, text);
+				fputs("\"", stdout);
+			}
+			if (pCtrl->rendClass == 0)
+				printf(" class=%s", GetCtrlClass(&dlg, j));
+			style = GetCtrlStyle(&dlg, j);
+			exStyle = GetCtrlExStyle(&dlg, j);
+			if (style != NULL && style[0] != '\0')
+				printf(" style=\"%s\"", style);
+			if (exStyle != NULL && exStyle[0] != '\0')
+				printf(" exstyle=\"%s\"", exStyle);
+			fputs("\n", stdout);
+		}
+		FreeDlgData(&dlg);
+	}
+	EA_DESTROY(ParseDiag, diags);
+	return retVal;
+}
+
+/* Prints the results of a batch run in file order and returns the
+   exit status. */
+static int ReportResults(ToolOpts* opts, BatchPath_array* files,
+						 FileResult* results)
+{
+	unsigned long typeTotals[NUM_CTRL_TYPES];
+	unsigned long numCtrls;
+	unsigned long numIdProblems;
+	unsigned numGood;
+	unsigned numLoaded;
+	unsigned i, j;
+
+	memset(typeTotals, 0, sizeof(typeTotals));
+	numCtrls = 0;
+	numIdProblems = 0;
+	numGood = 0;
+	numLoaded = 0;
+	for (i = 0; i < files->len; i++)
+	{
+		FileResult* result;
+		result = &results[i];
+		if (result->ok == TRUE)
+			numGood++;
+		else
+			ReportError(files->d[i], result);
+		if (result->loaded == FALSE)
+			continue;
+		numLoaded++;
+		numCtrls += result->numCtrls;
+		numIdProblems += result->numIdProblems;
+		if (result->output != NULL)
+		{
+			ProfMark mark;
+			SetProfLabel(files->d[i]);
+			ProfBegin(&mark);
+			fwrite(result->output, 1, result->outLen, stdout);
+			ProfEnd(&mark, PROF_WRITE, result->outLen);
+		}
+		if (opts->cmd == CMD_STATS)
+		{
+			printf("%s: %u controls\n", files->d[i], result->numCtrls);
+			for (j = 0; j < NUM_CTRL_TYPES; j++)
+				typeTotals[j] += result->typeCounts[j];
+		}
+	}
+
+	if (opts->cmd == CMD_VALIDATE && files->len > 1)
+		printf("%u of %u templates are valid.\n", numGood, files->len);
+	if (opts->cmd == CMD_STATS)
+	{
+		printf("Total: %lu controls in %u templates\n", numCtrls, numLoaded);
+		for (j = 0; j < NUM_CTRL_TYPES; j++)
+		{
+			if (typeTotals[j] != 0)
+				printf("  %-16s %lu\n", CtrlTypeName(j / 4, j % 4),
+					   typeTotals[j]);
+		}
+	}
+	if (opts->cmd == CMD_IDS && numIdProblems != 0)
+		return 1;
+	return (numGood == files->len) ? 0 : 1;
+}
+
+/* Prints the profile and writes the trace, if they were asked for.
+   Returns nonzero if the trace could not be written. */
+static int FinishProfile(ToolOpts* opts)
+{
+	int retVal;
+	retVal = 0;
+	if (opts->profile == TRUE)
+		PrintProfile(stderr);
+	if (opts->traceName != NULL && !WriteProfTrace(opts->traceName))
+	{
+		fprintf(stderr, "%s: Cannot open file for writing.\n",
+				opts->traceName);
+		retVal = 1;
+	}
+	FreeProfData();
+	return retVal;
+}
@@ -28,18 +28,20 @@
      as an argument.
 
    * NOTE: Because of the fact that this expandable array
-     implementation uses macros extensively, there are some
-     programming situations where macro inputs get clobbered during
-     intermediate execution of the macros.  So far, this code was only
-     modified in one place to compensate for these issues.
+     implementation uses macros extensively, the `array' argument is
+     evaluated many times, so it must not have side effects.  Position
+     and count arguments are copied into locals first, so they may
+     refer to the array itself (for example `array.len - 1').
 
    * When you are done using an expandable array, make sure you call
      `EA_DESTROY()'.
 
    * To reserve space for extra elements that will be written in-place
      at a later time, set `typename_array::len' to the desired size
-     and then call `EA_NORMALIZE()'.  `EA_NORMALIZE()' can also be
-     used to free up unused space in an array.
+     and then call `EA_NORMALIZE()'.  If you know how many elements
+     an array will hold, call `EA_RESERVE()' first so that it is
+     allocated only once, and call `EA_SHRINK_TO_FIT()' to free up
+     unused space in an array.
 
    * The normal behavior of an exparray is to allocate a reserve in
      advance, and allocate more space once all of the previously
@@ -55,7 +57,17 @@
      macros for `EA_GROW()' and `EA_NORMALIZE()'.  Normally,
      allocation behavior is done in an exponential manner without
      clearing newly allocated memory.  You can change this by defining
-     `EA_LINEAR_REALLOC' or `EA_GARRAY_REALLOC'.
+     `EA_LINEAR_REALLOC' or `EA_GARRAY_REALLOC'.  The growth factor of
+     the default reallocators can be changed by defining
+     `ea_next_alloc(alloc)' to return the next capacity after `alloc',
+     which must be larger than `alloc'.
+
+   * To watch how arrays grow, define `ea_grow_hook(tysize, len,
+     old_alloc, new_alloc)' before including this header.
+     `EA_GROW()' and `EA_NORMALIZE()' call it whenever they reallocate
+     an array, with the element size, the number of elements in use,
+     and the old and new capacity in elements.  "xmalloc.h" defines it
+     when XMALLOC_STATS is defined.
 
    * The rest of the functions are convenience functions that use the
      previously mentioned primitives.  See their individual
@@ -78,6 +90,14 @@
 
 #include <string.h>
 
+#ifndef ea_next_alloc
+#define ea_next_alloc(alloc) ((alloc) * 2)
+#endif
+
+#ifndef ea_grow_hook
+#define ea_grow_hook(tysize, len, old_alloc, new_alloc) ((void)(old_alloc))
+#endif
+
 #define EA_TYPE(typename)						\
 	struct typename##_array_tag					\
 	{											\
@@ -129,7 +149,19 @@
 
    EA_NORMALIZE(typename, array)
      Ensure that the allocated space is consistent with the current
-     allocation algorithm.  */
+     allocation algorithm.  With the default reallocators, the array
+     only grows, and memory is only reallocated if it has to.
+
+   EA_RESERVE(typename, array, num)
+     Allocate space for at least `num' elements, so that the array can
+     be filled up to that many elements without reallocating.  The
+     linear reallocators always allocate in steps of the stride, so
+     for them this does nothing.
+
+   EA_SHRINK_TO_FIT(typename, array)
+     Free up the unused space at the end of the array.  The GLib
+     GArray reallocators keep their allocation, so for them this does
+     nothing.  */
 
 /* GLib GArray reallocators.  */
 #ifdef EA_GARRAY_REALLOC
@@ -175,6 +207,23 @@
 			   reala->tysize * 1);									\
 	}																\
 }
+#define EA_RESERVE(typename, array, num)							\
+{																	\
+	struct _GRealWrap *reala = (struct _GRealWrap *)(&array);		\
+	unsigned ea_new_alloc = (num) + 1 + (reala->zero_term ? 1 : 0);	\
+	if (ea_new_alloc > reala->ea_len_alloc)							\
+	{																\
+		reala->ea_len_alloc = ea_new_alloc;							\
+		reala->data = (typename *)ea_realloc(reala->data, reala->tysize * \
+											 reala->ea_len_alloc);	\
+		if (reala->clear)											\
+		{															\
+			memset(reala->data + reala->tysize * reala->len, 0,		\
+				   reala->tysize * (reala->ea_len_alloc - reala->len)); \
+		}															\
+	}																\
+}
+#define EA_SHRINK_TO_FIT(typename, array) {}
 /* END EA_GARRAY_REALLOC */
 
 /* Linear reallocators.  */
@@ -183,12 +232,23 @@
 #define EA_GROW(typename, array)										\
 {																		\
 	if ((array).len % (array).ea_stride == 0)							\
+	{																	\
+		ea_grow_hook((array).tysize, (array).len, (array).len,			\
+					 (array).len + (array).ea_stride);					\
 		(array).d = (typename *)ea_realloc((array).d, (array).tysize *	\
 									   ((array).len + (array).ea_stride)); \
+	}																	\
 }
 #define EA_NORMALIZE(typename, array)									\
+{																		\
+	ea_grow_hook((array).tysize, (array).len, (array).len,				\
+				 (array).len + ((array).ea_stride -						\
+								(array).len % (array).ea_stride));		\
 	(array).d = (typename *)ea_realloc((array).d, (array).tysize *		\
-	   ((array).len + ((array).ea_stride - (array).len % (array).ea_stride)));
+	   ((array).len + ((array).ea_stride - (array).len % (array).ea_stride))); \
+}
+#define EA_RESERVE(typename, array, num) {}
+#define EA_SHRINK_TO_FIT(typename, array) EA_NORMALIZE(typename, array)
 /* END EA_LINEAR_REALLOC */
 
 /* Default exponential reallocators.  */
@@ -196,21 +256,53 @@
 #define EA_GROW(typename, array)				\
 	if ((array).len >= (array).ea_len_alloc)	\
 	{											\
-		(array).ea_len_alloc *= 2;				\
+		unsigned ea_new_alloc = ea_next_alloc((array).ea_len_alloc); \
+		ea_grow_hook((array).tysize, (array).len,	\
+					 (array).ea_len_alloc, ea_new_alloc); \
+		(array).ea_len_alloc = ea_new_alloc;	\
 		(array).d = (typename *)ea_realloc((array).d, (array).tysize *	\
 									   (array).ea_len_alloc);		\
 	}
 #define EA_NORMALIZE(typename, array)								\
 {																	\
-	while ((array).ea_len_alloc > 0 &&								\
-		   (array).ea_len_alloc >= (array).len)						\
-		(array).ea_len_alloc /= 2;									\
-	if ((array).ea_len_alloc == 0)									\
-		(array).ea_len_alloc = 1;									\
-	while ((array).len >= (array).ea_len_alloc)						\
-		(array).ea_len_alloc *= 2;									\
-	(array).d = (typename *)ea_realloc((array).d, (array).tysize *	\
-								   (array).ea_len_alloc);			\
+	unsigned ea_new_alloc = (array).ea_len_alloc;					\
+	if (ea_new_alloc == 0)											\
+		ea_new_alloc = 1;											\
+	while ((array).len >= ea_new_alloc)								\
+		ea_new_alloc = ea_next_alloc(ea_new_alloc);					\
+	if (ea_new_alloc != (array).ea_len_alloc)						\
+	{																\
+		ea_grow_hook((array).tysize, (array).len,					\
+					 (array).ea_len_alloc, ea_new_alloc);			\
+		(array).ea_len_alloc = ea_new_alloc;						\
+		(array).d = (typename *)ea_realloc((array).d, (array).tysize * \
+									   (array).ea_len_alloc);		\
+	}																\
+}
+/* Like the reserve given to `EA_INIT()', this keeps room for one
+   element past `num'.  */
+#define EA_RESERVE(typename, array, num)							\
+{																	\
+	unsigned ea_new_alloc = (num) + 1;								\
+	if (ea_new_alloc > (array).ea_len_alloc)						\
+	{																\
+		ea_grow_hook((array).tysize, (array).len,					\
+					 (array).ea_len_alloc, ea_new_alloc);			\
+		(array).ea_len_alloc = ea_new_alloc;						\
+		(array).d = (typename *)ea_realloc((array).d, (array).tysize * \
+									   (array).ea_len_alloc);		\
+	}																\
+}
+#define EA_SHRINK_TO_FIT(typename, array)							\
+{																	\
+	if ((array).ea_len_alloc > (array).len + 1)						\
+	{																\
+		ea_grow_hook((array).tysize, (array).len,					\
+					 (array).ea_len_alloc, (array).len + 1);		\
+		(array).ea_len_alloc = (array).len + 1;						\
+		(array).d = (typename *)ea_realloc((array).d, (array).tysize * \
+									   (array).ea_len_alloc);		\
+	}																\
 }
 #endif /* END reallocators */
 
@@ -259,9 +351,10 @@
                  inserted */
 #define EA_INS(typename, array, pos)			\
 {												\
+	unsigned ea_pos = (pos);					\
 	EA_ADD(typename, array);					\
-	memmove(&EA_SR(array, pos+1), &EA_SR(array, pos), (array).tysize * \
-			((array).len - pos));									   \
+	memmove(&EA_SR(array, ea_pos+1), &EA_SR(array, ea_pos),	\
+			(array).tysize * ((array).len - 1 - ea_pos));	\
 }
 
 /* Appends the given item to the end of the array.  Note that the
@@ -328,11 +421,13 @@
 #define EA_INSERT_MULT(typename, array, pos, data, num_data)			\
 	if (data != NULL)													\
 	{																	\
-		(array).len += num_data;										\
+		unsigned ea_pos = (pos);										\
+		unsigned ea_num = (num_data);									\
+		(array).len += ea_num;											\
 		EA_NORMALIZE(typename, array);									\
-		memmove(&EA_SR(array, pos+num_data), &EA_SR(array, pos),		\
-				(array).tysize * ((array).len - pos));					\
-		memcpy(&EA_SR(array, pos), data, (array).tysize * num_data);	\
+		memmove(&EA_SR(array, ea_pos+ea_num), &EA_SR(array, ea_pos),	\
+				(array).tysize * ((array).len - ea_num - ea_pos));		\
+		memcpy(&EA_SR(array, ea_pos), data, (array).tysize * ea_num);	\
 	}
 
 /* Prepend the given element at the beginning of the array.  Note that
@@ -370,8 +465,9 @@
                  remove */
 #define EA_REMOVE(typename, array, pos)									\
 {																		\
-	memmove(&EA_SR(array, pos), &EA_SR(array, pos+1), (array).tysize *	\
-			((array).len - (pos + 1)));									\
+	unsigned ea_pos = (pos);											\
+	memmove(&EA_SR(array, ea_pos), &EA_SR(array, ea_pos+1),			\
+			(array).tysize * ((array).len - (ea_pos + 1)));				\
 	(array).len--;														\
 }
 
@@ -397,14 +493,16 @@
 
    `typename'    the base type that the array contains, such as `int'
    `array'       the value (not pointer) of the exparray to modify
-   `data'        the address of the data array to append
    `pos'         the zero-based index indicating the first element to
                  remove
    `num_data'    the number of items to remove */
 #define EA_REMOVE_RANGE(typename, array, pos, num_data)					\
 {																		\
-	memmove(&EA_SR(array, pos), &EA_SR(array, pos+num_data),			\
-			(array).tysize * ((array).len - (pos + num_data)));			\
+	unsigned ea_pos = (pos);											\
+	unsigned ea_num = (num_data);										\
+	memmove(&EA_SR(array, ea_pos), &EA_SR(array, ea_pos+ea_num),		\
+			(array).tysize * ((array).len - (ea_pos + ea_num)));		\
+	(array).len -= ea_num;												\
 }
 
 /* Set an array's size and allocate enough memory for that size.
@@ -5,8 +5,9 @@
 
 #include <string.h>
 
-#include "dlgedit.h"
 #include "tmplparser.h"
+#include "ctrlgrid.h"
+#include "dlgedit.h"
 #include "ufsys.h"
 
 #include "graphhit.h"
@@ -29,6 +30,8 @@ static POINT lastMovePos;
 /* This is actually not a (l, t, r, b) rectangle but (x, y, w, h) */
 static RECT origRect;
 
+static long ScrToDlgUnits(long pix, long base, int div);
+
 /********************************************************************\
  * Hit-testing														*
 \********************************************************************/
@@ -48,15 +51,15 @@ void ProcLBtnDown(HWND hwnd, LPARAM lParam)
 		downPos.y = pt.y;
 		if (activeCtrl == -1)
 		{
-			origRect.left = dlgPos.x;
-			origRect.top = dlgPos.y;
-			origRect.right = dlgWidth;
-			origRect.bottom = dlgHeight;
+			origRect.left = curDlg.pos.x;
+			origRect.top = curDlg.pos.y;
+			origRect.right = curDlg.width;
+			origRect.bottom = curDlg.height;
 		}
 		else
 		{
 			DlgItem* pCtrl;
-			pCtrl = &dlgControls.d[activeCtrl];
+			pCtrl = &curDlg.controls.d[activeCtrl];
 			origRect.left = pCtrl->x;
 			origRect.top = pCtrl->y;
 			origRect.right = pCtrl->cx;
@@ -67,11 +70,11 @@ void ProcLBtnDown(HWND hwnd, LPARAM lParam)
 	}
 
 	/* Check if the titlebar was clicked on */
-	if (dlgHasCaption == TRUE)
+	if (curDlg.hasCaption == TRUE)
 	{
-		rt.left = DLG2SCR_X(dlgPos.x);
-		rt.top = DLG2SCR_Y(dlgPos.y);
-		rt.right = rt.left + DLG2SCR_X(dlgWidth);
+		rt.left = DLG2SCR_X(curDlg.pos.x);
+		rt.top = DLG2SCR_Y(curDlg.pos.y);
+		rt.right = rt.left + DLG2SCR_X(curDlg.width);
 		rt.bottom = rt.top + GetSystemMetrics(SM_CYCAPTION);
 		if (PtInRect(&rt, pt))
 		{
@@ -85,8 +88,8 @@ void ProcLBtnDown(HWND hwnd, LPARAM lParam)
 			downPos.y = pt.y;
 			lastMovePos.x = (short)LOWORD(lParam);
 			lastMovePos.y = (short)HIWORD(lParam);
-			lastDlgPos.x = dlgPos.x;
-			lastDlgPos.y = dlgPos.y;
+			lastDlgPos.x = curDlg.pos.x;
+			lastDlgPos.y = curDlg.pos.y;
 			WindowCursorClip(hwnd);
 			return;
 		}
@@ -94,38 +97,22 @@ void ProcLBtnDown(HWND hwnd, LPARAM lParam)
 
 	/* Check if a control was clicked on */
 	{
-		unsigned i;
-		BOOL hitTest;
-		hitTest = FALSE;
-		for (i = 0; i < dlgControls.len; i++)
-		{
-			/* Get the item rectangle */
-			rt.left = dlgControls.d[i].x;
-			rt.top = dlgControls.d[i].y;
-			rt.right = rt.left + dlgControls.d[i].cx;
-			rt.bottom = rt.top + dlgControls.d[i].cy;
-			DlgUnitMap(&rt);
-			/* Translate to absolute screen coordinates */
-			rt.left += DLG2SCR_X(dlgPos.x);
-			rt.top += DLG2SCR_Y(dlgPos.y);
-			rt.right += DLG2SCR_X(dlgPos.x);
-			rt.bottom += DLG2SCR_Y(dlgPos.y);
-			if (dlgHasCaption == TRUE)
-			{
-				rt.top += GetSystemMetrics(SM_CYCAPTION);
-				rt.bottom += GetSystemMetrics(SM_CYCAPTION);
-			}
-			if (PtInRect(&rt, pt))
-			{
-				activeCtrl = i;
-				hitTest = TRUE;
-				lastDlgPos.x = dlgControls.d[i].x;
-				lastDlgPos.y = dlgControls.d[i].y;
-				/* Keep going so that we get the control on top */
-			}
-		}
-		if (hitTest == TRUE)
+		int hitCtrl;
+		/* Translate to dialog units relative to the client area */
+		rt.left = pt.x - DLG2SCR_X(curDlg.pos.x);
+		rt.top = pt.y - DLG2SCR_Y(curDlg.pos.y);
+		if (curDlg.hasCaption == TRUE)
+			rt.top -= GetSystemMetrics(SM_CYCAPTION);
+		rt.right = rt.left + 1;
+		rt.bottom = rt.top + 1;
+		ScrUnitMap(&rt);
+		/* The spatial index returns the control on top */
+		hitCtrl = HitTestCtrls(&curDlg, rt.left, rt.top);
+		if (hitCtrl != -1)
 		{
+			activeCtrl = hitCtrl;
+			lastDlgPos.x = curDlg.controls.d[hitCtrl].x;
+			lastDlgPos.y = curDlg.controls.d[hitCtrl].y;
 			/* Possibly drag the control */
 			clickHit = TRUE;
 			downPos.x = pt.x;
@@ -138,11 +125,11 @@ void ProcLBtnDown(HWND hwnd, LPARAM lParam)
 	}
 
 	/* As a last resort, the dialog can be selected */
-	rt.left = DLG2SCR_X(dlgPos.x);
-	rt.top = DLG2SCR_Y(dlgPos.y);
-	rt.right = rt.left + DLG2SCR_X(dlgWidth);
-	rt.bottom = rt.top + DLG2SCR_Y(dlgHeight);
-	if (dlgHasCaption == TRUE)
+	rt.left = DLG2SCR_X(curDlg.pos.x);
+	rt.top = DLG2SCR_Y(curDlg.pos.y);
+	rt.right = rt.left + DLG2SCR_X(curDlg.width);
+	rt.bottom = rt.top + DLG2SCR_Y(curDlg.height);
+	if (curDlg.hasCaption == TRUE)
 	{
 		rt.top += GetSystemMetrics(SM_CYCAPTION);
 		rt.bottom += GetSystemMetrics(SM_CYCAPTION);
@@ -191,15 +178,15 @@ void ProcMouseMove(HWND hwnd, LPARAM lParam)
 		i = curDragHand;
 		if (activeCtrl == -1)
 		{
-			newCoords.left = dlgPos.x;
-			newCoords.top = dlgPos.y;
-			newCoords.right = dlgWidth;
-			newCoords.bottom = dlgHeight;
+			newCoords.left = curDlg.pos.x;
+			newCoords.top = curDlg.pos.y;
+			newCoords.right = curDlg.width;
+			newCoords.bottom = curDlg.height;
 		}
 		else
 		{
 			DlgItem* pCtrl;
-			pCtrl = &dlgControls.d[activeCtrl];
+			pCtrl = &curDlg.controls.d[activeCtrl];
 			newCoords.left = pCtrl->x;
 			newCoords.top = pCtrl->y;
 			newCoords.right = pCtrl->cx;
@@ -222,44 +209,45 @@ void ProcMouseMove(HWND hwnd, LPARAM lParam)
 
 		if (activeCtrl == -1)
 		{
-			dlgPos.x = newCoords.left;
-			dlgPos.y = newCoords.top;
-			dlgWidth = newCoords.right;
-			dlgHeight = newCoords.bottom;
+			curDlg.pos.x = newCoords.left;
+			curDlg.pos.y = newCoords.top;
+			curDlg.width = newCoords.right;
+			curDlg.height = newCoords.bottom;
 		}
 		else
 		{
 			DlgItem* pCtrl;
-			pCtrl = &dlgControls.d[activeCtrl];
+			pCtrl = &curDlg.controls.d[activeCtrl];
 			pCtrl->x = newCoords.left;
 			pCtrl->y = newCoords.top;
 			pCtrl->cx = newCoords.right;
 			pCtrl->cy = newCoords.bottom;
+			UpdateDlgItemRect(&curDlg, activeCtrl);
 		}
 		InvalSelItem(hwnd);
 	}
 	else if (clickHit == TRUE && activeCtrl == -1)
 	{
-		/*RECT updRect; Update clipping does not work when dlgPos < 0 */
+		/*RECT updRect; Update clipping does not work when curDlg.pos < 0 */
 		POINT pixMove;
 		/* The the bits to scroll before further calculations */
-		/*updRect.left = dlgPos.x;
-		  updRect.top = dlgPos.y;
-		  updRect.right = updRect.left + dlgWidth;
-		  updRect.bottom = updRect.top + dlgHeight;
+		/*updRect.left = curDlg.pos.x;
+		  updRect.top = curDlg.pos.y;
+		  updRect.right = updRect.left + curDlg.width;
+		  updRect.bottom = updRect.top + curDlg.height;
 		  DlgUnitMap(&updRect);
-		  if (dlgHasCaption == TRUE)
+		  if (curDlg.hasCaption == TRUE)
 		  updRect.bottom += GetSystemMetrics(SM_CYCAPTION);*/
 		fileChanged = TRUE;
-		dlgPos.x = lastDlgPos.x +
+		curDlg.pos.x = lastDlgPos.x +
 			MulDiv((short)LOWORD(lParam) - downPos.x, 4, dlgBaseX);
-		dlgPos.y = lastDlgPos.y +
+		curDlg.pos.y = lastDlgPos.y +
 			MulDiv((short)HIWORD(lParam) - downPos.y, 8, dlgBaseY);
 		/* Due to dialog unit rounding, scrolling can be a bit
 		   complicatated. */
 		/* First we convert the current dialog position to screen units */
-		pixMove.x = DLG2SCR_X(dlgPos.x);
-		pixMove.y = DLG2SCR_Y(dlgPos.y);
+		pixMove.x = DLG2SCR_X(curDlg.pos.x);
+		pixMove.y = DLG2SCR_Y(curDlg.pos.y);
 		/* Then we calculate the dialog displacement in screen units */
 		pixMove.x -= DLG2SCR_X(lastDlgPos.x);
 		pixMove.y -= DLG2SCR_Y(lastDlgPos.y);
@@ -267,7 +255,7 @@ void ProcMouseMove(HWND hwnd, LPARAM lParam)
 		   mouse was clicked for dragging */
 		pixMove.x += downPos.x;
 		pixMove.y += downPos.y;
-		/*if (dlgPos.x < 0 || dlgPos.y < 0)
+		/*if (curDlg.pos.x < 0 || curDlg.pos.y < 0)
 		  {
 		  /* Be on the safe side of the scroll rectangle, otherwise
 		  the full dialog bits sometimes don't get scrolled. *
@@ -287,7 +275,7 @@ void ProcMouseMove(HWND hwnd, LPARAM lParam)
 	else if (clickHit == TRUE)
 	{
 		DlgItem* pCtrl;
-		pCtrl = &dlgControls.d[activeCtrl];
+		pCtrl = &curDlg.controls.d[activeCtrl];
 
 		fileChanged = TRUE;
 		/* Invalidate the area at the old control dimensions */
@@ -297,6 +285,7 @@ void ProcMouseMove(HWND hwnd, LPARAM lParam)
 			MulDiv((short)LOWORD(lParam) - downPos.x, 4, dlgBaseX);
 		pCtrl->y = lastDlgPos.y +
 			MulDiv((short)HIWORD(lParam) - downPos.y, 8, dlgBaseY);
+		UpdateDlgItemRect(&curDlg, activeCtrl);
 
 		/* Invalidate the new area */
 		InvalSelItem(hwnd);
@@ -317,15 +306,15 @@ void DragHandleTest(HWND hwnd)
 	for (i = 0; i < 8; i++)
 	{
 		CopyRect(&rt, &dragHandles[i]);
-		if (dlgHasCaption == TRUE)
+		if (curDlg.hasCaption == TRUE)
 		{
 			rt.top += GetSystemMetrics(SM_CYCAPTION);
 			rt.bottom += GetSystemMetrics(SM_CYCAPTION);
 		}
-		rt.left += DLG2SCR_X(dlgPos.x);
-		rt.top += DLG2SCR_Y(dlgPos.y);
-		rt.right += DLG2SCR_X(dlgPos.x);
-		rt.bottom += DLG2SCR_Y(dlgPos.y);
+		rt.left += DLG2SCR_X(curDlg.pos.x);
+		rt.top += DLG2SCR_Y(curDlg.pos.y);
+		rt.right += DLG2SCR_X(curDlg.pos.x);
+		rt.bottom += DLG2SCR_Y(curDlg.pos.y);
 		if (PtInRect(&rt, pt))
 		{
 			curDragHand = i;
@@ -353,34 +342,36 @@ void CancelDrag()
 	{
 		if (activeCtrl == -1)
 		{
-			dlgPos.x = lastDlgPos.x;
-			dlgPos.y = lastDlgPos.y;
+			curDlg.pos.x = lastDlgPos.x;
+			curDlg.pos.y = lastDlgPos.y;
 		}
 		else
 		{
 			DlgItem* pCtrl;
-			pCtrl = &dlgControls.d[activeCtrl];
+			pCtrl = &curDlg.controls.d[activeCtrl];
 			pCtrl->x = lastDlgPos.x;
 			pCtrl->y = lastDlgPos.y;
+			UpdateDlgItemRect(&curDlg, activeCtrl);
 		}
 	}
 	else
 	{
 		if (activeCtrl == -1)
 		{
-			dlgPos.x = origRect.left;
-			dlgPos.y = origRect.top;
-			dlgWidth = origRect.right;
-			dlgHeight = origRect.bottom;
+			curDlg.pos.x = origRect.left;
+			curDlg.pos.y = origRect.top;
+			curDlg.width = origRect.right;
+			curDlg.height = origRect.bottom;
 		}
 		else
 		{
 			DlgItem* pCtrl;
-			pCtrl = &dlgControls.d[activeCtrl];
+			pCtrl = &curDlg.controls.d[activeCtrl];
 			pCtrl->x = origRect.left;
 			pCtrl->y = origRect.top;
 			pCtrl->cx = origRect.right;
 			pCtrl->cy = origRect.bottom;
+			UpdateDlgItemRect(&curDlg, activeCtrl);
 		}
 	}
 }
@@ -517,19 +508,19 @@ void InvalSelItem(HWND hwnd)
 		/* We don't actually support partial rendering of the entire dialog */
 		InvalidateRect(hwnd, NULL, TRUE);
 		return;
-		/*rt.left = dlgPos.x;
-		rt.top = dlgPos.y;
-		rt.right = rt.left + dlgWidth;
-		rt.bottom = rt.top + dlgHeight;
+		/*rt.left = curDlg.pos.x;
+		rt.top = curDlg.pos.y;
+		rt.right = rt.left + curDlg.width;
+		rt.bottom = rt.top + curDlg.height;
 		DlgUnitMap(&rt);
-		if (dlgHasCaption == TRUE)
+		if (curDlg.hasCaption == TRUE)
 			rt.bottom += GetSystemMetrics(SM_CYCAPTION);*/
 	}
 	else
 	{
 		DlgItem* pCtrl;
 		POINT scrOffset;
-		pCtrl = &dlgControls.d[activeCtrl];
+		pCtrl = &curDlg.controls.d[activeCtrl];
 		rt.left = pCtrl->x;
 		rt.top = pCtrl->y;
 		rt.right = rt.left + pCtrl->cx;
@@ -537,9 +528,9 @@ void InvalSelItem(HWND hwnd)
 		DlgUnitMap(&rt);
 
 		/* Add the dialog position separately to avoid rounding errors */
-		scrOffset.x = DLG2SCR_X(dlgPos.x);
-		scrOffset.y = DLG2SCR_Y(dlgPos.y);
-		if (dlgHasCaption == TRUE)
+		scrOffset.x = DLG2SCR_X(curDlg.pos.x);
+		scrOffset.y = DLG2SCR_Y(curDlg.pos.y);
+		if (curDlg.hasCaption == TRUE)
 			scrOffset.y += GetSystemMetrics(SM_CYCAPTION);
 		rt.left += scrOffset.x; rt.top += scrOffset.y;
 		rt.right += scrOffset.x; rt.bottom += scrOffset.y;
@@ -565,25 +556,28 @@ void DrawDlgItemDispatch(HDC hDC, unsigned ctrlNum)
 {
 	RECT rt;
 	DlgItem* pCtrl;
+	const char* text;
 
-	pCtrl = &dlgControls.d[ctrlNum];
+	pCtrl = &curDlg.controls.d[ctrlNum];
 	rt.left = pCtrl->x;
 	rt.top = pCtrl->y;
 	rt.right = rt.left + pCtrl->cx;
 	rt.bottom = rt.top + pCtrl->cy;
 
+	text = GetCtrlText(&curDlg, ctrlNum);
+
 	SetBkMode(hDC, TRANSPARENT);
 	/* Drawn controls are grouped by drawing style */
 	switch (pCtrl->rendClass)
 	{
 	case 0: /* Custom controls */
-		DrawCustomCtrl(hDC, &rt, pCtrl->wndClass);
+		DrawCustomCtrl(hDC, &rt, GetCtrlClass(&curDlg, ctrlNum));
 		break;
 	case 1: /* Check boxes */
-		DrawCRControl(hDC, &rt, pCtrl->text, DFCS_BUTTONCHECK);
+		DrawCRControl(hDC, &rt, text, DFCS_BUTTONCHECK);
 		break;
 	case 2: /* Radio buttons */
-		DrawCRControl(hDC, &rt, pCtrl->text, DFCS_BUTTONRADIO);
+		DrawCRControl(hDC, &rt, text, DFCS_BUTTONRADIO);
 		break;
 	case 3: /* Client boxes */
 		if (pCtrl->rendType == 3) /* ICON */
@@ -602,7 +596,7 @@ void DrawDlgItemDispatch(HDC hDC, unsigned ctrlNum)
 			align = DT_RIGHT | DT_WORDBREAK;
 		if (pCtrl->rendType == 4)
 			align = DT_CENTER | DT_VCENTER | DT_SINGLELINE;
-		DrawDlgText(hDC, &rt, pCtrl->text, align);
+		DrawDlgText(hDC, &rt, text, align);
 		break;
 	}
 	case 5: /* Push buttons */
@@ -611,26 +605,22 @@ void DrawDlgItemDispatch(HDC hDC, unsigned ctrlNum)
 		if (pCtrl->rendType == 0)
 			defBtn = TRUE;
 		else defBtn = FALSE;
-		DrawButton(hDC, &rt, pCtrl->text, defBtn);
+		DrawButton(hDC, &rt, text, defBtn);
 		break;
 	}
 	case 6: /* Group box */
-		if (pCtrl->style == NULL)
-			break;
-		if (strlen(pCtrl->style) == 0 ||
-			strstr("BS_LEFT", pCtrl->style) != NULL)
-			DrawGroupBox(hDC, &rt, pCtrl->text, DT_LEFT);
-		else if (strstr("BS_CENTER", pCtrl->style) != NULL)
-			DrawGroupBox(hDC, &rt, pCtrl->text, DT_CENTER);
-		else if (strstr("BS_RIGHT", pCtrl->style) != NULL)
-			DrawGroupBox(hDC, &rt, pCtrl->text, DT_RIGHT);
+		/* BS_CENTER is BS_LEFT | BS_RIGHT */
+		if ((pCtrl->style & BS_CENTER) == BS_CENTER)
+			DrawGroupBox(hDC, &rt, text, DT_CENTER);
+		else if ((pCtrl->style & BS_CENTER) == BS_RIGHT)
+			DrawGroupBox(hDC, &rt, text, DT_RIGHT);
+		else
+			DrawGroupBox(hDC, &rt, text, DT_LEFT);
 		break;
 	case 7: /* Scroll controls */
-		if (pCtrl->style == NULL)
-			break;
-		if (strstr("SBS_VERT", pCtrl->style) != NULL)
+		if ((pCtrl->style & SBS_VERT) != 0)
 			DrawScrollbar(hDC, &rt, SB_VERT);
-		if (strstr("SBS_HORZ", pCtrl->style) != NULL)
+		else
 			DrawScrollbar(hDC, &rt, SB_HORZ);
 		break;
 	}
@@ -643,7 +633,7 @@ void DrawDlgItemDispatch(HDC hDC, unsigned ctrlNum)
 }
 
 /* Draws a check box or a radio button */
-void DrawCRControl(HDC hDC, RECT* rt, char* caption, UINT state)
+void DrawCRControl(HDC hDC, RECT* rt, const char* caption, UINT state)
 {
 	RECT scRt;
 	long smX, smY; /* Checkbox or radio button sizes */
@@ -666,7 +656,7 @@ void DrawCRControl(HDC hDC, RECT* rt, char* caption, UINT state)
 	DrawText(hDC, caption, -1, &scRt, DT_LEFT);
 }
 
-void DrawButton(HDC hDC, RECT* rt, char* caption, BOOL defBtn)
+void DrawButton(HDC hDC, RECT* rt, const char* caption, BOOL defBtn)
 {
 	RECT scRt;
 	/* Draw the button */
@@ -702,7 +692,7 @@ void DrawClientBox(HDC hDC, RECT* rt, BOOL icon)
 	DrawEdge(hDC, &scRt, BDR_SUNKENINNER | BDR_SUNKENOUTER, BF_RECT);
 }
 
-void DrawDlgText(HDC hDC, RECT* rt, char* caption, UINT align)
+void DrawDlgText(HDC hDC, RECT* rt, const char* caption, UINT align)
 {
 	RECT scRt;
 	CopyRect(&scRt, rt);
@@ -710,7 +700,7 @@ void DrawDlgText(HDC hDC, RECT* rt, char* caption, UINT align)
 	DrawText(hDC, caption, -1, &scRt, align);
 }
 
-void DrawGroupBox(HDC hDC, RECT* rt, char* caption, UINT textAlign)
+void DrawGroupBox(HDC hDC, RECT* rt, const char* caption, UINT textAlign)
 {
 	RECT scRt;
 	COLORREF oldBk;
@@ -822,7 +812,7 @@ void DrawScrollbar(HDC hDC, RECT* rt, UINT type)
 	}
 }
 
-void DrawCustomCtrl(HDC hDC, RECT* rt, char* clsName)
+void DrawCustomCtrl(HDC hDC, RECT* rt, const char* clsName)
 {
 	RECT scRt;
 	HBRUSH hBr;
@@ -844,3 +834,28 @@ void DlgUnitMap(RECT* rt)
 	rt->right = DLG2SCR_X(rt->right);
 	rt->bottom = DLG2SCR_Y(rt->bottom);
 }
+
+/* Converts a pixel offset to dialog units.  A control covers the
+   pixel exactly when it covers the returned unit, whatever the
+   rounding of MulDiv() did to the control's edges. */
+static long ScrToDlgUnits(long pix, long base, int div)
+{
+	long units;
+	units = MulDiv(pix, div, base);
+	while (MulDiv(units + 1, base, div) <= pix)
+		units++;
+	while (MulDiv(units, base, div) > pix)
+		units--;
+	return units;
+}
+
+/* The reverse of DlgUnitMap().  A control overlaps the resulting
+   rectangle in dialog units exactly when it overlaps the given
+   rectangle in pixels. */
+void ScrUnitMap(RECT* rt)
+{
+	rt->left = ScrToDlgUnits(rt->left, dlgBaseX, 4);
+	rt->top = ScrToDlgUnits(rt->top, dlgBaseY, 8);
+	rt->right = ScrToDlgUnits(rt->right - 1, dlgBaseX, 4) + 1;
+	rt->bottom = ScrToDlgUnits(rt->bottom - 1, dlgBaseY, 8) + 1;
+}
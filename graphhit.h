@@ -19,17 +19,18 @@ void UpdateFont(HDC hDC);
 void DrawSelRect(HDC hDC, RECT* rt);
 void InvalSelItem(HWND hwnd);
 void DrawDlgItemDispatch(HDC hDC, unsigned ctrlNum);
-void DrawCRControl(HDC hDC, RECT* rt, char* caption, UINT state);
-void DrawButton(HDC hDC, RECT* rt, char* caption, BOOL defBtn);
+void DrawCRControl(HDC hDC, RECT* rt, const char* caption, UINT state);
+void DrawButton(HDC hDC, RECT* rt, const char* caption, BOOL defBtn);
 void DrawClientBox(HDC hDC, RECT* rt, BOOL icon);
-void DrawDlgText(HDC hDC, RECT* rt, char* caption, UINT align);
-void DrawGroupBox(HDC hDC, RECT* rt, char* caption, UINT textAlign);
+void DrawDlgText(HDC hDC, RECT* rt, const char* caption, UINT align);
+void DrawGroupBox(HDC hDC, RECT* rt, const char* caption, UINT textAlign);
 void DrawScrollbar(HDC hDC, RECT* rt, UINT type);
-void DrawCustomCtrl(HDC hDC, RECT* rt, char* clsName);
+void DrawCustomCtrl(HDC hDC, RECT* rt, const char* clsName);
 
 /* This is so that we do not need to create a pseudo dialog box for
    MapDialogRect() */
 void DlgUnitMap(RECT* rt);
+void ScrUnitMap(RECT* rt);
 
 extern HFONT dlgFont;
 extern long fontHeight;
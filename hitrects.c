@@ -0,0 +1,233 @@
+/* Rectangle sets for hit-testing.
+
+   This is platform independent code.  The hit-testing kernel compares
+   a point against a vector of rectangles at a time: 16 with AVX-512,
+   8 with AVX2, and 4 with SSE2, whichever the compiler targets.  The
+   vectors are scanned from the end of the arrays, so the first vector
+   that contains a hit also contains the topmost hit and the scan can
+   stop there.  Define HITRECTS_NO_SIMD to use only the scalar code. */
+
+#include <string.h>
+
+#include "xmalloc.h"
+#include "hitrects.h"
+
+#ifndef HITRECTS_NO_SIMD
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#define HIT_VEC_SIZE 16
+typedef __m512i HitVec;
+#define HIT_VEC_LOAD(p) _mm512_loadu_si512((const void*)(p))
+#define HIT_VEC_SPLAT(v) _mm512_set1_epi32(v)
+#define HIT_KERNEL_NAME "avx512"
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define HIT_VEC_SIZE 8
+typedef __m256i HitVec;
+#define HIT_VEC_LOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define HIT_VEC_SPLAT(v) _mm256_set1_epi32(v)
+#define HIT_KERNEL_NAME "avx2"
+#elif defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HIT_VEC_SIZE 4
+typedef __m128i HitVec;
+#define HIT_VEC_LOAD(p) _mm_loadu_si128((const __m128i*)(p))
+#define HIT_VEC_SPLAT(v) _mm_set1_epi32(v)
+#define HIT_KERNEL_NAME "sse2"
+#endif
+#endif /* not HITRECTS_NO_SIMD */
+
+#ifndef HIT_KERNEL_NAME
+#define HIT_KERNEL_NAME "scalar"
+#endif
+
+#ifdef HIT_VEC_SIZE
+static unsigned InRectMask(const HitRects* hr, unsigned i,
+						   HitVec px, HitVec py);
+static unsigned HighestBit(unsigned x);
+#endif /* HIT_VEC_SIZE */
+static void GrowHitRects(HitRects* hr);
+
+#ifdef HIT_VEC_SIZE
+/* Returns a mask with bit j set if the point is in rectangle i + j */
+static unsigned InRectMask(const HitRects* hr, unsigned i,
+						   HitVec px, HitVec py)
+{
+	HitVec left, top, right, bottom;
+	left = HIT_VEC_LOAD(hr->left + i);
+	top = HIT_VEC_LOAD(hr->top + i);
+	right = HIT_VEC_LOAD(hr->right + i);
+	bottom = HIT_VEC_LOAD(hr->bottom + i);
+#if HIT_VEC_SIZE == 16
+	return (unsigned)(_mm512_cmpge_epi32_mask(px, left) &
+					  _mm512_cmplt_epi32_mask(px, right) &
+					  _mm512_cmpge_epi32_mask(py, top) &
+					  _mm512_cmplt_epi32_mask(py, bottom));
+#elif HIT_VEC_SIZE == 8
+	{
+		__m256i inX, inY;
+		/* x >= left is the same as !(left > x) */
+		inX = _mm256_andnot_si256(_mm256_cmpgt_epi32(left, px),
+								  _mm256_cmpgt_epi32(right, px));
+		inY = _mm256_andnot_si256(_mm256_cmpgt_epi32(top, py),
+								  _mm256_cmpgt_epi32(bottom, py));
+		return (unsigned)_mm256_movemask_ps(
+			_mm256_castsi256_ps(_mm256_and_si256(inX, inY)));
+	}
+#else
+	{
+		__m128i inX, inY;
+		inX = _mm_andnot_si128(_mm_cmpgt_epi32(left, px),
+							   _mm_cmpgt_epi32(right, px));
+		inY = _mm_andnot_si128(_mm_cmpgt_epi32(top, py),
+							   _mm_cmpgt_epi32(bottom, py));
+		return (unsigned)_mm_movemask_ps(
+			_mm_castsi128_ps(_mm_and_si128(inX, inY)));
+	}
+#endif
+}
+
+/* "x" must not be zero */
+static unsigned HighestBit(unsigned x)
+{
+#ifdef __GNUC__
+	return 31 - __builtin_clz(x);
+#else
+	unsigned i;
+	for (i = 0; x > 1; i++)
+		x >>= 1;
+	return i;
+#endif
+}
+#endif /* HIT_VEC_SIZE */
+
+/* Returns the name of the kernel that was compiled in. */
+const char* HitRectsKernelName()
+{
+	return HIT_KERNEL_NAME;
+}
+
+void InitHitRects(HitRects* hr)
+{
+	hr->left = NULL;
+	hr->top = NULL;
+	hr->right = NULL;
+	hr->bottom = NULL;
+	hr->ids = NULL;
+	hr->len = 0;
+	hr->cap = 0;
+}
+
+/* Grows the arrays so that they can hold at least one more
+   rectangle */
+static void GrowHitRects(HitRects* hr)
+{
+	unsigned newCap;
+	int* block;
+	unsigned i;
+	newCap = (hr->cap == 0) ? HIT_BLOCK : hr->cap * 2;
+	/* All five arrays share one allocation */
+	block = (int*)xmalloc(sizeof(int) * 5 * newCap);
+	if (hr->len > 0)
+	{
+		memcpy(block, hr->left, sizeof(int) * hr->len);
+		memcpy(block + newCap, hr->top, sizeof(int) * hr->len);
+		memcpy(block + newCap * 2, hr->right, sizeof(int) * hr->len);
+		memcpy(block + newCap * 3, hr->bottom, sizeof(int) * hr->len);
+		memcpy(block + newCap * 4, hr->ids, sizeof(unsigned) * hr->len);
+	}
+	xfree(hr->left);
+	hr->left = block;
+	hr->top = block + newCap;
+	hr->right = block + newCap * 2;
+	hr->bottom = block + newCap * 3;
+	hr->ids = (unsigned*)(block + newCap * 4);
+	hr->cap = newCap;
+	/* Empty out everything past the end */
+	for (i = hr->len; i < newCap; i++)
+		SetHitRect(hr, i, 0, 0, 0, 0);
+}
+
+/* Inserts a rectangle before position "pos".  The rectangles at and
+   after "pos" move up by one. */
+void InsertHitRect(HitRects* hr, unsigned pos, unsigned id,
+				   int left, int top, int right, int bottom)
+{
+	unsigned num;
+	if (hr->len >= hr->cap)
+		GrowHitRects(hr);
+	num = hr->len - pos;
+	memmove(hr->left + pos + 1, hr->left + pos, sizeof(int) * num);
+	memmove(hr->top + pos + 1, hr->top + pos, sizeof(int) * num);
+	memmove(hr->right + pos + 1, hr->right + pos, sizeof(int) * num);
+	memmove(hr->bottom + pos + 1, hr->bottom + pos, sizeof(int) * num);
+	memmove(hr->ids + pos + 1, hr->ids + pos, sizeof(unsigned) * num);
+	hr->ids[pos] = id;
+	SetHitRect(hr, pos, left, top, right, bottom);
+	hr->len++;
+}
+
+void SetHitRect(HitRects* hr, unsigned pos,
+				int left, int top, int right, int bottom)
+{
+	hr->left[pos] = left;
+	hr->top[pos] = top;
+	hr->right[pos] = right;
+	hr->bottom[pos] = bottom;
+}
+
+/* Removes the rectangle at position "pos".  The rectangles after it
+   move down by one. */
+void RemoveHitRect(HitRects* hr, unsigned pos)
+{
+	unsigned num;
+	num = hr->len - (pos + 1);
+	memmove(hr->left + pos, hr->left + pos + 1, sizeof(int) * num);
+	memmove(hr->top + pos, hr->top + pos + 1, sizeof(int) * num);
+	memmove(hr->right + pos, hr->right + pos + 1, sizeof(int) * num);
+	memmove(hr->bottom + pos, hr->bottom + pos + 1, sizeof(int) * num);
+	memmove(hr->ids + pos, hr->ids + pos + 1, sizeof(unsigned) * num);
+	hr->len--;
+	SetHitRect(hr, hr->len, 0, 0, 0, 0);
+}
+
+/* Returns the position of the last rectangle in the set that
+   contains the point, or -1 if no rectangle contains it.  If the
+   rectangles are kept in painting order, that is the topmost one. */
+int HitTestRects(const HitRects* hr, int x, int y)
+{
+	unsigned i;
+#ifdef HIT_VEC_SIZE
+	HitVec px, py;
+	px = HIT_VEC_SPLAT(x);
+	py = HIT_VEC_SPLAT(y);
+	/* "cap" is a multiple of the vector size, and the empty
+	   rectangles past "len" never match */
+	i = (hr->len + HIT_VEC_SIZE - 1) / HIT_VEC_SIZE * HIT_VEC_SIZE;
+	while (i > 0)
+	{
+		unsigned mask;
+		i -= HIT_VEC_SIZE;
+		mask = InRectMask(hr, i, px, py);
+		if (mask != 0)
+			return (int)(i + HighestBit(mask));
+	}
+#else
+	i = hr->len;
+	while (i > 0)
+	{
+		i--;
+		if (x >= hr->left[i] && x < hr->right[i] &&
+			y >= hr->top[i] && y < hr->bottom[i])
+			return (int)i;
+	}
+#endif
+	return -1;
+}
+
+void FreeHitRects(HitRects* hr)
+{
+	xfree(hr->left);
+	InitHitRects(hr);
+}
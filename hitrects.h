@@ -0,0 +1,40 @@
+/* Rectangle sets for hit-testing.  The edges of the rectangles are
+   kept in parallel arrays so that a point can be tested against a
+   whole vector of rectangles at a time. */
+
+#ifndef HITRECTS_H
+#define HITRECTS_H
+
+/* The arrays are allocated in multiples of this many rectangles, which
+   is at least the widest vector that the kernels use */
+#define HIT_BLOCK 16
+
+/* A point (x, y) is in rectangle i if left[i] <= x < right[i] and
+   top[i] <= y < bottom[i], the same as PtInRect().  "ids" holds the
+   caller's identifier for each rectangle.  Rectangles from "len" up
+   to "cap" are empty, so the kernels never need to handle a partial
+   vector.  An all-zero set is a valid empty set. */
+struct HitRects_t
+{
+	int* left;
+	int* top;
+	int* right;
+	int* bottom;
+	unsigned* ids;
+	unsigned len;
+	unsigned cap; /* Multiple of HIT_BLOCK */
+};
+
+typedef struct HitRects_t HitRects;
+
+void InitHitRects(HitRects* hr);
+void InsertHitRect(HitRects* hr, unsigned pos, unsigned id,
+				   int left, int top, int right, int bottom);
+void SetHitRect(HitRects* hr, unsigned pos,
+				int left, int top, int right, int bottom);
+void RemoveHitRect(HitRects* hr, unsigned pos);
+int HitTestRects(const HitRects* hr, int x, int y);
+void FreeHitRects(HitRects* hr);
+const char* HitRectsKernelName();
+
+#endif /* not HITRECTS_H */
@@ -0,0 +1,198 @@
+/* Generates styletab.h, the perfect hash table of the window style
+   constants in styletab.def.  The table is written to standard
+   output.
+
+   This is a build tool that runs on the build machine, so it does not
+   use the rest of the library.
+
+   The hash is "hash and displace".  Each name is hashed once, and two
+   bit fields of the hash give the name's home slot and its bucket.
+   Every bucket has a displacement that is added to the home slots of
+   its names, and the displacements are chosen, largest bucket first,
+   so that no two names land in the same slot.  The multiplier of the
+   hash is found by searching the odd numbers for the first one that
+   allows such displacements. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STYLE_CONST(name, value) #name,
+static const char* names[] =
+{
+#include "styletab.def"
+};
+#undef STYLE_CONST
+
+#define NUM_NAMES (sizeof(names) / sizeof(names[0]))
+
+/* These must stay in step with the macros that are written out */
+#define TABLE_SIZE 512
+#define NUM_BUCKETS 128
+#define HASH_SLOT(h) (((h) >> 8) & (TABLE_SIZE - 1))
+#define HASH_BUCKET(h) (((h) >> 20) & (NUM_BUCKETS - 1))
+
+static unsigned long hashes[NUM_NAMES];
+static unsigned short table[TABLE_SIZE];
+static unsigned short disp[NUM_BUCKETS];
+
+static unsigned long HashName(const char* name, unsigned long mult)
+{
+	unsigned long h;
+	h = 0;
+	for (; *name != '\0'; name++)
+		h = (h * mult + (unsigned char)*name) & 0xffffffffUL;
+	return h;
+}
+
+/* Tries to place every name with the given multiplier.  Returns
+   nonzero on success, with "table" and "disp" filled in. */
+static int PlaceNames(unsigned long mult)
+{
+	unsigned bucketSize[NUM_BUCKETS];
+	unsigned order[NUM_BUCKETS];
+	unsigned i, j, k;
+
+	memset(table, 0, sizeof(table));
+	memset(disp, 0, sizeof(disp));
+	memset(bucketSize, 0, sizeof(bucketSize));
+	for (i = 0; i < NUM_NAMES; i++)
+	{
+		hashes[i] = HashName(names[i], mult);
+		bucketSize[HASH_BUCKET(hashes[i])]++;
+	}
+
+	/* Sort the buckets by size, largest first */
+	for (i = 0; i < NUM_BUCKETS; i++)
+		order[i] = i;
+	for (i = 1; i < NUM_BUCKETS; i++)
+	{
+		unsigned cur;
+		cur = order[i];
+		for (j = i; j > 0 && bucketSize[order[j-1]] < bucketSize[cur]; j--)
+			order[j] = order[j-1];
+		order[j] = cur;
+	}
+
+	for (i = 0; i < NUM_BUCKETS && bucketSize[order[i]] > 0; i++)
+	{
+		unsigned bucket;
+		unsigned d;
+		bucket = order[i];
+		for (d = 0; d < TABLE_SIZE; d++)
+		{
+			/* Check that the slots are free, marking them as we go so
+			   that names in the same bucket do not collide */
+			for (j = 0; j < NUM_NAMES; j++)
+			{
+				unsigned slot;
+				if (HASH_BUCKET(hashes[j]) != bucket)
+					continue;
+				slot = (HASH_SLOT(hashes[j]) + d) & (TABLE_SIZE - 1);
+				if (table[slot] != 0)
+					break;
+				table[slot] = (unsigned short)(j + 1);
+			}
+			if (j == NUM_NAMES)
+				break;
+			/* Undo the marks of this attempt */
+			for (k = 0; k < j; k++)
+			{
+				unsigned slot;
+				if (HASH_BUCKET(hashes[k]) != bucket)
+					continue;
+				slot = (HASH_SLOT(hashes[k]) + d) & (TABLE_SIZE - 1);
+				table[slot] = 0;
+			}
+		}
+		if (d == TABLE_SIZE)
+			return 0;
+		disp[bucket] = (unsigned short)d;
+	}
+	return 1;
+}
+
+/* Prints the body of a table initializer, 12 numbers per line */
+static void PrintTable(const unsigned short* values, unsigned num)
+{
+	unsigned i;
+	for (i = 0; i < num; i++)
+	{
+		if (i > 0)
+			putchar(',');
+		if (i % 12 == 0)
+			printf("\n\t");
+		else
+			putchar(' ');
+		printf("%3u", values[i]);
+	}
+	printf("};\n");
+}
+
+int main(void)
+{
+	unsigned long mult;
+	unsigned maxLen;
+	unsigned i, j;
+
+	/* The table holds the indexes in bytes */
+	if (NUM_NAMES > 255)
+	{
+		fputs("mkstyletab: too many style constants\n", stderr);
+		return 1;
+	}
+	/* Duplicate names would make the table ambiguous */
+	maxLen = 0;
+	for (i = 0; i < NUM_NAMES; i++)
+	{
+		if (strlen(names[i]) > maxLen)
+			maxLen = strlen(names[i]);
+		for (j = 0; j < i; j++)
+		{
+			if (strcmp(names[i], names[j]) == 0)
+			{
+				fprintf(stderr, "mkstyletab: %s is listed twice\n",
+						names[i]);
+				return 1;
+			}
+		}
+	}
+
+	for (mult = 3; mult < 0x100000; mult += 2)
+	{
+		if (PlaceNames(mult))
+			break;
+	}
+	if (mult >= 0x100000)
+	{
+		fputs("mkstyletab: no perfect hash was found\n", stderr);
+		return 1;
+	}
+
+	printf("/* Perfect hash table of the window style constants.\n"
+		   "   Generated by mkstyletab from styletab.def.  Do not edit. */\n"
+		   "\n");
+	printf("#define NUM_STYLE_CONSTS %u\n", (unsigned)NUM_NAMES);
+	printf("#define MAX_STYLE_CONST_LEN %u\n", maxLen);
+	printf("#define STYLE_HASH_MULT %lu\n", mult);
+	printf("#define STYLE_TABLE_SIZE %u\n", TABLE_SIZE);
+	printf("#define STYLE_NUM_BUCKETS %u\n", NUM_BUCKETS);
+	printf("#define STYLE_HASH_SLOT(h) "
+		   "(((h) >> 8) & (STYLE_TABLE_SIZE - 1))\n");
+	printf("#define STYLE_HASH_BUCKET(h) "
+		   "(((h) >> 20) & (STYLE_NUM_BUCKETS - 1))\n");
+
+	printf("\n/* Displacement of each bucket */\n");
+	printf("static const unsigned short "
+		   "styleHashDisp[STYLE_NUM_BUCKETS] = {");
+	PrintTable(disp, NUM_BUCKETS);
+
+	printf("\n/* Index of the constant in each slot, counting from one, "
+		   "with zero\n   for unused slots */\n");
+	printf("static const unsigned char "
+		   "styleHashTable[STYLE_TABLE_SIZE] = {");
+	PrintTable(table, TABLE_SIZE);
+	if (fflush(stdout) != 0 || ferror(stdout))
+		return 1;
+	return 0;
+}
@@ -0,0 +1,277 @@
+/* Line ending conversion kernels.
+
+   This is platform independent code.  Each kernel scans the input a
+   vector at a time and copies vectors that do not contain the
+   character that it is looking for straight to the output.  Only
+   vectors that contain line endings are handled one byte at a time.
+   Define NLCONV_NO_SIMD to use only the scalar code. */
+
+#include <string.h>
+
+#include "nlconv.h"
+
+#ifndef NLCONV_NO_SIMD
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define NL_VEC_SIZE 32
+typedef __m256i NlVec;
+#define NL_VEC_LOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define NL_VEC_STORE(p, v) _mm256_storeu_si256((__m256i*)(p), (v))
+#define NL_VEC_SPLAT(c) _mm256_set1_epi8(c)
+#define NL_VEC_EQ_MASK(v, s) \
+	((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8((v), (s))))
+#define NL_KERNEL_NAME "avx2"
+#elif defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NL_VEC_SIZE 16
+typedef __m128i NlVec;
+#define NL_VEC_LOAD(p) _mm_loadu_si128((const __m128i*)(p))
+#define NL_VEC_STORE(p, v) _mm_storeu_si128((__m128i*)(p), (v))
+#define NL_VEC_SPLAT(c) _mm_set1_epi8(c)
+#define NL_VEC_EQ_MASK(v, s) \
+	((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8((v), (s))))
+#define NL_KERNEL_NAME "sse2"
+#endif
+#endif /* not NLCONV_NO_SIMD */
+
+#ifndef NL_KERNEL_NAME
+#define NL_KERNEL_NAME "scalar"
+#endif
+
+#ifdef NL_VEC_SIZE
+static unsigned PopCount(unsigned x);
+static unsigned LowestBit(unsigned x);
+
+static unsigned PopCount(unsigned x)
+{
+#ifdef __GNUC__
+	return __builtin_popcount(x);
+#else
+	x = x - ((x >> 1) & 0x55555555);
+	x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+	x = (x + (x >> 4)) & 0x0f0f0f0f;
+	return (x * 0x01010101) >> 24;
+#endif
+}
+
+/* "x" must not be zero */
+static unsigned LowestBit(unsigned x)
+{
+#ifdef __GNUC__
+	return __builtin_ctz(x);
+#else
+	unsigned i;
+	for (i = 0; (x & 1) == 0; i++)
+		x >>= 1;
+	return i;
+#endif
+}
+#endif /* NL_VEC_SIZE */
+
+/* Returns the name of the kernel set that was compiled in. */
+const char* NlConvKernelName()
+{
+	return NL_KERNEL_NAME;
+}
+
+/* Returns the style of the first line ending in the text, or
+   NL_UNKNOWN if there are no line endings. */
+int DetectNlStyle(const char* src, unsigned srcLen)
+{
+	unsigned i;
+	i = 0;
+#ifdef NL_VEC_SIZE
+	{
+		NlVec lfVec, crVec;
+		lfVec = NL_VEC_SPLAT('\n');
+		crVec = NL_VEC_SPLAT('\r');
+		for (; i + NL_VEC_SIZE <= srcLen; i += NL_VEC_SIZE)
+		{
+			NlVec v;
+			unsigned mask;
+			v = NL_VEC_LOAD(&src[i]);
+			mask = NL_VEC_EQ_MASK(v, lfVec) | NL_VEC_EQ_MASK(v, crVec);
+			if (mask != 0)
+			{
+				i += LowestBit(mask);
+				break;
+			}
+		}
+	}
+#endif
+	for (; i < srcLen; i++)
+	{
+		if (src[i] == '\n')
+			return NL_LF;
+		if (src[i] == '\r')
+		{
+			if (i + 1 < srcLen && src[i+1] == '\n')
+				return NL_CRLF;
+			return NL_CR;
+		}
+	}
+	return NL_UNKNOWN;
+}
+
+/* Returns the number of times that the character "nlChar" occurs in
+   the text.  With '\n', or '\r' for NL_CR text, this counts the
+   lines. */
+unsigned CountNlChars(const char* src, unsigned srcLen, char nlChar)
+{
+	unsigned numNl;
+	unsigned i;
+	numNl = 0;
+	i = 0;
+#ifdef NL_VEC_SIZE
+	{
+		NlVec nlVec;
+		nlVec = NL_VEC_SPLAT(nlChar);
+		for (; i + NL_VEC_SIZE <= srcLen; i += NL_VEC_SIZE)
+			numNl += PopCount(NL_VEC_EQ_MASK(NL_VEC_LOAD(&src[i]), nlVec));
+	}
+#endif
+	for (; i < srcLen; i++)
+	{
+		if (src[i] == nlChar)
+			numNl++;
+	}
+	return numNl;
+}
+
+/* Returns the exact size of the output of ConvLfToCrlf(). */
+unsigned CountLfToCrlf(const char* src, unsigned srcLen)
+{
+	return srcLen + CountNlChars(src, srcLen, '\n');
+}
+
+/* Writes the text with every LF replaced by CR+LF.  "dest" must have
+   room for CountLfToCrlf() characters and must not overlap "src".  No
+   null character is written.  Returns the output size. */
+unsigned ConvLfToCrlf(char* dest, const char* src, unsigned srcLen)
+{
+	unsigned i, j;
+	i = 0;
+	j = 0;
+#ifdef NL_VEC_SIZE
+	{
+		NlVec lfVec;
+		lfVec = NL_VEC_SPLAT('\n');
+		for (; i + NL_VEC_SIZE <= srcLen; i += NL_VEC_SIZE)
+		{
+			NlVec v;
+			unsigned mask;
+			v = NL_VEC_LOAD(&src[i]);
+			mask = NL_VEC_EQ_MASK(v, lfVec);
+			if (mask == 0)
+			{
+				NL_VEC_STORE(&dest[j], v);
+				j += NL_VEC_SIZE;
+			}
+			else
+			{
+				/* Copy the runs between the line feeds */
+				unsigned runStart, lfPos;
+				runStart = 0;
+				do
+				{
+					lfPos = LowestBit(mask);
+					memcpy(&dest[j], &src[i+runStart], lfPos - runStart);
+					j += lfPos - runStart;
+					dest[j++] = '\r';
+					dest[j++] = '\n';
+					runStart = lfPos + 1;
+					mask &= mask - 1;
+				} while (mask != 0);
+				memcpy(&dest[j], &src[i+runStart], NL_VEC_SIZE - runStart);
+				j += NL_VEC_SIZE - runStart;
+			}
+		}
+	}
+#endif
+	for (; i < srcLen; i++)
+	{
+		if (src[i] == '\n')
+			dest[j++] = '\r';
+		dest[j++] = src[i];
+	}
+	return j;
+}
+
+/* Writes the text with CR+LF and lone CR line endings replaced by LF.
+   The output is never longer than the input, and "dest" may be the
+   same as "src" to convert in place.  No null character is written.
+   Returns the output size. */
+unsigned ConvCrlfToLf(char* dest, const char* src, unsigned srcLen)
+{
+	unsigned i, j;
+	i = 0;
+	j = 0;
+#ifdef NL_VEC_SIZE
+	{
+		NlVec crVec;
+		crVec = NL_VEC_SPLAT('\r');
+		for (; i + NL_VEC_SIZE <= srcLen; i += NL_VEC_SIZE)
+		{
+			NlVec v;
+			unsigned mask;
+			v = NL_VEC_LOAD(&src[i]);
+			mask = NL_VEC_EQ_MASK(v, crVec);
+			if (mask == 0)
+			{
+				/* Stores never reach past the bytes already read */
+				NL_VEC_STORE(&dest[j], v);
+				j += NL_VEC_SIZE;
+			}
+			else
+			{
+				unsigned k;
+				for (k = i; k < i + NL_VEC_SIZE; k++)
+				{
+					if (src[k] != '\r')
+						dest[j++] = src[k];
+					else if (k + 1 >= srcLen || src[k+1] != '\n')
+						dest[j++] = '\n';
+					/* Otherwise, drop the CR of CR+LF */
+				}
+			}
+		}
+	}
+#endif
+	for (; i < srcLen; i++)
+	{
+		if (src[i] != '\r')
+			dest[j++] = src[i];
+		else if (i + 1 >= srcLen || src[i+1] != '\n')
+			dest[j++] = '\n';
+	}
+	return j;
+}
+
+/* Replaces every LF with CR in place. */
+void ConvLfToCr(char* buffer, unsigned dataSize)
+{
+	unsigned i;
+	i = 0;
+#ifdef NL_VEC_SIZE
+	{
+		NlVec lfVec;
+		lfVec = NL_VEC_SPLAT('\n');
+		for (; i + NL_VEC_SIZE <= dataSize; i += NL_VEC_SIZE)
+		{
+			unsigned mask;
+			mask = NL_VEC_EQ_MASK(NL_VEC_LOAD(&buffer[i]), lfVec);
+			while (mask != 0)
+			{
+				buffer[i+LowestBit(mask)] = '\r';
+				mask &= mask - 1;
+			}
+		}
+	}
+#endif
+	for (; i < dataSize; i++)
+	{
+		if (buffer[i] == '\n')
+			buffer[i] = '\r';
+	}
+}
@@ -0,0 +1,29 @@
+/* Line ending conversion kernels.  These work on buffers of any size
+   and use SSE2 or AVX2 vector instructions when the compiler targets
+   them, with a scalar fallback otherwise. */
+
+#ifndef NLCONV_H
+#define NLCONV_H
+
+/* Line ending styles.  NL_UNKNOWN means that the text had no line
+   endings; it is saved in the native style of the platform. */
+#define NL_UNKNOWN 0
+#define NL_LF 1
+#define NL_CRLF 2
+#define NL_CR 3
+
+#ifdef _WIN32
+#define NL_NATIVE NL_CRLF
+#else
+#define NL_NATIVE NL_LF
+#endif
+
+int DetectNlStyle(const char* src, unsigned srcLen);
+unsigned CountNlChars(const char* src, unsigned srcLen, char nlChar);
+unsigned CountLfToCrlf(const char* src, unsigned srcLen);
+unsigned ConvLfToCrlf(char* dest, const char* src, unsigned srcLen);
+unsigned ConvCrlfToLf(char* dest, const char* src, unsigned srcLen);
+void ConvLfToCr(char* buffer, unsigned dataSize);
+const char* NlConvKernelName();
+
+#endif /* not NLCONV_H */
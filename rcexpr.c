@@ -0,0 +1,561 @@
+/* Integer and constant expression parsing for resource scripts.
+
+   This is platform independent code.  The evaluator is a recursive
+   descent parser that works on the source bytes, with the operators
+   and precedence of C:
+
+	   expr    = add { "|" add }
+	   add     = mul { ("+" | "-") mul }
+	   mul     = unary { ("*" | "/") unary }
+	   unary   = ("-" | "+" | "~") unary | primary
+	   primary = number | symbol | "(" expr ")"
+
+   Preprocessor conditions (EvalPpExpr()) add the logical and
+   comparison operators, "!", and "defined", and read symbols that are
+   not defined as zero, as the C preprocessor does:
+
+	   cond    = and { "||" and }
+	   and     = cmp { "&&" cmp }
+	   cmp     = expr { ("==" | "!=" | "<" | ">" | "<=" | ">=") expr }
+	   unary   = ("-" | "+" | "~" | "!") unary | "defined" name |
+				 "defined" "(" name ")" | primary
+
+   Arithmetic is checked against the range of a signed 32-bit value,
+   without needing a wider type, so it works the same wherever "long"
+   has more than 32 bits.  The bitwise operators work on the 32-bit
+   pattern of the value. */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "rcexpr.h"
+#include "tmpllex.h"
+
+#define INT32_MAX_L 0x7fffffffL
+#define INT32_MIN_L (-0x7fffffffL - 1)
+
+/* Parentheses may not be nested deeper than this, which bounds the
+   recursion */
+#define MAX_EXPR_DEPTH 64
+
+struct ExprState_t
+{
+	const char* src;
+	unsigned len;
+	unsigned pos;
+	ExprSymbolFunc lookup;
+	void* param;
+	int error; /* First error, or EXPR_OK */
+	unsigned errPos;
+	unsigned depth;
+	BOOL ppMode; /* Reading a preprocessor condition */
+	ExprDefinedFunc isDefined;
+};
+
+typedef struct ExprState_t ExprState;
+
+static long EvalOr(ExprState* st);
+static long EvalLogOr(ExprState* st);
+
+/* Returns the signed value of a 32-bit pattern */
+static long Int32FromBits(unsigned long bits)
+{
+	bits &= 0xffffffffUL;
+	if (bits & 0x80000000UL)
+		return -(long)(~bits & 0x7fffffffUL) - 1;
+	return (long)bits;
+}
+
+/* Reads a decimal or hexadecimal integer at the start of "src".  The
+   number may have "L" and "U" suffixes, as in C.  Values up to
+   0xFFFFFFFF are accepted, and the ones above 0x7FFFFFFF are taken as
+   the 32-bit pattern of a negative value.  "pUsed" receives the
+   number of characters read.
+
+   Returns EXPR_SYNTAX if "src" does not start with a number or if
+   letters follow the number, and EXPR_OVERFLOW if it does not fit in
+   32 bits. */
+int ParseIntText(const char* src, unsigned len, unsigned* pUsed,
+				 long* pValue)
+{
+	unsigned long value;
+	unsigned long maxDiv;
+	unsigned base;
+	unsigned i, digitStart;
+	int result;
+	i = 0;
+	base = 10;
+	if (len > 2 && src[0] == '0' && (src[1] == 'x' || src[1] == 'X'))
+	{
+		base = 16;
+		i = 2;
+	}
+	digitStart = i;
+	value = 0;
+	maxDiv = 0xffffffffUL / base;
+	result = EXPR_OK;
+	for (; i < len; i++)
+	{
+		unsigned digit;
+		char c;
+		c = src[i];
+		if (c >= '0' && c <= '9')
+			digit = c - '0';
+		else if (base == 16 && c >= 'a' && c <= 'f')
+			digit = c - 'a' + 10;
+		else if (base == 16 && c >= 'A' && c <= 'F')
+			digit = c - 'A' + 10;
+		else
+			break;
+		if (value > maxDiv || value * base > 0xffffffffUL - digit)
+			result = EXPR_OVERFLOW;
+		value = (value * base + digit) & 0xffffffffUL;
+	}
+	if (i == digitStart)
+		result = EXPR_SYNTAX;
+	/* Only suffixes may follow the digits */
+	for (; i < len && (CHAR_CLASS(src[i]) & CC_IDCHAR); i++)
+	{
+		if (src[i] != 'L' && src[i] != 'l' && src[i] != 'U' && src[i] != 'u')
+			result = EXPR_SYNTAX;
+	}
+	*pUsed = i;
+	*pValue = Int32FromBits(value);
+	return result;
+}
+
+/* Records the first error of an evaluation */
+static void SetExprError(ExprState* st, int error)
+{
+	if (st->error == EXPR_OK)
+	{
+		st->error = error;
+		st->errPos = st->pos;
+	}
+}
+
+/* Skips whitespace, including line breaks, since arguments may be
+   split over several lines.  Comments and the backslashes that
+   continue preprocessor lines are skipped too. */
+static void SkipExprSpace(ExprState* st)
+{
+	const char* src;
+	src = st->src;
+	while (st->pos < st->len)
+	{
+		if (CHAR_CLASS(src[st->pos]) & (CC_SPACE | CC_NL))
+			st->pos++;
+		else if (src[st->pos] == '\\' && st->pos + 1 < st->len &&
+				 CHAR_CLASS(src[st->pos+1]) == CC_NL)
+			st->pos++;
+		else if (src[st->pos] == '/' && st->pos + 1 < st->len &&
+				 src[st->pos+1] == '*')
+		{
+			for (st->pos += 2; st->pos < st->len &&
+					 !(src[st->pos] == '*' && st->pos + 1 < st->len &&
+					   src[st->pos+1] == '/'); st->pos++);
+			st->pos = (st->pos < st->len) ? st->pos + 2 : st->len;
+		}
+		else if (src[st->pos] == '/' && st->pos + 1 < st->len &&
+				 src[st->pos+1] == '/')
+		{
+			while (st->pos < st->len &&
+				   CHAR_CLASS(src[st->pos]) != CC_NL)
+				st->pos++;
+		}
+		else
+			break;
+	}
+}
+
+/* Returns the next character without reading it, or zero at the
+   end */
+static char PeekExprChar(ExprState* st)
+{
+	SkipExprSpace(st);
+	if (st->pos >= st->len)
+		return '\0';
+	return st->src[st->pos];
+}
+
+/* Returns TRUE if the next characters are the two character operator
+   "op", without reading them */
+static BOOL PeekExprOp(ExprState* st, const char* op)
+{
+	return (BOOL)(PeekExprChar(st) == op[0] && st->pos + 1 < st->len &&
+				  st->src[st->pos+1] == op[1]);
+}
+
+/* Reads "name" or "(name)" after "defined" */
+static long EvalDefined(ExprState* st)
+{
+	unsigned start;
+	BOOL paren;
+	paren = (BOOL)(PeekExprChar(st) == '(');
+	if (paren)
+	{
+		st->pos++;
+		PeekExprChar(st);
+	}
+	start = st->pos;
+	if (start >= st->len || CHAR_CLASS(st->src[start]) != CC_ALPHA)
+	{
+		SetExprError(st, EXPR_SYNTAX);
+		return 0;
+	}
+	while (st->pos < st->len && (CHAR_CLASS(st->src[st->pos]) & CC_IDCHAR))
+		st->pos++;
+	if (paren)
+	{
+		if (PeekExprChar(st) != ')')
+		{
+			SetExprError(st, EXPR_SYNTAX);
+			return 0;
+		}
+		st->pos++;
+	}
+	if (st->isDefined == NULL)
+		return 0;
+	return st->isDefined(st->param, &st->src[start], st->pos - start) ? 1 : 0;
+}
+
+static long EvalPrimary(ExprState* st)
+{
+	char c;
+	long value;
+	c = PeekExprChar(st);
+	value = 0;
+	if (c == '(')
+	{
+		st->pos++;
+		if (++st->depth > MAX_EXPR_DEPTH)
+		{
+			SetExprError(st, EXPR_TOO_DEEP);
+			return 0;
+		}
+		value = st->ppMode ? EvalLogOr(st) : EvalOr(st);
+		st->depth--;
+		if (PeekExprChar(st) != ')')
+		{
+			SetExprError(st, EXPR_SYNTAX);
+			return 0;
+		}
+		st->pos++;
+	}
+	else if (CHAR_CLASS(c) == CC_DIGIT)
+	{
+		unsigned used;
+		int result;
+		result = ParseIntText(&st->src[st->pos], st->len - st->pos,
+							  &used, &value);
+		if (result != EXPR_OK)
+			SetExprError(st, result);
+		st->pos += used;
+	}
+	else if (CHAR_CLASS(c) == CC_ALPHA)
+	{
+		unsigned start;
+		start = st->pos;
+		while (st->pos < st->len &&
+			   (CHAR_CLASS(st->src[st->pos]) & CC_IDCHAR))
+			st->pos++;
+		if (st->ppMode && st->pos - start == 7 &&
+			memcmp(&st->src[start], "defined", 7) == 0)
+			return EvalDefined(st);
+		if (st->lookup == NULL ||
+			!st->lookup(st->param, &st->src[start], st->pos - start, &value))
+		{
+			/* The preprocessor reads unknown names as zero */
+			if (st->ppMode)
+				return 0;
+			st->pos = start;
+			SetExprError(st, EXPR_UNKNOWN_SYMBOL);
+			return 0;
+		}
+	}
+	else
+		SetExprError(st, EXPR_SYNTAX);
+	return value;
+}
+
+static long EvalUnary(ExprState* st)
+{
+	char c;
+	long value;
+	c = PeekExprChar(st);
+	if (c != '-' && c != '+' && c != '~' && !(c == '!' && st->ppMode))
+		return EvalPrimary(st);
+	st->pos++;
+	if (++st->depth > MAX_EXPR_DEPTH)
+	{
+		SetExprError(st, EXPR_TOO_DEEP);
+		return 0;
+	}
+	value = EvalUnary(st);
+	st->depth--;
+	if (c == '-')
+	{
+		if (value == INT32_MIN_L)
+		{
+			SetExprError(st, EXPR_OVERFLOW);
+			return 0;
+		}
+		value = -value;
+	}
+	else if (c == '~')
+		value = Int32FromBits(~(unsigned long)value);
+	else if (c == '!')
+		value = (value == 0);
+	return value;
+}
+
+static long EvalMul(ExprState* st)
+{
+	long value;
+	value = EvalUnary(st);
+	for (;;)
+	{
+		char c;
+		long rhs;
+		unsigned opPos;
+		BOOL overflow;
+		c = PeekExprChar(st);
+		if (c != '*' && c != '/')
+			break;
+		opPos = st->pos++;
+		rhs = EvalUnary(st);
+		if (st->error != EXPR_OK)
+			return 0;
+		if (c == '/')
+		{
+			if (rhs == 0)
+			{
+				st->pos = opPos;
+				SetExprError(st, EXPR_DIV_ZERO);
+				return 0;
+			}
+			if (value == INT32_MIN_L && rhs == -1)
+			{
+				st->pos = opPos;
+				SetExprError(st, EXPR_OVERFLOW);
+				return 0;
+			}
+			value /= rhs;
+			continue;
+		}
+		if (value > 0)
+			overflow = (rhs > 0) ? value > INT32_MAX_L / rhs :
+				rhs < INT32_MIN_L / value;
+		else if (value < 0)
+			overflow = (rhs > 0) ? value < INT32_MIN_L / rhs :
+				rhs != 0 && rhs < INT32_MAX_L / value;
+		else
+			overflow = FALSE;
+		if (overflow)
+		{
+			st->pos = opPos;
+			SetExprError(st, EXPR_OVERFLOW);
+			return 0;
+		}
+		value *= rhs;
+	}
+	return value;
+}
+
+static long EvalAdd(ExprState* st)
+{
+	long value;
+	value = EvalMul(st);
+	for (;;)
+	{
+		char c;
+		long rhs;
+		unsigned opPos;
+		c = PeekExprChar(st);
+		if (c != '+' && c != '-')
+			break;
+		opPos = st->pos++;
+		rhs = EvalMul(st);
+		if (st->error != EXPR_OK)
+			return 0;
+		if (c == '-')
+		{
+			if ((rhs < 0 && value > INT32_MAX_L + rhs) ||
+				(rhs > 0 && value < INT32_MIN_L + rhs))
+			{
+				st->pos = opPos;
+				SetExprError(st, EXPR_OVERFLOW);
+				return 0;
+			}
+			value -= rhs;
+		}
+		else
+		{
+			if ((rhs > 0 && value > INT32_MAX_L - rhs) ||
+				(rhs < 0 && value < INT32_MIN_L - rhs))
+			{
+				st->pos = opPos;
+				SetExprError(st, EXPR_OVERFLOW);
+				return 0;
+			}
+			value += rhs;
+		}
+	}
+	return value;
+}
+
+static long EvalOr(ExprState* st)
+{
+	long value;
+	value = EvalAdd(st);
+	while (PeekExprChar(st) == '|' && !PeekExprOp(st, "||"))
+	{
+		long rhs;
+		st->pos++;
+		rhs = EvalAdd(st);
+		value = Int32FromBits((unsigned long)value | (unsigned long)rhs);
+	}
+	return value;
+}
+
+static long EvalCompare(ExprState* st)
+{
+	long value;
+	value = EvalOr(st);
+	for (;;)
+	{
+		char c;
+		BOOL twoChars;
+		long rhs;
+		c = PeekExprChar(st);
+		if (c != '=' && c != '!' && c != '<' && c != '>')
+			break;
+		twoChars = (BOOL)(st->pos + 1 < st->len && st->src[st->pos+1] == '=');
+		/* "=" and "!" alone are not comparisons */
+		if ((c == '=' || c == '!') && !twoChars)
+			break;
+		st->pos += twoChars ? 2 : 1;
+		rhs = EvalOr(st);
+		switch (c)
+		{
+		case '=': value = (value == rhs); break;
+		case '!': value = (value != rhs); break;
+		case '<': value = twoChars ? (value <= rhs) : (value < rhs); break;
+		case '>': value = twoChars ? (value >= rhs) : (value > rhs); break;
+		}
+	}
+	return value;
+}
+
+static long EvalLogAnd(ExprState* st)
+{
+	long value;
+	value = EvalCompare(st);
+	while (PeekExprOp(st, "&&"))
+	{
+		long rhs;
+		st->pos += 2;
+		rhs = EvalCompare(st);
+		value = (value != 0 && rhs != 0);
+	}
+	return value;
+}
+
+static long EvalLogOr(ExprState* st)
+{
+	long value;
+	value = EvalLogAnd(st);
+	while (PeekExprOp(st, "||"))
+	{
+		long rhs;
+		st->pos += 2;
+		rhs = EvalLogAnd(st);
+		value = (value != 0 || rhs != 0);
+	}
+	return value;
+}
+
+/* Evaluates the whole of "src" with the settings in "st" */
+static int EvalExprText(ExprState* st, long* pValue, unsigned* pErrPos)
+{
+	long value;
+	st->pos = 0;
+	st->error = EXPR_OK;
+	st->errPos = 0;
+	st->depth = 0;
+	value = st->ppMode ? EvalLogOr(st) : EvalOr(st);
+	/* The whole text must be one expression */
+	if (st->error == EXPR_OK && PeekExprChar(st) != '\0')
+		SetExprError(st, EXPR_SYNTAX);
+	if (st->error != EXPR_OK)
+	{
+		if (pErrPos != NULL)
+			*pErrPos = st->errPos;
+		return st->error;
+	}
+	*pValue = value;
+	return EXPR_OK;
+}
+
+/* Evaluates the constant expression in "src", which need not be null
+   terminated.  Symbols are looked up with "lookup", which may be NULL
+   if there are no symbols.  On failure, "pErrPos" receives the offset
+   in "src" where the error was found, if it is not NULL.  Returns
+   EXPR_OK or the first error. */
+int EvalConstExpr(const char* src, unsigned len, ExprSymbolFunc lookup,
+				  void* param, long* pValue, unsigned* pErrPos)
+{
+	ExprState st;
+	long value;
+	/* Plain numbers are by far the most common */
+	if (len > 0 && CHAR_CLASS(src[0]) == CC_DIGIT)
+	{
+		unsigned used;
+		if (ParseIntText(src, len, &used, &value) == EXPR_OK && used == len)
+		{
+			*pValue = value;
+			return EXPR_OK;
+		}
+	}
+	st.src = src;
+	st.len = len;
+	st.lookup = lookup;
+	st.param = param;
+	st.ppMode = FALSE;
+	st.isDefined = NULL;
+	return EvalExprText(&st, pValue, pErrPos);
+}
+
+/* Evaluates the condition of a preprocessor "#if" or "#elif" line.
+   Symbols that "lookup" does not know read as zero, and "isDefined"
+   answers "defined" tests.  Returns the same results as
+   EvalConstExpr(). */
+int EvalPpExpr(const char* src, unsigned len, ExprSymbolFunc lookup,
+			   ExprDefinedFunc isDefined, void* param, long* pValue,
+			   unsigned* pErrPos)
+{
+	ExprState st;
+	st.src = src;
+	st.len = len;
+	st.lookup = lookup;
+	st.param = param;
+	st.ppMode = TRUE;
+	st.isDefined = isDefined;
+	return EvalExprText(&st, pValue, pErrPos);
+}
+
+/* Returns a description of an EvalConstExpr() result, for error
+   messages */
+const char* ExprErrorDesc(int result)
+{
+	switch (result)
+	{
+	case EXPR_OK: return "No error.";
+	case EXPR_SYNTAX: return "Invalid number or expression.";
+	case EXPR_OVERFLOW: return "Number is too large.";
+	case EXPR_DIV_ZERO: return "Division by zero.";
+	case EXPR_UNKNOWN_SYMBOL: return "Undefined symbol in expression.";
+	case EXPR_TOO_DEEP: return "Expression is nested too deeply.";
+	}
+	return "Invalid expression.";
+}
@@ -0,0 +1,40 @@
+/* Integer and constant expression parsing for resource scripts.
+   Numbers and expressions are read straight from the source text
+   without copying it.  Values are 32-bit, as in the resource
+   compiler, and results that do not fit are reported instead of being
+   wrapped around. */
+
+#ifndef RCEXPR_H
+#define RCEXPR_H
+
+/* Include Windows data types (BOOL) */
+#include "subwindef.h"
+
+/* Results of ParseIntText() and EvalConstExpr() */
+#define EXPR_OK 0
+#define EXPR_SYNTAX 1 /* Not a valid number or expression */
+#define EXPR_OVERFLOW 2 /* A value does not fit in 32 bits */
+#define EXPR_DIV_ZERO 3
+#define EXPR_UNKNOWN_SYMBOL 4
+#define EXPR_TOO_DEEP 5 /* Parentheses are nested too deeply */
+
+/* Finds the value of the symbol "name", which is "len" characters
+   long.  Returns FALSE if the symbol is not defined. */
+typedef BOOL (*ExprSymbolFunc)(void* param, const char* name, unsigned len,
+							   long* pValue);
+
+/* Returns TRUE if the symbol "name" is defined, for "defined" in
+   preprocessor conditions */
+typedef BOOL (*ExprDefinedFunc)(void* param, const char* name,
+								unsigned len);
+
+int ParseIntText(const char* src, unsigned len, unsigned* pUsed,
+				 long* pValue);
+int EvalConstExpr(const char* src, unsigned len, ExprSymbolFunc lookup,
+				  void* param, long* pValue, unsigned* pErrPos);
+int EvalPpExpr(const char* src, unsigned len, ExprSymbolFunc lookup,
+			   ExprDefinedFunc isDefined, void* param, long* pValue,
+			   unsigned* pErrPos);
+const char* ExprErrorDesc(int result);
+
+#endif /* not RCEXPR_H */
@@ -0,0 +1,531 @@
+/* Resource script preprocessing.
+
+   This is platform independent code.  The preprocessor does not
+   rewrite the source.  It reads the preprocessor lines of a template
+   file with NextTmplDirective(), follows the "#define" and "#undef"
+   lines in a symbol table, and works out which lines the "#if",
+   "#ifdef", "#ifndef", "#elif", "#else", and "#endif" lines leave
+   out.  Those lines become skip ranges that the lexer jumps over, so
+   the parser never sees them.  The other preprocessor lines are
+   skipped by the lexer like comments.
+
+   An "#include" line reads the preprocessor lines of the included
+   file, so that the symbols of resource.h and similar headers are
+   defined.  Everything else in an included file is ignored, as are
+   the files that cannot be found, such as windows.h, which the
+   symbols of a template seldom depend on.  A quoted file name is
+   looked for next to the including file and then in the include
+   directories of the context, and a file name in angle brackets is
+   only looked for in the include directories.
+
+   The same headers are included by file after file, so the include
+   cache keeps the preprocessor lines of every file that has been
+   included, under its path, size, and modification time.  A header is
+   read and scanned once for the whole program, however many
+   templates include it.  The cache is shared by all threads.  Its
+   entries are never changed or freed before FreeIncludeCache(), so
+   they can be read without holding the lock.  A file that changes
+   gets a new entry. */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "xthread.h" /* Includes windows.h before subwindef.h */
+#include "xmalloc.h"
+#include "tmpllex.h"
+#include "tmplfile.h"
+#include "symtab.h"
+#include "rcpp.h"
+
+/* MSVC >= 8.0 pragmas */
+#if _MSC_VER >= 1400
+#pragma warning (disable: 4996) /* Disable deprecate */
+#pragma warning (disable: 4267) /* Disable size_t warnings */
+#endif
+
+#define MAX_IF_DEPTH 64
+#define MAX_INCLUDE_DEPTH 16
+
+EA_TYPE(TmplToken);
+
+struct IncludeFile_t
+{
+	struct IncludeFile_t* next;
+	char* path;
+	unsigned long size;
+	unsigned long mtime;
+	char* text; /* Copy of the file, which "dirs" point into */
+	unsigned textLen;
+	TmplToken_array dirs; /* The preprocessor lines */
+};
+
+typedef struct IncludeFile_t IncludeFile;
+
+static IncludeFile* includeFiles;
+static xmutex_t includeLock;
+static xonce_t includeOnce = XONCE_INIT;
+
+/* One level of "#if" nesting */
+struct PpCond_t
+{
+	BOOL outerActive; /* Whether the lines around the "#if" are used */
+	BOOL taken; /* Whether a branch has been used, or cannot be */
+	BOOL seenElse;
+	const TmplToken* start; /* The "#if" line */
+};
+
+typedef struct PpCond_t PpCond;
+
+/* The state of one preprocessing run */
+struct PpState_t
+{
+	ParseCtx* ctx;
+	SymTable* syms;
+	TmplSkip_array* skips;
+	unsigned incDepth;
+};
+
+typedef struct PpState_t PpState;
+
+static void InitIncludeCache(void)
+{
+	xmutex_init(&includeLock);
+	includeFiles = NULL;
+}
+
+/* Finds the preprocessor lines of a file.  The array must have been
+   initialized. */
+static void ScanDirectives(const char* text, unsigned size,
+						   TmplToken_array* dirs)
+{
+	TmplLexer lex;
+	InitTmplLexer(&lex, text, size, 0, 1);
+	while (NextTmplDirective(&lex, &EA_SR(*dirs, dirs->len)))
+		EA_ADD(TmplToken, *dirs);
+}
+
+/* Returns the cache entry of a file, reading the file if it is not in
+   the cache or has changed.  Returns NULL if the file cannot be
+   read. */
+static IncludeFile* GetIncludeFile(const char* path)
+{
+	struct stat st;
+	IncludeFile* inc;
+	TmplFileMap map;
+
+	if (stat(path, &st) != 0 || (st.st_mode & S_IFMT) != S_IFREG)
+		return NULL;
+	xthread_once(&includeOnce, InitIncludeCache);
+	xmutex_lock(&includeLock);
+	for (inc = includeFiles; inc != NULL; inc = inc->next)
+	{
+		if (inc->size == (unsigned long)st.st_size &&
+			inc->mtime == (unsigned long)st.st_mtime &&
+			strcmp(inc->path, path) == 0)
+			break;
+	}
+	xmutex_unlock(&includeLock);
+	if (inc != NULL)
+		return inc;
+
+	/* Scan the file without the lock, so that other threads can use
+	   the cache meanwhile.  If two threads read the same file at once,
+	   both entries are kept, which does no harm. */
+	if (!MapTmplFile(&map, path))
+		return NULL;
+	inc = (IncludeFile*)xmalloc(sizeof(IncludeFile));
+	inc->path = (char*)xmalloc(strlen(path) + 1);
+	strcpy(inc->path, path);
+	inc->size = (unsigned long)st.st_size;
+	inc->mtime = (unsigned long)st.st_mtime;
+	inc->text = (char*)xmalloc(map.size + 1);
+	memcpy(inc->text, map.data, map.size);
+	inc->text[map.size] = '\0';
+	inc->textLen = map.size;
+	EA_INIT(TmplToken, inc->dirs, 16);
+	ScanDirectives(inc->text, map.size, &inc->dirs);
+	UnmapTmplFile(&map);
+
+	xmutex_lock(&includeLock);
+	inc->next = includeFiles;
+	includeFiles = inc;
+	xmutex_unlock(&includeLock);
+	return inc;
+}
+
+/* Frees the include cache.  No thread may be preprocessing when this
+   is called. */
+void FreeIncludeCache()
+{
+	xthread_once(&includeOnce, InitIncludeCache);
+	while (includeFiles != NULL)
+	{
+		IncludeFile* inc;
+		inc = includeFiles;
+		includeFiles = inc->next;
+		xfree(inc->path);
+		xfree(inc->text);
+		EA_DESTROY(TmplToken, inc->dirs);
+		xfree(inc);
+	}
+}
+
+/* Returns the start of the line after a preprocessor line */
+static unsigned DirectiveLineEnd(const char* buffer, unsigned dataSize,
+								 const TmplToken* tok)
+{
+	unsigned pos;
+	pos = tok->pos + tok->len;
+	if (pos < dataSize && buffer[pos] == '\r')
+		pos++;
+	if (pos < dataSize && buffer[pos] == '\n' &&
+		(pos == tok->pos + tok->len || buffer[pos-1] == '\r'))
+		pos++;
+	return pos;
+}
+
+/* Adds a skip range, unless it is empty */
+static void AddSkip(TmplSkip_array* skips, unsigned start, unsigned end)
+{
+	if (start >= end)
+		return;
+	EA_SR(*skips, skips->len).start = start;
+	EA_SR(*skips, skips->len).end = end;
+	EA_ADD(TmplSkip, *skips);
+}
+
+/* Returns the length of the directory part of a path, including the
+   last separator */
+static unsigned PathDirLen(const char* path)
+{
+	unsigned dirLen;
+	unsigned i;
+	dirLen = 0;
+	for (i = 0; path[i] != '\0'; i++)
+	{
+		if (path[i] == '/' || path[i] == '\\')
+			dirLen = i + 1;
+	}
+	return dirLen;
+}
+
+/* Builds the path of an included file from a directory and the file
+   name of an "#include" line.  A file name with a full path is used as
+   it is.  The doubled backslashes of a quoted name are undoubled, and
+   backslashes become slashes outside of Windows. */
+static char* MakeIncludePath(const char* dir, unsigned dirLen,
+							 const char* name, unsigned nameLen)
+{
+	char* path;
+	unsigned i, j;
+
+	if (name[0] == '/' || name[0] == '\\' || (nameLen > 1 && name[1] == ':'))
+		dirLen = 0;
+	path = (char*)xmalloc(dirLen + 1 + nameLen + 1);
+	j = 0;
+	if (dirLen > 0)
+	{
+		memcpy(path, dir, dirLen);
+		j = dirLen;
+		if (dir[dirLen-1] != '/' && dir[dirLen-1] != '\\')
+			path[j++] = '/';
+	}
+	for (i = 0; i < nameLen; i++)
+	{
+		char c;
+		c = name[i];
+		if (c == '\\' && i + 1 < nameLen && name[i+1] == '\\')
+			i++;
+#ifndef _WIN32
+		if (c == '\\')
+			c = '/';
+#endif
+		path[j++] = c;
+	}
+	path[j] = '\0';
+	return path;
+}
+
+/* Returns the cache entry of the file of an "#include" line, or NULL
+   if it cannot be found */
+static IncludeFile* FindIncludeFile(PpState* pp, const char* curFile,
+									const TmplDirective* dir)
+{
+	const char* const* incDirs;
+	const char* name;
+	unsigned nameLen;
+	IncludeFile* inc;
+	char* path;
+	char endChar;
+
+	if (dir->argLen < 2 || (dir->arg[0] != '"' && dir->arg[0] != '<'))
+		return NULL;
+	endChar = (dir->arg[0] == '"') ? '"' : '>';
+	name = dir->arg + 1;
+	for (nameLen = 0; nameLen < dir->argLen - 1 && name[nameLen] != endChar;
+		 nameLen++);
+	if (nameLen == 0 || nameLen == dir->argLen - 1)
+		return NULL;
+
+	inc = NULL;
+	if (endChar == '"')
+	{
+		/* Without a file name, the current directory is used */
+		if (curFile != NULL)
+			path = MakeIncludePath(curFile, PathDirLen(curFile),
+								   name, nameLen);
+		else
+			path = MakeIncludePath(NULL, 0, name, nameLen);
+		inc = GetIncludeFile(path);
+		xfree(path);
+	}
+	incDirs = pp->ctx->includeDirs;
+	for (; inc == NULL && incDirs != NULL && *incDirs != NULL; incDirs++)
+	{
+		path = MakeIncludePath(*incDirs, strlen(*incDirs), name, nameLen);
+		inc = GetIncludeFile(path);
+		xfree(path);
+	}
+	return inc;
+}
+
+/* Reports an error in a preprocessor line, see AddParseDiag().  The
+   errors of included files are ignored.  Returns FALSE if
+   preprocessing must stop. */
+static BOOL PpError(PpState* pp, const char* buffer, unsigned pos,
+					unsigned line, const char* desc)
+{
+	if (pp->incDepth > 0)
+		return TRUE;
+	return AddParseDiag(pp->ctx, buffer, pos, line, PDIAG_PREPROC, desc);
+}
+
+/* Follows the preprocessor lines of a file.  "buffer" holds the
+   file, and "dirs" its preprocessor lines.  For the template file
+   itself, the lines that the conditions leave out are added to the
+   skip ranges, and mistakes in the conditions are errors.  Included
+   files are read leniently.  In recovery mode a line with a mistake
+   is ignored, and a condition that cannot be evaluated is false.
+   Returns FALSE on error, with the error in the context. */
+static BOOL ProcessDirectives(PpState* pp, const char* fileName,
+							  const char* buffer, unsigned dataSize,
+							  const TmplToken* dirs, unsigned numDirs)
+{
+	PpCond conds[MAX_IF_DEPTH];
+	unsigned numConds;
+	BOOL active;
+	BOOL isMain;
+	unsigned skipStart;
+	const TmplToken* tok;
+	unsigned i;
+
+	isMain = (BOOL)(pp->incDepth == 0);
+	numConds = 0;
+	active = TRUE;
+	skipStart = 0;
+	tok = NULL;
+	for (i = 0; i < numDirs; i++)
+	{
+		TmplDirective dir;
+		BOOL wasActive;
+		BOOL isIf, isIfdef, isIfndef;
+
+		tok = &dirs[i];
+		ReadTmplDirective(tok, &dir);
+		wasActive = active;
+		isIf = (dir.nameLen == 2 && memcmp(dir.name, "if", 2) == 0);
+		isIfdef = (dir.nameLen == 5 && memcmp(dir.name, "ifdef", 5) == 0);
+		isIfndef = (dir.nameLen == 6 && memcmp(dir.name, "ifndef", 6) == 0);
+		if (isIf || isIfdef || isIfndef)
+		{
+			long value;
+			if (numConds == MAX_IF_DEPTH)
+			{
+				if (!PpError(pp, buffer, tok->pos, tok->line,
+							 "Conditions are nested too deeply."))
+					return FALSE;
+				continue;
+			}
+			conds[numConds].outerActive = active;
+			conds[numConds].seenElse = FALSE;
+			conds[numConds].start = tok;
+			value = 0;
+			if (active == TRUE && isIf)
+			{
+				int result;
+				unsigned exprPos;
+				result = EvalPpExpr(dir.arg, dir.argLen, LookupSym,
+									IsSymDefined, pp->syms, &value,
+									&exprPos);
+				/* A condition that cannot be evaluated is false */
+				if (result != EXPR_OK)
+				{
+					if (!PpError(pp, buffer, (dir.arg - buffer) + exprPos,
+								 tok->line, ExprErrorDesc(result)))
+						return FALSE;
+					value = 0;
+				}
+			}
+			else if (active == TRUE)
+			{
+				value = IsSymDefined(pp->syms, dir.macro, dir.macroLen);
+				if (isIfndef)
+					value = !value;
+			}
+			active = (BOOL)(active == TRUE && value != 0);
+			/* If the lines around are left out, so are all branches */
+			conds[numConds].taken = (BOOL)(active == TRUE ||
+										   wasActive == FALSE);
+			numConds++;
+		}
+		else if (dir.nameLen == 4 && memcmp(dir.name, "elif", 4) == 0)
+		{
+			long value;
+			if (numConds == 0)
+			{
+				if (!PpError(pp, buffer, tok->pos, tok->line,
+							 "#elif without #if."))
+					return FALSE;
+				continue;
+			}
+			if (conds[numConds-1].seenElse == TRUE)
+			{
+				if (!PpError(pp, buffer, tok->pos, tok->line,
+							 "#elif after #else."))
+					return FALSE;
+				continue;
+			}
+			value = 0;
+			if (conds[numConds-1].taken == FALSE)
+			{
+				int result;
+				unsigned exprPos;
+				result = EvalPpExpr(dir.arg, dir.argLen, LookupSym,
+									IsSymDefined, pp->syms, &value,
+									&exprPos);
+				/* A condition that cannot be evaluated is false */
+				if (result != EXPR_OK)
+				{
+					if (!PpError(pp, buffer, (dir.arg - buffer) + exprPos,
+								 tok->line, ExprErrorDesc(result)))
+						return FALSE;
+					value = 0;
+				}
+			}
+			active = (BOOL)(value != 0);
+			if (active == TRUE)
+				conds[numConds-1].taken = TRUE;
+		}
+		else if (dir.nameLen == 4 && memcmp(dir.name, "else", 4) == 0)
+		{
+			if (numConds == 0)
+			{
+				if (!PpError(pp, buffer, tok->pos, tok->line,
+							 "#else without #if."))
+					return FALSE;
+				continue;
+			}
+			if (conds[numConds-1].seenElse == TRUE)
+			{
+				if (!PpError(pp, buffer, tok->pos, tok->line,
+							 "#else after #else."))
+					return FALSE;
+				continue;
+			}
+			conds[numConds-1].seenElse = TRUE;
+			active = (BOOL)(conds[numConds-1].taken == FALSE);
+			conds[numConds-1].taken = TRUE;
+		}
+		else if (dir.nameLen == 5 && memcmp(dir.name, "endif", 5) == 0)
+		{
+			if (numConds == 0)
+			{
+				if (!PpError(pp, buffer, tok->pos, tok->line,
+							 "#endif without #if."))
+					return FALSE;
+				continue;
+			}
+			numConds--;
+			active = conds[numConds].outerActive;
+		}
+		else if (active == FALSE)
+			continue;
+		else if (dir.nameLen == 6 && memcmp(dir.name, "define", 6) == 0)
+		{
+			long value;
+			if (dir.macroLen == 0)
+				continue;
+			if (dir.funcLike == FALSE && dir.valueLen > 0 &&
+				EvalConstExpr(dir.value, dir.valueLen, LookupSym, pp->syms,
+							  &value, NULL) == EXPR_OK)
+				DefineSym(pp->syms, dir.macro, dir.macroLen, value);
+			else
+				DefineSymNoValue(pp->syms, dir.macro, dir.macroLen);
+		}
+		else if (dir.nameLen == 5 && memcmp(dir.name, "undef", 5) == 0)
+		{
+			if (dir.macroLen > 0)
+				UndefSym(pp->syms, dir.macro, dir.macroLen);
+		}
+		else if (dir.nameLen == 7 && memcmp(dir.name, "include", 7) == 0)
+		{
+			IncludeFile* inc;
+			if (pp->incDepth == MAX_INCLUDE_DEPTH)
+				continue;
+			inc = FindIncludeFile(pp, fileName, &dir);
+			if (inc == NULL)
+				continue;
+			pp->incDepth++;
+			ProcessDirectives(pp, inc->path, inc->text, inc->textLen,
+							  inc->dirs.d, inc->dirs.len);
+			pp->incDepth--;
+		}
+		/* "#pragma" and the other lines are ignored */
+
+		if (isMain == TRUE && wasActive != active)
+		{
+			if (active == FALSE)
+				skipStart = DirectiveLineEnd(buffer, dataSize, tok);
+			else
+				AddSkip(pp->skips, skipStart, tok->pos - (tok->col - 1));
+		}
+	}
+	if (numConds > 0)
+	{
+		/* Leave out the rest of the file */
+		if (isMain == TRUE && active == FALSE)
+			AddSkip(pp->skips, skipStart, dataSize);
+		/* Point at the "#if" that is not ended */
+		tok = conds[numConds-1].start;
+		return PpError(pp, buffer, tok->pos, tok->line, "Missing #endif.");
+	}
+	return TRUE;
+}
+
+/* Reads the preprocessor lines of a template file.  The symbols that
+   the file and the files it includes define go into "syms", and the
+   ranges of the lines that the conditions leave out go into "skips",
+   which must have been initialized.  The file name of the context, if
+   any, is where quoted "#include" files are looked for first.
+   Returns FALSE if the conditions are not well formed, with the error
+   in the context, unless the context records its diagnostics. */
+BOOL PreprocessTmpl(ParseCtx* ctx, const char* buffer, unsigned dataSize,
+					SymTable* syms, TmplSkip_array* skips)
+{
+	PpState pp;
+	TmplToken_array dirs;
+	BOOL retVal;
+
+	EA_INIT(TmplToken, dirs, 16);
+	ScanDirectives(buffer, dataSize, &dirs);
+	pp.ctx = ctx;
+	pp.syms = syms;
+	pp.skips = skips;
+	pp.incDepth = 0;
+	retVal = ProcessDirectives(&pp, ctx->srcName, buffer, dataSize,
+							   dirs.d, dirs.len);
+	EA_DESTROY(TmplToken, dirs);
+	return retVal;
+}
@@ -0,0 +1,20 @@
+/* Resource script preprocessing.  The preprocessor lines of a
+   template file are read before the template is parsed: "#define"
+   and "#undef" lines go into a symbol table, "#include" lines read
+   the symbols of headers such as resource.h, and "#if" and its
+   relatives decide which parts of the file the parser sees. */
+
+#ifndef RCPP_H
+#define RCPP_H
+
+#include "tmplparser.h"
+#include "tmpllex.h"
+#include "symtab.h"
+
+EA_TYPE(TmplSkip);
+
+BOOL PreprocessTmpl(ParseCtx* ctx, const char* buffer, unsigned dataSize,
+					SymTable* syms, TmplSkip_array* skips);
+void FreeIncludeCache();
+
+#endif /* not RCPP_H */
@@ -0,0 +1,154 @@
+/* Arena allocator for strings that are released together.
+
+   A dialog template keeps the text of its controls in an arena, and a
+   symbol table the names of its symbols.  The strings are packed one
+   after another into blocks, so they sit next to each other in memory
+   and are released with one call.
+
+   Freed blocks of the standard size are not returned to the heap
+   right away.  They are kept on a free list that belongs to the
+   current thread and reused by the next arena that the thread
+   creates.  When a batch worker thread processes file after file, it
+   keeps reusing the same few blocks and hardly ever calls malloc(),
+   so the worker threads do not contend for the heap lock.  */
+
+#include <string.h>
+
+#include "xmalloc.h"
+#include "xthread.h"
+#include "strarena.h"
+
+/* Usable size of a standard block.  Longer strings get a block of
+   their own, which is not cached.  */
+#define STR_BLOCK_SIZE 4096
+/* Maximum number of blocks on a thread's free list */
+#define MAX_CACHED_BLOCKS 64
+
+struct StrBlock_t
+{
+	struct StrBlock_t* next;
+	unsigned size;
+	unsigned used;
+	char data[1]; /* Actually "size" bytes */
+};
+
+typedef struct StrBlock_t StrBlock;
+
+/* Free list of standard size blocks for the current thread */
+static XTHREAD_LOCAL StrBlock* blockCache = NULL;
+static XTHREAD_LOCAL unsigned numCached = 0;
+
+void InitStrArena(StrArena* arena)
+{
+	arena->blocks = NULL;
+}
+
+static StrBlock* NewStrBlock(unsigned size)
+{
+	StrBlock* block;
+	if (size <= STR_BLOCK_SIZE && blockCache != NULL)
+	{
+		block = blockCache;
+		blockCache = block->next;
+		numCached--;
+	}
+	else
+	{
+		if (size < STR_BLOCK_SIZE)
+			size = STR_BLOCK_SIZE;
+		block = (StrBlock*)xmalloc(sizeof(StrBlock) - 1 + size);
+		block->size = size;
+	}
+	block->used = 0;
+	return block;
+}
+
+/* Allocates "size" bytes from the arena.  The memory stays valid
+   until the arena is freed.  */
+char* StrArenaAlloc(StrArena* arena, unsigned size)
+{
+	StrBlock* block;
+	char* mem;
+	block = arena->blocks;
+	if (block == NULL || block->size - block->used < size)
+	{
+		StrBlock* newBlock;
+		newBlock = NewStrBlock(size);
+		if (block != NULL && newBlock->size > STR_BLOCK_SIZE)
+		{
+			/* Keep filling the current block; a large string's block
+			   is full anyway */
+			newBlock->next = block->next;
+			block->next = newBlock;
+			newBlock->used = size;
+			return newBlock->data;
+		}
+		newBlock->next = block;
+		arena->blocks = newBlock;
+		block = newBlock;
+	}
+	mem = &block->data[block->used];
+	block->used += size;
+	return mem;
+}
+
+/* Shrinks the most recent allocation "mem" to "size" bytes, so that
+   the unused bytes can be used for the next allocation.  This lets
+   the caller allocate the largest size that it might need and trim
+   it once the real size is known.  */
+void StrArenaTrim(StrArena* arena, char* mem, unsigned size)
+{
+	StrBlock* block;
+	block = arena->blocks;
+	if (block != NULL && mem >= block->data &&
+		mem < &block->data[block->used])
+		block->used = (unsigned)(mem - block->data) + size;
+}
+
+/* Copies "len" characters of "src" into the arena and adds a null
+   character.  */
+char* StrArenaDup(StrArena* arena, const char* src, unsigned len)
+{
+	char* str;
+	str = StrArenaAlloc(arena, len + 1);
+	memcpy(str, src, len);
+	str[len] = '\0';
+	return str;
+}
+
+/* Releases all of the strings in the arena.  The arena is left empty
+   and can be used again.  */
+void FreeStrArena(StrArena* arena)
+{
+	StrBlock* block;
+	block = arena->blocks;
+	while (block != NULL)
+	{
+		StrBlock* next;
+		next = block->next;
+		if (block->size == STR_BLOCK_SIZE && numCached < MAX_CACHED_BLOCKS)
+		{
+			block->next = blockCache;
+			blockCache = block;
+			numCached++;
+		}
+		else
+			xfree(block);
+		block = next;
+	}
+	arena->blocks = NULL;
+}
+
+/* Frees the blocks on the current thread's free list.  Threads that
+   used arenas should call this before they exit.  */
+void FreeStrArenaCache()
+{
+	while (blockCache != NULL)
+	{
+		StrBlock* next;
+		next = blockCache->next;
+		xfree(blockCache);
+		blockCache = next;
+	}
+	numCached = 0;
+}
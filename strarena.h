@@ -0,0 +1,25 @@
+/* Arena allocator for strings that are released together.  Strings
+   are carved out of large blocks one after another, and all of them
+   are released at once when the arena is freed.  */
+
+#ifndef STRARENA_H
+#define STRARENA_H
+
+struct StrBlock_t;
+
+/* An all-zero arena is a valid empty arena.  */
+struct StrArena_t
+{
+	struct StrBlock_t* blocks; /* Newest block first */
+};
+
+typedef struct StrArena_t StrArena;
+
+void InitStrArena(StrArena* arena);
+char* StrArenaAlloc(StrArena* arena, unsigned size);
+void StrArenaTrim(StrArena* arena, char* mem, unsigned size);
+char* StrArenaDup(StrArena* arena, const char* src, unsigned len);
+void FreeStrArena(StrArena* arena);
+void FreeStrArenaCache();
+
+#endif /* not STRARENA_H */
@@ -0,0 +1,252 @@
+/* Global string interning.
+
+   The same ID, style, and window class strings appear in control
+   after control and template after template.  Instead of giving every
+   control its own copy, such strings are interned: InternStr()
+   returns the one copy of a string that is shared by the whole
+   program, so equal interned strings have equal pointers.
+
+   Each call to InternStr() takes a reference to the string, which is
+   given back with ReleaseStr().  A string is freed when its last
+   reference is released, so templates that are freed, and controls
+   that are edited or deleted, do not leave their strings behind.
+
+   The table is split into shards by the high bits of the hash, and
+   each shard has its own lock, so batch worker threads that intern
+   strings at the same time seldom wait for each other.  Each shard is
+   an open addressing hash table with linear probing.  */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "xmalloc.h"
+#include "xthread.h"
+#include "strintern.h"
+
+#define NUM_SHARDS 16
+#define SHARD_SHIFT 28 /* Top four bits of the hash select the shard */
+#define MIN_SLOTS 64
+
+/* An interned string and its reference count */
+struct InternEntry_t
+{
+	unsigned refs;
+	unsigned hash;
+	unsigned len;
+	char str[1]; /* Actually "len" characters and a null character */
+};
+
+typedef struct InternEntry_t InternEntry;
+
+struct InternSlot_t
+{
+	InternEntry* entry; /* NULL if the slot is empty */
+	unsigned hash;
+};
+
+typedef struct InternSlot_t InternSlot;
+
+struct InternShard_t
+{
+	xmutex_t lock;
+	InternSlot* slots;
+	unsigned numSlots; /* Always a power of two */
+	unsigned numUsed;
+	unsigned long numBytes;
+};
+
+typedef struct InternShard_t InternShard;
+
+static InternShard shards[NUM_SHARDS];
+static xonce_t tableOnce = XONCE_INIT;
+
+/* Sets up the shards.  This runs once, on the first call to
+   InternStr() from any thread. */
+static void InitInternTable(void)
+{
+	unsigned i;
+	for (i = 0; i < NUM_SHARDS; i++)
+	{
+		xmutex_init(&shards[i].lock);
+		shards[i].slots = NULL;
+		shards[i].numSlots = 0;
+		shards[i].numUsed = 0;
+		shards[i].numBytes = 0;
+	}
+}
+
+/* FNV-1a hash */
+static unsigned HashStr(const char* str, unsigned len)
+{
+	unsigned hash;
+	unsigned i;
+	hash = 2166136261U;
+	for (i = 0; i < len; i++)
+	{
+		hash ^= (unsigned char)str[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+/* Doubles the number of slots of a shard */
+static void GrowShard(InternShard* shard)
+{
+	InternSlot* oldSlots;
+	unsigned oldNumSlots;
+	unsigned i;
+	oldSlots = shard->slots;
+	oldNumSlots = shard->numSlots;
+	shard->numSlots = (oldNumSlots == 0) ? MIN_SLOTS : oldNumSlots * 2;
+	shard->slots = (InternSlot*)xmalloc(sizeof(InternSlot) *
+										shard->numSlots);
+	memset(shard->slots, 0, sizeof(InternSlot) * shard->numSlots);
+	for (i = 0; i < oldNumSlots; i++)
+	{
+		unsigned j;
+		if (oldSlots[i].entry == NULL)
+			continue;
+		j = oldSlots[i].hash & (shard->numSlots - 1);
+		while (shard->slots[j].entry != NULL)
+			j = (j + 1) & (shard->numSlots - 1);
+		shard->slots[j] = oldSlots[i];
+	}
+	xfree(oldSlots);
+}
+
+/* Empties slot "i" of a shard.  The entries after it in the same run
+   of slots are moved back where needed, so that every entry can still
+   be reached from its home slot without tombstones. */
+static void RemoveSlot(InternShard* shard, unsigned i)
+{
+	unsigned mask;
+	unsigned j;
+	mask = shard->numSlots - 1;
+	j = i;
+	while (1)
+	{
+		unsigned home;
+		j = (j + 1) & mask;
+		if (shard->slots[j].entry == NULL)
+			break;
+		/* An entry whose home slot lies after the hole, up to its own
+		   slot, stays where it is */
+		home = shard->slots[j].hash & mask;
+		if ((i <= j) ? (i < home && home <= j) : (i < home || home <= j))
+			continue;
+		shard->slots[i] = shard->slots[j];
+		i = j;
+	}
+	shard->slots[i].entry = NULL;
+}
+
+/* Returns the interned copy of the first "len" characters of "str"
+   and takes a reference to it, which must be given back with
+   ReleaseStr().  The copy is null terminated and must not be
+   modified.  This function is thread-safe. */
+const char* InternStr(const char* str, unsigned len)
+{
+	InternShard* shard;
+	InternEntry* entry;
+	unsigned hash;
+	unsigned i;
+
+	xthread_once(&tableOnce, InitInternTable);
+	hash = HashStr(str, len);
+	shard = &shards[hash >> SHARD_SHIFT];
+	xmutex_lock(&shard->lock);
+	/* Keep the table at most half full */
+	if (shard->numUsed * 2 >= shard->numSlots)
+		GrowShard(shard);
+	i = hash & (shard->numSlots - 1);
+	while (shard->slots[i].entry != NULL)
+	{
+		entry = shard->slots[i].entry;
+		if (shard->slots[i].hash == hash && entry->len == len &&
+			memcmp(entry->str, str, len) == 0)
+		{
+			entry->refs++;
+			xmutex_unlock(&shard->lock);
+			return entry->str;
+		}
+		i = (i + 1) & (shard->numSlots - 1);
+	}
+	entry = (InternEntry*)xmalloc(offsetof(InternEntry, str) + len + 1);
+	entry->refs = 1;
+	entry->hash = hash;
+	entry->len = len;
+	memcpy(entry->str, str, len);
+	entry->str[len] = '\0';
+	shard->slots[i].entry = entry;
+	shard->slots[i].hash = hash;
+	shard->numUsed++;
+	shard->numBytes += len + 1;
+	xmutex_unlock(&shard->lock);
+	return entry->str;
+}
+
+/* Gives back a reference that InternStr() returned.  The string is
+   freed with its last reference.  "str" may be NULL.  This function
+   is thread-safe. */
+void ReleaseStr(const char* str)
+{
+	InternShard* shard;
+	InternEntry* entry;
+	unsigned i;
+
+	if (str == NULL)
+		return;
+	entry = (InternEntry*)(str - offsetof(InternEntry, str));
+	shard = &shards[entry->hash >> SHARD_SHIFT];
+	xmutex_lock(&shard->lock);
+	if (--entry->refs > 0)
+	{
+		xmutex_unlock(&shard->lock);
+		return;
+	}
+	i = entry->hash & (shard->numSlots - 1);
+	while (shard->slots[i].entry != entry)
+		i = (i + 1) & (shard->numSlots - 1);
+	RemoveSlot(shard, i);
+	shard->numUsed--;
+	shard->numBytes -= entry->len + 1;
+	xmutex_unlock(&shard->lock);
+	xfree(entry);
+}
+
+/* Returns the number of distinct interned strings and the number of
+   bytes that they take up, including null characters. */
+void GetInternStats(unsigned* pNumStrings, unsigned long* pNumBytes)
+{
+	unsigned i;
+	*pNumStrings = 0;
+	*pNumBytes = 0;
+	xthread_once(&tableOnce, InitInternTable);
+	for (i = 0; i < NUM_SHARDS; i++)
+	{
+		xmutex_lock(&shards[i].lock);
+		*pNumStrings += shards[i].numUsed;
+		*pNumBytes += shards[i].numBytes;
+		xmutex_unlock(&shards[i].lock);
+	}
+}
+
+/* Frees all of the interned strings, whether or not they have been
+   released.  No other thread may be using the table, and no interned
+   string may be used afterwards.  The table is left empty and can be
+   used again. */
+void FreeInternTable()
+{
+	unsigned i, j;
+	xthread_once(&tableOnce, InitInternTable);
+	for (i = 0; i < NUM_SHARDS; i++)
+	{
+		for (j = 0; j < shards[i].numSlots; j++)
+			xfree(shards[i].slots[j].entry);
+		xfree(shards[i].slots);
+		shards[i].slots = NULL;
+		shards[i].numSlots = 0;
+		shards[i].numUsed = 0;
+		shards[i].numBytes = 0;
+	}
+}
@@ -0,0 +1,13 @@
+/* Global string interning.  Equal strings are stored once, so
+   interned strings can be compared by pointer.  Every InternStr()
+   must be matched by a ReleaseStr().  */
+
+#ifndef STRINTERN_H
+#define STRINTERN_H
+
+const char* InternStr(const char* str, unsigned len);
+void ReleaseStr(const char* str);
+void GetInternStats(unsigned* pNumStrings, unsigned long* pNumBytes);
+void FreeInternTable();
+
+#endif /* not STRINTERN_H */
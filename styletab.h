@@ -0,0 +1,71 @@
+/* Perfect hash table of the window style constants.
+   Generated by mkstyletab from styletab.def.  Do not edit. */
+
+#define NUM_STYLE_CONSTS 182
+#define MAX_STYLE_CONST_LEN 27
+#define STYLE_HASH_MULT 7
+#define STYLE_TABLE_SIZE 512
+#define STYLE_NUM_BUCKETS 128
+#define STYLE_HASH_SLOT(h) (((h) >> 8) & (STYLE_TABLE_SIZE - 1))
+#define STYLE_HASH_BUCKET(h) (((h) >> 20) & (STYLE_NUM_BUCKETS - 1))
+
+/* Displacement of each bucket */
+static const unsigned short styleHashDisp[STYLE_NUM_BUCKETS] = {
+	  0,   0,   0,   1,   0,   0,   1,   0,   0,   0,   0,   0,
+	  0,   0,   0,   2,   0,   0,   0,   0,   0,   0,   0,   0,
+	  1,   0,   0,   4,   0,   0,   0,   0,   0,   0,   0,   2,
+	  0,   4,   1,   0,   0,   1,   0,   0,   2,   0,   4,   1,
+	  1,   0,   0,   0,   0,   0,   2,   0,   0,   0,   3,   0,
+	  1,   0,   1,   0,   0,   0,   0,   0,   1,   0,   0,   0,
+	  8,   0,   2,   0,   0,   5,   3,   0,   0,   1,   1,   0,
+	  0,   0,   1,   0,   0,   0,   0,   0,   2,   0,   0,   0,
+	  2,   1,   0,   0,   0,   2,   0,   0,   2,   1,   0,   0,
+	  0,   0,   0,   0,   2,   4,   0,   0,   0,   3,   0,   0,
+	  0,   3,   0,   0,   0,   0,   7,   1};
+
+/* Index of the constant in each slot, counting from one, with zero
+   for unused slots */
+static const unsigned char styleHashTable[STYLE_TABLE_SIZE] = {
+	  0,   0,   0,   0,   0,   0,   0,   0,   0,  42,   0,   2,
+	  0,  76,  22,  46, 125,   0,   0,   0,   0,   0,   0, 171,
+	174,  48,  41, 103,   0,   0,   0,   0,   0,  15,   0,   0,
+	  0,   0,   0,  21,   0,   0,   0,   0,   0,   0,   0,   0,
+	 88,   0,   0,   0,  20, 100,   0,  61, 149,  97, 146,   0,
+	  0,  23,   0,   0,   0,   0,   0,  32,   0,   0,   0,   0,
+	  0,   0,   0, 122,  14,  28,  31, 181,  62, 135, 106,   0,
+	175,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+	 29, 136,   0,   0, 161,   0,   0,   0,  44,   0,   0,   0,
+	176, 110,   0,   0,   0,   0,   0,   0, 165,  24,   0,   0,
+	  0,  38,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+	  0,   0, 102,   0,   0,  90,   0,  66,  19,   0,   0,  95,
+	  0,   0,   0, 159,  77,  71,   0,  55,   0,   0,   0,   0,
+	  0,   0, 101, 182,   0,   0, 118,   0,   0,   0, 111, 152,
+	170, 142, 151,  54,   0,   0,   0,  92,   0,   0, 121, 143,
+	163,  11,   1,   0, 147,   0,   0,   0,  98,  34, 128,  75,
+	127,   0, 156, 132, 144,   0, 141,   0,   0,  30, 154,   0,
+	  0,   0,   0,   0,   0, 117,   0,   0,  59,   0,   0,  26,
+	  0,  25,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+	  0,   0, 158,   0,   0,   0,   0,   0,   7,   0,   0,   0,
+	  0,   0,   0,  43, 120,   0,   0,   0,   0,   0, 108, 107,
+	  0,   0,   0,   0,  79, 169,   0, 164,   0,   0,  80,   0,
+	  0,  68,   0,   0,   0,   0,  93,   0,   0,   0,   0,   0,
+	  0,   0,   0, 129,   0,   0,   0,   0,   0, 138,   0,  56,
+	 49, 139,   0,   0,   0,   0,   0,   0, 157,   0,   0,   0,
+	  0,  40,  39,   0,  10,  18,   0,   0, 172,   0,   0,  16,
+	 82,   0,  36,   0,  27, 155,   0,   6, 137, 166,  63,  86,
+	180, 130,  65, 133, 173,   0,   0, 145, 105,   0,   0,   0,
+	  0,   0,   0,   0,   0,   0,  50, 167, 153,  89,   0,   0,
+	  0,  73,   0, 113,   0,   0,  52,   5,   0,  45,   0,   0,
+	  0,   4, 123, 140,  13, 148,   0,   0, 114,  53,   0,  57,
+	  0,   0,   0,   0,   0,   0,   0,   0,   0,  91,   0,   0,
+	 58,   0,  64,   0,   0,   0,   3,   0,   0, 150, 116, 109,
+	  0, 115,   0,   0,   0,   0,   0, 162, 126, 112,  33,  70,
+	134,  37,   0,   0,   0,   0,   9,  81,   0,   0,   0,   0,
+	 83,   0,   0,   0,   0,   0, 168,   0,   0,  96,   0,  35,
+	 85, 177,  72,   0,  87,   0,   0,   0,   0,   0,  17,   0,
+	160, 124,   0,  51,  84,   0,   0,  69,  67,   0,  74,   0,
+	  0,   0,   0,   0,   0,   0,   0,  99,  12,  60,   0, 178,
+	  0,   0,   0,  78,  47,   8,   0,   0,   0,   0,   0,   0,
+	  0,   0, 131,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+	  0,  94,   0,   0,   0,   0, 119,   0,   0,   0,   0, 104,
+	  0,   0,   0,   0,   0, 179,   0,   0};
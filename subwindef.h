@@ -24,7 +24,7 @@ typedef struct tagPOINT
 } POINT;
 
 #ifndef MAX_PATH
-#define MAX_PATH 260;
+#define MAX_PATH 260
 #endif
 
 #endif /* SUBWINDEF_H */
@@ -0,0 +1,596 @@
+/* Preprocessor symbol tables.
+
+   This is platform independent code.  The table is a hash table with
+   open addressing and linear probing, which is kept at most half
+   full.  It is filled before the templates are parsed and only read
+   while they are, so it needs no locking.
+
+   A header is only scanned for its "#define NAME value" lines whose
+   value is a constant expression (see rcexpr.h), which is what
+   resource.h and similar headers are made of.  Function-like macros,
+   macros that continue on the next line, and macros with any other
+   value are skipped, as are the other preprocessor directives.
+
+   The cache file of a header holds the symbols that the header
+   defined, in the order it defined them:
+
+	   "DLGSYM1\n"
+	   key (two 32-bit numbers), header size, number of symbols
+	   for each symbol: value, name length, name
+
+   All of the numbers are 32 bits, least significant byte first.  The
+   key hashes the header's contents together with the symbols that
+   were defined before it, since those can change the values that the
+   header defines. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "xmalloc.h"
+#include "tmpllex.h"
+#include "tmplfile.h"
+#include "symtab.h"
+
+/* MSVC >= 8.0 pragmas */
+#if _MSC_VER >= 1400
+#pragma warning (disable: 4996) /* Disable deprecate */
+#pragma warning (disable: 4267) /* Disable size_t warnings */
+#endif
+
+#define SYM_CACHE_MAGIC "DLGSYM1\n"
+#define SYM_CACHE_MAGIC_LEN 8
+#define SYM_CACHE_HEAD_LEN (SYM_CACHE_MAGIC_LEN + 16)
+
+/* The symbols that windows.h defines for the standard dialog box
+   buttons, which most resource scripts use without defining */
+static const struct
+{
+	const char* name;
+	long value;
+} stdSymbols[] =
+{
+	{ "IDOK", 1 },
+	{ "IDCANCEL", 2 },
+	{ "IDABORT", 3 },
+	{ "IDRETRY", 4 },
+	{ "IDIGNORE", 5 },
+	{ "IDYES", 6 },
+	{ "IDNO", 7 },
+	{ "IDCLOSE", 8 },
+	{ "IDHELP", 9 },
+	{ "IDTRYAGAIN", 10 },
+	{ "IDCONTINUE", 11 },
+	{ "IDC_STATIC", -1 }
+};
+
+#define NUM_STD_SYMBOLS (sizeof(stdSymbols) / sizeof(stdSymbols[0]))
+
+/* FNV-1a, continuing from "h" */
+static unsigned long HashBytes(unsigned long h, const char* data,
+							   unsigned len)
+{
+	unsigned i;
+	for (i = 0; i < len; i++)
+		h = ((h ^ (unsigned char)data[i]) * 16777619UL) & 0xffffffffUL;
+	return h;
+}
+
+/* A second, independent hash for the cache keys, continuing from
+   "h" */
+static unsigned long HashBytes2(unsigned long h, const char* data,
+								unsigned len)
+{
+	unsigned i;
+	for (i = 0; i < len; i++)
+		h = (h * 31 + (unsigned char)data[i] + 1) & 0xffffffffUL;
+	return h;
+}
+
+void InitSymTable(SymTable* table)
+{
+	EA_INIT(SymEntry, table->entries, 64);
+	table->slots = NULL;
+	table->numSlots = 0;
+	table->count = 0;
+	InitStrArena(&table->names);
+	table->stateHash[0] = 2166136261UL;
+	table->stateHash[1] = 0;
+	table->parentLookup = NULL;
+	table->parentParam = NULL;
+}
+
+void FreeSymTable(SymTable* table)
+{
+	EA_DESTROY(SymEntry, table->entries);
+	xfree(table->slots);
+	table->slots = NULL;
+	table->numSlots = 0;
+	table->count = 0;
+	FreeStrArena(&table->names);
+}
+
+/* Returns the slot that holds the given name, or the free slot where
+   it would go.  The table must have at least one free slot. */
+static unsigned FindSymSlot(SymTable* table, const char* name,
+							unsigned len, unsigned long hash)
+{
+	unsigned mask;
+	unsigned i;
+	mask = table->numSlots - 1;
+	i = (unsigned)hash & mask;
+	while (table->slots[i] != 0)
+	{
+		SymEntry* entry;
+		entry = &table->entries.d[table->slots[i]-1];
+		if (entry->hash == hash && entry->nameLen == len &&
+			memcmp(entry->name, name, len) == 0)
+			break;
+		i = (i + 1) & mask;
+	}
+	return i;
+}
+
+/* Doubles the number of slots and rehashes the names */
+static void GrowSymSlots(SymTable* table)
+{
+	unsigned* oldSlots;
+	unsigned oldNum;
+	unsigned i;
+	oldSlots = table->slots;
+	oldNum = table->numSlots;
+	table->numSlots = (oldNum == 0) ? 64 : oldNum * 2;
+	table->slots = (unsigned*)xmalloc(sizeof(unsigned) * table->numSlots);
+	memset(table->slots, 0, sizeof(unsigned) * table->numSlots);
+	for (i = 0; i < oldNum; i++)
+	{
+		unsigned mask;
+		unsigned j;
+		if (oldSlots[i] == 0)
+			continue;
+		mask = table->numSlots - 1;
+		j = (unsigned)table->entries.d[oldSlots[i]-1].hash & mask;
+		while (table->slots[j] != 0)
+			j = (j + 1) & mask;
+		table->slots[j] = oldSlots[i];
+	}
+	xfree(oldSlots);
+}
+
+/* Adds a definition, which replaces any earlier definition of the
+   same name */
+static void AddSymEntry(SymTable* table, const char* name, unsigned len,
+						long value, unsigned flags)
+{
+	SymEntry* entry;
+	unsigned long hash;
+	unsigned slot;
+	char valueBytes[5];
+	unsigned i;
+
+	if ((table->count + 1) * 2 > table->numSlots)
+		GrowSymSlots(table);
+	hash = HashBytes(2166136261UL, name, len);
+	slot = FindSymSlot(table, name, len, hash);
+	entry = &EA_SR(table->entries, table->entries.len);
+	if (table->slots[slot] != 0)
+		entry->name = table->entries.d[table->slots[slot]-1].name;
+	else
+	{
+		entry->name = StrArenaDup(&table->names, name, len);
+		table->count++;
+	}
+	entry->nameLen = len;
+	entry->hash = hash;
+	entry->value = value;
+	entry->flags = flags;
+	EA_ADD(SymEntry, table->entries);
+	table->slots[slot] = table->entries.len;
+
+	for (i = 0; i < 4; i++)
+		valueBytes[i] = (char)(((unsigned long)value >> (i * 8)) & 0xff);
+	valueBytes[4] = (char)flags;
+	/* Plain numeric definitions hash as they always have, so that
+	   the existing cache files stay valid */
+	i = (flags != 0) ? 5 : 4;
+	table->stateHash[0] = HashBytes(table->stateHash[0], name, len);
+	table->stateHash[0] = HashBytes(table->stateHash[0], valueBytes, i);
+	table->stateHash[1] = HashBytes2(table->stateHash[1], name, len);
+	table->stateHash[1] = HashBytes2(table->stateHash[1], valueBytes, i);
+}
+
+/* Defines a symbol, replacing any earlier definition of the same
+   name.  The name need not be null terminated. */
+void DefineSym(SymTable* table, const char* name, unsigned len, long value)
+{
+	AddSymEntry(table, name, len, value, 0);
+}
+
+/* Defines a symbol that has no numeric value, such as a macro that
+   stands for a string.  "defined" finds it, but expressions cannot
+   use it. */
+void DefineSymNoValue(SymTable* table, const char* name, unsigned len)
+{
+	AddSymEntry(table, name, len, 0, SYMF_NO_VALUE);
+}
+
+/* Undefines a symbol.  This also hides a symbol of the parent
+   table. */
+void UndefSym(SymTable* table, const char* name, unsigned len)
+{
+	AddSymEntry(table, name, len, 0, SYMF_UNDEFINED);
+}
+
+/* Returns the current definition of a name, or NULL if the table does
+   not know it */
+static SymEntry* FindSymEntry(SymTable* table, const char* name,
+							  unsigned len)
+{
+	unsigned slot;
+	if (table->count == 0)
+		return NULL;
+	slot = FindSymSlot(table, name, len, HashBytes(2166136261UL, name, len));
+	if (table->slots[slot] == 0)
+		return NULL;
+	return &table->entries.d[table->slots[slot]-1];
+}
+
+/* Looks up the value of a symbol.  The name need not be null
+   terminated.  The table is passed as a "void*" so that this can be
+   used as the symbol function of EvalConstExpr() and of a parsing
+   context. */
+BOOL LookupSym(void* table, const char* name, unsigned len, long* pValue)
+{
+	SymTable* symTab;
+	SymEntry* entry;
+	symTab = (SymTable*)table;
+	entry = FindSymEntry(symTab, name, len);
+	if (entry == NULL)
+	{
+		if (symTab->parentLookup == NULL)
+			return FALSE;
+		return symTab->parentLookup(symTab->parentParam, name, len, pValue);
+	}
+	if (entry->flags != 0)
+		return FALSE;
+	*pValue = entry->value;
+	return TRUE;
+}
+
+/* Returns TRUE if a symbol is defined, with or without a value.  The
+   names of the parent table count if they have a value. */
+BOOL IsSymDefined(void* table, const char* name, unsigned len)
+{
+	SymTable* symTab;
+	SymEntry* entry;
+	long value;
+	symTab = (SymTable*)table;
+	entry = FindSymEntry(symTab, name, len);
+	if (entry == NULL)
+	{
+		if (symTab->parentLookup == NULL)
+			return FALSE;
+		return symTab->parentLookup(symTab->parentParam, name, len, &value);
+	}
+	return (BOOL)((entry->flags & SYMF_UNDEFINED) == 0);
+}
+
+/* Defines the standard dialog box button IDs */
+void AddStdSymbols(SymTable* table)
+{
+	unsigned i;
+	for (i = 0; i < NUM_STD_SYMBOLS; i++)
+		DefineSym(table, stdSymbols[i].name, strlen(stdSymbols[i].name),
+				  stdSymbols[i].value);
+}
+
+/* Scans the code of a line from "pos" to "end" for comments.
+   "pInComment" says whether "pos" is inside a block comment, and
+   receives whether the line ends inside one.  Returns the end of the
+   code before the first comment that starts on the line. */
+static unsigned ScanSymLine(const char* text, unsigned pos, unsigned end,
+							BOOL* pInComment)
+{
+	unsigned codeEnd;
+	codeEnd = end;
+	while (pos < end)
+	{
+		char c;
+		c = text[pos];
+		if (*pInComment == TRUE)
+		{
+			if (c == '*' && pos + 1 < end && text[pos+1] == '/')
+			{
+				*pInComment = FALSE;
+				pos++;
+			}
+			pos++;
+		}
+		else if (c == '"' || c == '\'')
+		{
+			/* Comment characters in quotes do not count */
+			for (pos++; pos < end && text[pos] != c; pos++)
+			{
+				if (text[pos] == '\\')
+					pos++;
+			}
+			pos++;
+		}
+		else if (c == '/' && pos + 1 < end &&
+				 (text[pos+1] == '/' || text[pos+1] == '*'))
+		{
+			if (codeEnd == end)
+				codeEnd = pos;
+			if (text[pos+1] == '/')
+				break;
+			*pInComment = TRUE;
+			pos += 2;
+		}
+		else
+			pos++;
+	}
+	return codeEnd;
+}
+
+/* Skips spaces and tabs */
+static unsigned SkipSymSpace(const char* text, unsigned pos, unsigned end)
+{
+	while (pos < end && (CHAR_CLASS(text[pos]) & CC_SPACE))
+		pos++;
+	return pos;
+}
+
+/* Reads the "#define" lines of a header and defines the symbols whose
+   values are constant expressions.  The values may use the symbols
+   that are already in the table.  Returns the number of symbols
+   defined. */
+unsigned ParseSymHeader(SymTable* table, const char* text, unsigned len)
+{
+	unsigned numDefined;
+	unsigned lineStart;
+	BOOL inComment;
+	BOOL continued;
+
+	numDefined = 0;
+	inComment = FALSE;
+	continued = FALSE;
+	lineStart = 0;
+	while (lineStart < len)
+	{
+		unsigned lineEnd, nextLine;
+		unsigned pos, nameStart, nameEnd, valueEnd;
+		BOOL wasContinued;
+		BOOL startsInComment;
+		long value;
+
+		for (lineEnd = lineStart; lineEnd < len && text[lineEnd] != '\n';
+			 lineEnd++);
+		nextLine = lineEnd + 1;
+		if (lineEnd > lineStart && text[lineEnd-1] == '\r')
+			lineEnd--;
+		wasContinued = continued;
+		startsInComment = inComment;
+		continued = (lineEnd > lineStart && text[lineEnd-1] == '\\');
+		valueEnd = ScanSymLine(text, lineStart, lineEnd, &inComment);
+		if (startsInComment == TRUE || wasContinued == TRUE)
+		{
+			/* Directives must start outside of comments, and the
+			   lines of a continued macro are skipped with it */
+			if (startsInComment == TRUE)
+				continued = FALSE;
+			lineStart = nextLine;
+			continue;
+		}
+		if (continued == TRUE)
+		{
+			lineStart = nextLine;
+			continue;
+		}
+
+		pos = SkipSymSpace(text, lineStart, valueEnd);
+		if (pos >= valueEnd || text[pos] != '#')
+		{
+			lineStart = nextLine;
+			continue;
+		}
+		pos = SkipSymSpace(text, pos + 1, valueEnd);
+		if (valueEnd - pos < 7 || memcmp(&text[pos], "define", 6) != 0 ||
+			!(CHAR_CLASS(text[pos+6]) & CC_SPACE))
+		{
+			lineStart = nextLine;
+			continue;
+		}
+		pos = SkipSymSpace(text, pos + 6, valueEnd);
+		nameStart = pos;
+		if (pos < valueEnd && CHAR_CLASS(text[pos]) == CC_ALPHA)
+		{
+			while (pos < valueEnd && (CHAR_CLASS(text[pos]) & CC_IDCHAR))
+				pos++;
+		}
+		nameEnd = pos;
+		/* Function-like macros have the parenthesis right after the
+		   name */
+		if (nameEnd == nameStart ||
+			(pos < valueEnd && text[pos] == '('))
+		{
+			lineStart = nextLine;
+			continue;
+		}
+		while (valueEnd > pos && (CHAR_CLASS(text[valueEnd-1]) & CC_SPACE))
+			valueEnd--;
+		pos = SkipSymSpace(text, pos, valueEnd);
+		if (pos < valueEnd &&
+			EvalConstExpr(&text[pos], valueEnd - pos, LookupSym, table,
+						  &value, NULL) == EXPR_OK)
+		{
+			DefineSym(table, &text[nameStart], nameEnd - nameStart, value);
+			numDefined++;
+		}
+		lineStart = nextLine;
+	}
+	return numDefined;
+}
+
+static void PutSym32(unsigned char* dest, unsigned long value)
+{
+	dest[0] = (unsigned char)(value & 0xff);
+	dest[1] = (unsigned char)((value >> 8) & 0xff);
+	dest[2] = (unsigned char)((value >> 16) & 0xff);
+	dest[3] = (unsigned char)((value >> 24) & 0xff);
+}
+
+static unsigned long GetSym32(const char* src)
+{
+	const unsigned char* bytes;
+	bytes = (const unsigned char*)src;
+	return (unsigned long)bytes[0] | ((unsigned long)bytes[1] << 8) |
+		((unsigned long)bytes[2] << 16) | ((unsigned long)bytes[3] << 24);
+}
+
+/* Returns the signed value of a 32-bit pattern */
+static long SymValueFromBits(unsigned long bits)
+{
+	if (bits & 0x80000000UL)
+		return -(long)(~bits & 0x7fffffffUL) - 1;
+	return (long)bits;
+}
+
+/* Defines the symbols of a cache file, if it is intact and belongs to
+   the given key.  Nothing is defined if it does not. */
+static BOOL ReadSymCache(SymTable* table, const char* cacheName,
+						 const unsigned long* key, unsigned headerSize)
+{
+	TmplFileMap map;
+	unsigned numSyms;
+	unsigned pass;
+	unsigned pos;
+	unsigned i;
+
+	if (!MapTmplFile(&map, cacheName))
+		return FALSE;
+	if (map.size < SYM_CACHE_HEAD_LEN ||
+		memcmp(map.data, SYM_CACHE_MAGIC, SYM_CACHE_MAGIC_LEN) != 0 ||
+		GetSym32(&map.data[8]) != key[0] ||
+		GetSym32(&map.data[12]) != key[1] ||
+		GetSym32(&map.data[16]) != headerSize)
+	{
+		UnmapTmplFile(&map);
+		return FALSE;
+	}
+	numSyms = (unsigned)GetSym32(&map.data[20]);
+
+	/* Check the whole file before defining anything */
+	for (pass = 0; pass < 2; pass++)
+	{
+		pos = SYM_CACHE_HEAD_LEN;
+		for (i = 0; i < numSyms; i++)
+		{
+			unsigned long nameLen;
+			if (map.size - pos < 8)
+				break;
+			nameLen = GetSym32(&map.data[pos+4]);
+			if (nameLen == 0 || nameLen > map.size - pos - 8)
+				break;
+			if (pass == 1)
+				DefineSym(table, &map.data[pos+8], (unsigned)nameLen,
+						  SymValueFromBits(GetSym32(&map.data[pos])));
+			pos += 8 + (unsigned)nameLen;
+		}
+		if (i < numSyms || pos != map.size)
+		{
+			UnmapTmplFile(&map);
+			return FALSE;
+		}
+	}
+	UnmapTmplFile(&map);
+	return TRUE;
+}
+
+/* Writes the definitions from "firstEntry" on into a cache file.  The
+   file is written under a temporary name and then renamed, so that
+   other processes never read a partial file.  Returns FALSE if it
+   could not be written. */
+static BOOL WriteSymCache(SymTable* table, const char* cacheName,
+						  const unsigned long* key, unsigned headerSize,
+						  unsigned firstEntry)
+{
+	unsigned char head[SYM_CACHE_HEAD_LEN];
+	char* tempName;
+	FILE* fp;
+	BOOL ok;
+	unsigned i;
+
+	tempName = (char*)xmalloc(strlen(cacheName) + 5);
+	sprintf(tempName, "%s.tmp", cacheName);
+	fp = fopen(tempName, "wb");
+	if (fp == NULL)
+	{
+		xfree(tempName);
+		return FALSE;
+	}
+	memcpy(head, SYM_CACHE_MAGIC, SYM_CACHE_MAGIC_LEN);
+	PutSym32(&head[8], key[0]);
+	PutSym32(&head[12], key[1]);
+	PutSym32(&head[16], headerSize);
+	PutSym32(&head[20], table->entries.len - firstEntry);
+	ok = (fwrite(head, 1, SYM_CACHE_HEAD_LEN, fp) == SYM_CACHE_HEAD_LEN);
+	for (i = firstEntry; ok == TRUE && i < table->entries.len; i++)
+	{
+		SymEntry* entry;
+		unsigned char symHead[8];
+		entry = &table->entries.d[i];
+		PutSym32(&symHead[0], (unsigned long)entry->value);
+		PutSym32(&symHead[4], entry->nameLen);
+		ok = (fwrite(symHead, 1, 8, fp) == 8 &&
+			  fwrite(entry->name, 1, entry->nameLen, fp) == entry->nameLen);
+	}
+	if (fclose(fp) != 0)
+		ok = FALSE;
+	if (ok == TRUE && rename(tempName, cacheName) != 0)
+	{
+		/* Some systems do not rename over an existing file */
+		remove(cacheName);
+		ok = (rename(tempName, cacheName) == 0);
+	}
+	if (ok == FALSE)
+		remove(tempName);
+	xfree(tempName);
+	return ok;
+}
+
+/* Reads the symbols of a header file into the table.  If "cacheDir"
+   is not NULL, the symbols are read from the cache in that directory
+   when the header has been read before with the same symbols already
+   defined, and the cache is written otherwise.  The directory must
+   exist.  A cache that cannot be written is not an error.  Returns
+   FALSE if the header cannot be read. */
+BOOL LoadSymHeader(SymTable* table, const char* filename,
+				   const char* cacheDir)
+{
+	TmplFileMap map;
+	unsigned long key[2];
+	char* cacheName;
+	unsigned firstEntry;
+
+	if (!MapTmplFile(&map, filename))
+		return FALSE;
+	if (cacheDir == NULL)
+	{
+		ParseSymHeader(table, map.data, map.size);
+		UnmapTmplFile(&map);
+		return TRUE;
+	}
+
+	key[0] = HashBytes(table->stateHash[0], map.data, map.size);
+	key[1] = HashBytes2(table->stateHash[1], map.data, map.size);
+	cacheName = (char*)xmalloc(strlen(cacheDir) + 1 + 16 + 5);
+	sprintf(cacheName, "%s/%08lx%08lx.sym", cacheDir, key[0], key[1]);
+	if (!ReadSymCache(table, cacheName, key, map.size))
+	{
+		firstEntry = table->entries.len;
+		ParseSymHeader(table, map.data, map.size);
+		WriteSymCache(table, cacheName, key, map.size, firstEntry);
+	}
+	xfree(cacheName);
+	UnmapTmplFile(&map);
+	return TRUE;
+}
@@ -0,0 +1,68 @@
+/* Preprocessor symbol tables.  The numeric "#define NAME value"
+   symbols of headers such as resource.h are read once into a hash
+   table, which is only read afterwards, so all of the templates of a
+   batch run can share one table between threads.  The symbols of a
+   header can be cached on disk under the hash of its contents, so
+   that a header that has not changed is not parsed again.
+
+   A table can also follow the "#define" and "#undef" lines of a
+   template file as the preprocessor reads them (see rcpp.h).  Such a
+   table records the names that are defined without a value and the
+   names that are undefined, and it can fall back on a parent table
+   for the names that it does not know. */
+
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include "tmplparser.h"
+#include "strarena.h"
+
+struct SymEntry_t
+{
+	const char* name; /* Null terminated copy */
+	unsigned nameLen;
+	unsigned long hash;
+	long value;
+	unsigned flags;
+};
+
+typedef struct SymEntry_t SymEntry;
+
+/* Bits of SymEntry.flags */
+#define SYMF_NO_VALUE	0x01 /* Defined, but not as a number */
+#define SYMF_UNDEFINED	0x02 /* Hides the name, see UndefSym() */
+
+EA_TYPE(SymEntry);
+
+struct SymTable_t
+{
+	/* Every definition in order.  A redefinition adds a new entry
+	   that takes the place of the old one in the hash table. */
+	SymEntry_array entries;
+	unsigned* slots; /* Entry number plus one, or zero if unused */
+	unsigned numSlots; /* Zero or a power of two */
+	unsigned count; /* Number of distinct names */
+	StrArena names;
+	/* Running hashes of all of the definitions, which make the cache
+	   key of a header depend on the symbols its values can use */
+	unsigned long stateHash[2];
+	/* Looks up the names that the table does not know, or NULL */
+	ExprSymbolFunc parentLookup;
+	void* parentParam;
+};
+
+typedef struct SymTable_t SymTable;
+
+void InitSymTable(SymTable* table);
+void FreeSymTable(SymTable* table);
+void DefineSym(SymTable* table, const char* name, unsigned len, long value);
+void DefineSymNoValue(SymTable* table, const char* name, unsigned len);
+void UndefSym(SymTable* table, const char* name, unsigned len);
+BOOL LookupSym(void* table, const char* name, unsigned len, long* pValue);
+BOOL IsSymDefined(void* table, const char* name, unsigned len);
+void AddStdSymbols(SymTable* table);
+unsigned ParseSymHeader(SymTable* table, const char* text, unsigned len);
+BOOL LoadSymHeader(SymTable* table, const char* filename,
+				   const char* cacheDir);
+
+#endif /* not SYMTAB_H */
@@ -0,0 +1,253 @@
+/* Dialog template file loading and saving.
+
+   This is platform independent code.  Files are memory mapped for
+   loading where the system supports it, and read with the standard C
+   library otherwise, so it can be used by both the dialog editor and
+   the command-line tools. */
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+
+#include "xmalloc.h"
+#include "tmplparser.h"
+#include "tmplfile.h"
+#include "dlgprof.h"
+
+/* MSVC >= 8.0 pragmas */
+#if _MSC_VER >= 1400
+#pragma warning (disable: 4996) /* Disable deprecate */
+#pragma warning (disable: 4267) /* Disable size_t warnings */
+#endif
+
+static BOOL ReadTmplFile(TmplFileMap* map, const char* filename);
+static BOOL ProfMapTmplFile(TmplFileMap* map, const char* filename);
+
+/* Reads the whole file into the heap.  This is used when the file
+   cannot be memory mapped, such as for pipes. */
+static BOOL ReadTmplFile(TmplFileMap* map, const char* filename)
+{
+	char* buffer;
+	unsigned bufSize;
+	unsigned dataSize;
+	size_t numRead;
+	FILE* fp;
+
+	fp = fopen(filename, "rb");
+	if (fp == NULL)
+		return FALSE;
+	bufSize = 4096;
+	dataSize = 0;
+	buffer = (char*)xmalloc(bufSize);
+	while ((numRead = fread(&buffer[dataSize], 1, bufSize - dataSize, fp)) > 0)
+	{
+		dataSize += numRead;
+		if (dataSize == bufSize)
+		{
+			bufSize *= 2;
+			buffer = (char*)xrealloc(buffer, bufSize);
+		}
+	}
+	if (ferror(fp))
+	{
+		xfree(buffer);
+		fclose(fp);
+		return FALSE;
+	}
+	fclose(fp);
+	if (dataSize == 0)
+	{
+		xfree(buffer);
+		buffer = "";
+	}
+	map->data = buffer;
+	map->size = dataSize;
+	map->isMapped = FALSE;
+	return TRUE;
+}
+
+/* Maps the given file into memory for reading.  Returns FALSE if the
+   file could not be read.  UnmapTmplFile() MUST be called on success
+   to release the mapping. */
+BOOL MapTmplFile(TmplFileMap* map, const char* filename)
+{
+#ifdef _WIN32
+	DWORD fileSize, sizeHigh;
+	map->hFile = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+							OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	map->hMapping = NULL;
+	if (map->hFile == INVALID_HANDLE_VALUE)
+		return FALSE;
+	fileSize = GetFileSize(map->hFile, &sizeHigh);
+	if (fileSize == INVALID_FILE_SIZE || sizeHigh != 0)
+	{
+		CloseHandle(map->hFile);
+		return FALSE;
+	}
+	if (fileSize == 0)
+	{
+		/* Empty files cannot be mapped */
+		CloseHandle(map->hFile);
+		map->data = "";
+		map->size = 0;
+		map->isMapped = FALSE;
+		return TRUE;
+	}
+	map->hMapping = CreateFileMapping(map->hFile, NULL, PAGE_READONLY,
+									  0, 0, NULL);
+	if (map->hMapping != NULL)
+		map->data = (const char*)MapViewOfFile(map->hMapping, FILE_MAP_READ,
+											   0, 0, 0);
+	if (map->hMapping == NULL || map->data == NULL)
+	{
+		if (map->hMapping != NULL)
+			CloseHandle(map->hMapping);
+		CloseHandle(map->hFile);
+		return ReadTmplFile(map, filename);
+	}
+	map->size = fileSize;
+	map->isMapped = TRUE;
+	return TRUE;
+#else
+	struct stat st;
+	void* mem;
+	int fd;
+	fd = open(filename, O_RDONLY);
+	if (fd == -1)
+		return FALSE;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+		(unsigned long)st.st_size > (unsigned)-1)
+	{
+		/* Let the fallback handle special files */
+		close(fd);
+		return ReadTmplFile(map, filename);
+	}
+	if (st.st_size == 0)
+	{
+		/* Empty files cannot be mapped */
+		close(fd);
+		map->data = "";
+		map->size = 0;
+		map->isMapped = FALSE;
+		return TRUE;
+	}
+	mem = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); /* The mapping keeps its own reference */
+	if (mem == MAP_FAILED)
+		return ReadTmplFile(map, filename);
+#ifdef MADV_SEQUENTIAL
+	madvise(mem, st.st_size, MADV_SEQUENTIAL);
+#endif
+	map->data = (const char*)mem;
+	map->size = (unsigned)st.st_size;
+	map->isMapped = TRUE;
+	return TRUE;
+#endif
+}
+
+/* MapTmplFile(), profiled as the read phase.  Mapped files are only
+   read from the disk when their pages are first touched, so much of
+   the reading time of a mapped file shows up in the parsing
+   phases. */
+static BOOL ProfMapTmplFile(TmplFileMap* map, const char* filename)
+{
+	ProfMark mark;
+	BOOL retVal;
+	ProfBegin(&mark);
+	retVal = MapTmplFile(map, filename);
+	ProfEnd(&mark, PROF_READ, retVal ? map->size : 0);
+	return retVal;
+}
+
+void UnmapTmplFile(TmplFileMap* map)
+{
+	if (map->isMapped == TRUE)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(map->data);
+		CloseHandle(map->hMapping);
+		CloseHandle(map->hFile);
+#else
+		munmap((void*)map->data, map->size);
+#endif
+	}
+	else if (map->size != 0)
+		xfree((char*)map->data);
+	/* Unmapping twice is harmless */
+	map->data = NULL;
+	map->size = 0;
+	map->isMapped = FALSE;
+}
+
+/* Reads and parses the given dialog template file into the context's
+   dialog template.  If the file could not be read, "ctx->curLine" is
+   left at zero; otherwise, on a parse error, it holds the line number
+   of the error. */
+BOOL LoadDlgTemplateFile(ParseCtx* ctx, const char* filename)
+{
+	TmplFileMap map;
+	BOOL retVal;
+
+	/* Map the file */
+	ctx->curLine = 0;
+	ctx->errorDesc = "Could not read the file.";
+	if (!ProfMapTmplFile(&map, filename))
+		return FALSE;
+
+	/* The parser accepts any line endings and does not write to the
+	   buffer, so the file is parsed where it lies.  Quoted "#include"
+	   files are looked for next to it. */
+	ctx->srcName = filename;
+	retVal = ParseDlgTemplate(ctx, map.data, map.size);
+	UnmapTmplFile(&map);
+	return retVal;
+}
+
+/* Like LoadDlgTemplateFile(), but the control fields are only
+   decoded when they are first read (see ParseCtx.lazyFields).  On
+   success, the file stays mapped in "map", because the dialog
+   template refers to it.  Call DecodeDlgFields() or FreeDlgData()
+   before UnmapTmplFile(), and do not write to the file while it is
+   mapped.  On failure, the file is already unmapped. */
+BOOL LoadDlgTemplateLazy(ParseCtx* ctx, TmplFileMap* map,
+						 const char* filename)
+{
+	ctx->curLine = 0;
+	ctx->errorDesc = "Could not read the file.";
+	if (!ProfMapTmplFile(map, filename))
+		return FALSE;
+
+	ctx->lazyFields = TRUE;
+	ctx->srcName = filename;
+	if (!ParseDlgTemplate(ctx, map->data, map->size))
+	{
+		UnmapTmplFile(map);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* Writes the context's dialog template to the given file.  The file
+   gets the same line endings as the file that the template was loaded
+   from. */
+BOOL SaveDlgTemplateFile(ParseCtx* ctx, const char* filename)
+{
+	FILE* fp;
+	BOOL retVal;
+
+	fp = fopen(filename, "wb");
+	if (fp == NULL)
+		return FALSE;
+	retVal = WriteDlgTemplate(ctx, fp);
+	if (fclose(fp) != 0)
+		retVal = FALSE;
+	return retVal;
+}
@@ -0,0 +1,31 @@
+/* Dialog template file loading and saving. */
+
+#ifndef TMPLFILE_H
+#define TMPLFILE_H
+
+#include "tmplparser.h"
+
+/* A read-only view of a whole file's contents.  The data is memory
+   mapped when possible, so it is not null terminated. */
+struct TmplFileMap_t
+{
+	const char* data;
+	unsigned size;
+	/* Private fields */
+	BOOL isMapped; /* FALSE if "data" was read into the heap */
+#ifdef _WIN32
+	HANDLE hFile;
+	HANDLE hMapping;
+#endif
+};
+
+typedef struct TmplFileMap_t TmplFileMap;
+
+BOOL MapTmplFile(TmplFileMap* map, const char* filename);
+void UnmapTmplFile(TmplFileMap* map);
+BOOL LoadDlgTemplateFile(ParseCtx* ctx, const char* filename);
+BOOL LoadDlgTemplateLazy(ParseCtx* ctx, TmplFileMap* map,
+						 const char* filename);
+BOOL SaveDlgTemplateFile(ParseCtx* ctx, const char* filename);
+
+#endif /* not TMPLFILE_H */
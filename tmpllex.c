@@ -0,0 +1,536 @@
+/* Dialog template lexer.
+
+   This is platform independent code.  The lexer never writes to the
+   source buffer and never reads past "dataSize", so it can run
+   directly on a memory mapped file.
+
+   Comments and preprocessor lines are skipped like whitespace, so
+   the parser never sees them.  The preprocessor (rcpp.c) reads the
+   preprocessor lines with NextTmplDirective() instead, and gives the
+   lexer the ranges of the lines that its conditions leave out. */
+
+#include <string.h>
+
+#include "tmpllex.h"
+
+/* MSVC >= 8.0 pragmas */
+#if _MSC_VER >= 1400
+#pragma warning (disable: 4996) /* Disable deprecate */
+#pragma warning (disable: 4267) /* Disable size_t warnings */
+#endif
+
+#define OT 0
+#define SP CC_SPACE
+#define NL CC_NL
+#define ID CC_ALPHA
+#define DG CC_DIGIT
+#define QT CC_QUOTE
+#define PU CC_PUNCT
+
+const unsigned char tmplCharClass[256] = {
+	OT, OT, OT, OT, OT, OT, OT, OT, OT, SP, NL, SP, SP, NL, OT, OT,
+	OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT,
+	SP, PU, QT, OT, OT, OT, PU, OT, PU, PU, PU, PU, PU, PU, OT, PU,
+	DG, DG, DG, DG, DG, DG, DG, DG, DG, DG, OT, OT, OT, OT, OT, OT,
+	OT, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID,
+	ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, OT, OT, OT, PU, ID,
+	OT, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID,
+	ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, PU, PU, PU, PU, OT,
+	OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT,
+	OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT,
+	OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT,
+	OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT,
+	OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT,
+	OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT,
+	OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT,
+	OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT};
+
+#undef OT
+#undef SP
+#undef NL
+#undef ID
+#undef DG
+#undef QT
+#undef PU
+
+/* Must be in the same order as enum RcKeyword */
+static const char* rcKeywords[NUM_RC_KEYWORDS] = {
+	"",
+	"ACCELERATORS", "AUTO3STATE", "AUTOCHECKBOX", "AUTORADIOBUTTON",
+	"BEGIN", "BITMAP", "CAPTION", "CHARACTERISTICS", "CHECKBOX",
+	"CLASS", "COMBOBOX", "CONTROL", "CTEXT", "CURSOR",
+	"DEFPUSHBUTTON", "DIALOG", "DIALOGEX", "DISCARDABLE", "EDITTEXT",
+	"END", "EXSTYLE", "FIXED", "FONT", "GROUPBOX", "ICON",
+	"IMPURE", "LANGUAGE", "LISTBOX", "LOADONCALL", "LTEXT", "MENU",
+	"MENUEX", "MENUITEM", "MESSAGETABLE", "MOVEABLE", "NOT",
+	"POPUP", "PRELOAD", "PURE", "PUSHBOX", "PUSHBUTTON",
+	"RADIOBUTTON", "RCDATA", "RTEXT", "SCROLLBAR", "STATE3",
+	"STRINGTABLE", "STYLE", "VERSION", "VERSIONINFO"};
+
+/* Perfect hash of the keywords.  Bits 8 to 15 of the multiplicative
+   hash below are different for every keyword; the multiplier was
+   found by searching the odd numbers for the first one without
+   collisions.  The table maps each hash value to a keyword, with zero
+   for unused slots.  If you change the keyword list, you will have to
+   search for a new multiplier and rebuild the table. */
+#define KW_HASH_MULT 345
+#define KW_HASH(h) (((h) >> 8) & 0xff)
+
+static const unsigned char kwHashTable[256] = {
+	18,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 47,
+	 0,  0,  0,  0, 36,  0,  0,  0, 29,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  9,  0, 11,  0, 46,  0,  0,  5,  0,  0,
+	 0, 45,  0,  0,  0,  0,  0,  0,  0,  0, 38,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0, 21,  0,  0, 48,  0, 39,  0,  0,
+	 0, 49,  0,  0,  0,  0,  0, 35,  0,  0,  0, 34,  0,  0, 16,  0,
+	 0,  0,  0,  0, 26,  6, 22,  0,  0, 43,  0,  0,  0,  0,  0,  0,
+	 0, 17,  0,  0, 30,  0,  0,  0,  0,  0, 31,  0,  0,  0,  0,  0,
+	 0,  2,  0,  0,  3, 44, 50, 25,  0,  0,  0,  4,  0,  0, 37, 33,
+	12,  0, 23,  8,  0,  0,  0, 32,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0, 41, 24,  0,  0,  0,  0,  0,  0, 40, 42, 19,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0, 14,  0,  0, 20,  0,  0,  0,  0,  0,
+	 0,  0,  0,  1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0, 15,  0,  0,  0,  0,  0,  0,  0,  0, 13,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0, 10,  0,  0,  7,  0,  0,  0,
+	 0,  0,  0, 27,  0,  0,  0,  0,  0,  0,  0,  0,  0, 28,  0,  0};
+
+/* The longest keyword is "CHARACTERISTICS" */
+#define MAX_KEYWORD_LEN 15
+
+/* Returns the keyword that the given identifier spells, or KW_NONE.
+   Keywords are case sensitive. */
+int LookupRcKeyword(const char* str, unsigned len)
+{
+	unsigned long h;
+	const char* kwName;
+	int keyword;
+	unsigned i;
+
+	if (len > MAX_KEYWORD_LEN)
+		return KW_NONE;
+	h = 0;
+	for (i = 0; i < len; i++)
+		h = (h * KW_HASH_MULT + (unsigned char)str[i]) & 0xffffffffUL;
+	keyword = kwHashTable[KW_HASH(h)];
+	if (keyword == KW_NONE)
+		return KW_NONE;
+	kwName = rcKeywords[keyword];
+	if (strncmp(kwName, str, len) != 0 || kwName[len] != '\0')
+		return KW_NONE;
+	return keyword;
+}
+
+const char* RcKeywordName(int keyword)
+{
+	if (keyword < 0 || keyword >= NUM_RC_KEYWORDS)
+		return "";
+	return rcKeywords[keyword];
+}
+
+/* Prepares a lexer to read "buffer" starting at "curPos", which is
+   taken to be on line "curLine".  "dataSize" specifies the length of
+   the data in the buffer, which need not be null terminated. */
+void InitTmplLexer(TmplLexer* lex, const char* buffer, unsigned dataSize,
+				   unsigned curPos, unsigned curLine)
+{
+	lex->buffer = buffer;
+	lex->dataSize = dataSize;
+	lex->curPos = curPos;
+	lex->curLine = curLine;
+	/* Find the start of the line for column numbers */
+	lex->lineStart = curPos;
+	while (lex->lineStart > 0 &&
+		   CHAR_CLASS(buffer[lex->lineStart-1]) != CC_NL)
+		lex->lineStart--;
+	lex->skips = NULL;
+	lex->numSkips = 0;
+	lex->nextSkip = 0;
+}
+
+/* Moves past the line break at "pos", which may be CR+LF */
+static unsigned SkipTmplNewline(TmplLexer* lex, unsigned pos)
+{
+	if (lex->buffer[pos] == '\r' && pos + 1 < lex->dataSize &&
+		lex->buffer[pos+1] == '\n')
+		pos++;
+	pos++;
+	lex->curLine++;
+	lex->lineStart = pos;
+	return pos;
+}
+
+/* Skips the block comment at "pos".  A comment without an end runs to
+   the end of the buffer. */
+static unsigned SkipTmplComment(TmplLexer* lex, unsigned pos)
+{
+	const char* buffer;
+	unsigned dataSize;
+	buffer = lex->buffer;
+	dataSize = lex->dataSize;
+	pos += 2;
+	while (pos < dataSize)
+	{
+		if (buffer[pos] == '*' && pos + 1 < dataSize && buffer[pos+1] == '/')
+			return pos + 2;
+		if (CHAR_CLASS(buffer[pos]) == CC_NL)
+			pos = SkipTmplNewline(lex, pos);
+		else
+			pos++;
+	}
+	return pos;
+}
+
+/* Skips the line comment at "pos", up to the line break */
+static unsigned SkipTmplLineComment(TmplLexer* lex, unsigned pos)
+{
+	while (pos < lex->dataSize && CHAR_CLASS(lex->buffer[pos]) != CC_NL)
+		pos++;
+	return pos;
+}
+
+/* Skips the string at "pos" the same way that NextTmplToken() reads
+   strings */
+static unsigned SkipTmplString(TmplLexer* lex, unsigned pos)
+{
+	const char* buffer;
+	unsigned dataSize;
+	buffer = lex->buffer;
+	dataSize = lex->dataSize;
+	pos++;
+	while (pos < dataSize && buffer[pos] != '"' &&
+		   CHAR_CLASS(buffer[pos]) != CC_NL)
+	{
+		if (buffer[pos] == '\\' && pos + 1 < dataSize &&
+			CHAR_CLASS(buffer[pos+1]) != CC_NL)
+			pos++;
+		pos++;
+	}
+	if (pos < dataSize && buffer[pos] == '"')
+		pos++;
+	return pos;
+}
+
+/* Returns the end of the preprocessor line at "pos", which is its
+   line break or the end of the buffer.  A line that ends with a
+   backslash goes on to the next line, and so does a block comment.
+   Quoted file names are skipped, so that a slash and star in them do
+   not start a comment. */
+static unsigned SkipTmplDirective(TmplLexer* lex, unsigned pos)
+{
+	const char* buffer;
+	unsigned dataSize;
+	buffer = lex->buffer;
+	dataSize = lex->dataSize;
+	while (pos < dataSize)
+	{
+		char c;
+		c = buffer[pos];
+		if (CHAR_CLASS(c) == CC_NL)
+		{
+			if (pos == 0 || buffer[pos-1] != '\\')
+				break;
+			pos = SkipTmplNewline(lex, pos);
+		}
+		else if (c == '/' && pos + 1 < dataSize && buffer[pos+1] == '*')
+			pos = SkipTmplComment(lex, pos);
+		else if (c == '/' && pos + 1 < dataSize && buffer[pos+1] == '/')
+			pos = SkipTmplLineComment(lex, pos);
+		else if (c == '"')
+		{
+			for (pos++; pos < dataSize && buffer[pos] != '"' &&
+					 CHAR_CLASS(buffer[pos]) != CC_NL; pos++);
+			if (pos < dataSize && buffer[pos] == '"')
+				pos++;
+		}
+		else
+			pos++;
+	}
+	return pos;
+}
+
+/* Jumps over the skipped range that starts at "pos", counting its
+   lines */
+static unsigned SkipTmplRange(TmplLexer* lex, unsigned pos)
+{
+	unsigned end;
+	end = lex->skips[lex->nextSkip].end;
+	lex->nextSkip++;
+	if (end > lex->dataSize)
+		end = lex->dataSize;
+	while (pos < end)
+	{
+		if (CHAR_CLASS(lex->buffer[pos]) == CC_NL)
+			pos = SkipTmplNewline(lex, pos);
+		else
+			pos++;
+	}
+	return pos;
+}
+
+/* Makes the lexer skip the given ranges of the source, which must be
+   in source order and must not overlap.  The ranges must stay valid
+   while the lexer (or any copy of it) is used. */
+void SetTmplLexerSkips(TmplLexer* lex, const TmplSkip* skips,
+					   unsigned numSkips)
+{
+	unsigned lo, hi;
+	lex->skips = skips;
+	lex->numSkips = numSkips;
+	/* Find the first range that is still ahead */
+	lo = 0;
+	hi = numSkips;
+	while (lo < hi)
+	{
+		unsigned mid;
+		mid = lo + (hi - lo) / 2;
+		if (skips[mid].start < lex->curPos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	lex->nextSkip = lo;
+	/* A lexer that starts right at a range skips it at once */
+	if (lo < numSkips && skips[lo].start == lex->curPos &&
+		lex->curPos == lex->lineStart)
+		lex->curPos = SkipTmplRange(lex, lex->curPos);
+}
+
+/* Reads the next token.  At the end of the buffer, this returns
+   TOK_EOF tokens forever. */
+void NextTmplToken(TmplLexer* lex, TmplToken* tok)
+{
+	const char* buffer;
+	unsigned dataSize;
+	unsigned curPos;
+	unsigned charClass;
+
+	buffer = lex->buffer;
+	dataSize = lex->dataSize;
+	curPos = lex->curPos;
+	tok->flags = (curPos == lex->lineStart) ? TOKF_BOL : 0;
+
+	/* Skip whitespace, newlines, comments, and preprocessor lines */
+	while (curPos < dataSize)
+	{
+		charClass = CHAR_CLASS(buffer[curPos]);
+		if (charClass == CC_SPACE)
+			curPos++;
+		else if (charClass == CC_NL)
+		{
+			curPos = SkipTmplNewline(lex, curPos);
+			tok->flags |= TOKF_BOL;
+			/* Skipped ranges start at the start of a line */
+			if (lex->nextSkip < lex->numSkips &&
+				lex->skips[lex->nextSkip].start == curPos)
+				curPos = SkipTmplRange(lex, curPos);
+		}
+		else if (buffer[curPos] == '/' && curPos + 1 < dataSize &&
+				 buffer[curPos+1] == '*')
+		{
+			unsigned oldLine;
+			oldLine = lex->curLine;
+			curPos = SkipTmplComment(lex, curPos);
+			if (lex->curLine != oldLine)
+				tok->flags |= TOKF_BOL;
+		}
+		else if (buffer[curPos] == '/' && curPos + 1 < dataSize &&
+				 buffer[curPos+1] == '/')
+			curPos = SkipTmplLineComment(lex, curPos);
+		else if (buffer[curPos] == '#' && (tok->flags & TOKF_BOL))
+			curPos = SkipTmplDirective(lex, curPos);
+		else
+			break;
+	}
+
+	tok->keyword = KW_NONE;
+	tok->str = &buffer[curPos];
+	tok->pos = curPos;
+	tok->line = lex->curLine;
+	tok->col = curPos - lex->lineStart + 1;
+	if (curPos >= dataSize)
+	{
+		tok->type = TOK_EOF;
+		tok->len = 0;
+		lex->curPos = curPos;
+		return;
+	}
+
+	charClass = CHAR_CLASS(buffer[curPos]);
+	if (charClass & CC_IDCHAR)
+	{
+		/* Numbers keep their suffixes, such as in "0x1FL" */
+		tok->type = (charClass == CC_DIGIT) ? TOK_NUMBER : TOK_IDENT;
+		curPos++;
+		while (curPos < dataSize && (CHAR_CLASS(buffer[curPos]) & CC_IDCHAR))
+			curPos++;
+		tok->len = curPos - tok->pos;
+		if (tok->type == TOK_IDENT)
+			tok->keyword = LookupRcKeyword(tok->str, tok->len);
+	}
+	else if (charClass == CC_QUOTE)
+	{
+		/* Strings may not span lines */
+		tok->type = TOK_STRING;
+		curPos++;
+		for (;;)
+		{
+			while (curPos < dataSize && buffer[curPos] != '"' &&
+				   CHAR_CLASS(buffer[curPos]) != CC_NL)
+			{
+				/* Skip escaped quotation marks */
+				if (buffer[curPos] == '\\' && curPos + 1 < dataSize &&
+					CHAR_CLASS(buffer[curPos+1]) != CC_NL)
+					curPos++;
+				curPos++;
+			}
+			if (curPos >= dataSize || buffer[curPos] != '"')
+			{
+				tok->flags |= TOKF_UNTERMINATED;
+				break;
+			}
+			curPos++;
+			/* A doubled quotation mark stands for one quotation mark
+			   and does not end the string */
+			if (curPos >= dataSize || buffer[curPos] != '"')
+				break;
+			curPos++;
+		}
+		tok->len = curPos - tok->pos;
+	}
+	else
+	{
+		tok->type = (charClass == CC_PUNCT) ? TOK_PUNCT : TOK_OTHER;
+		curPos++;
+		tok->len = 1;
+	}
+	lex->curPos = curPos;
+}
+
+/* Reads the next token without moving past it. */
+void PeekTmplToken(TmplLexer* lex, TmplToken* tok)
+{
+	TmplLexer saveLex;
+	saveLex = *lex;
+	NextTmplToken(&saveLex, tok);
+}
+
+/* Finds the next preprocessor line: a line whose first character,
+   other than whitespace and comments, is '#'.  A '#' in a string or
+   a comment does not count.  Returns FALSE at the end of the buffer.
+   Otherwise, "tok" receives the whole line, without its line break,
+   as a TOK_DIRECTIVE token, and the lexer is left at the end of the
+   line. */
+BOOL NextTmplDirective(TmplLexer* lex, TmplToken* tok)
+{
+	const char* buffer;
+	unsigned dataSize;
+	unsigned curPos;
+	BOOL atBol;
+
+	buffer = lex->buffer;
+	dataSize = lex->dataSize;
+	curPos = lex->curPos;
+	atBol = (BOOL)(curPos == lex->lineStart);
+	while (curPos < dataSize)
+	{
+		unsigned charClass;
+		char c;
+		c = buffer[curPos];
+		charClass = CHAR_CLASS(c);
+		if (charClass == CC_NL)
+		{
+			curPos = SkipTmplNewline(lex, curPos);
+			atBol = TRUE;
+		}
+		else if (charClass == CC_SPACE)
+			curPos++;
+		else if (c == '/' && curPos + 1 < dataSize && buffer[curPos+1] == '*')
+			curPos = SkipTmplComment(lex, curPos);
+		else if (c == '/' && curPos + 1 < dataSize && buffer[curPos+1] == '/')
+			curPos = SkipTmplLineComment(lex, curPos);
+		else if (c == '#' && atBol == TRUE)
+		{
+			tok->type = TOK_DIRECTIVE;
+			tok->keyword = KW_NONE;
+			tok->str = &buffer[curPos];
+			tok->pos = curPos;
+			tok->line = lex->curLine;
+			tok->col = curPos - lex->lineStart + 1;
+			tok->flags = TOKF_BOL;
+			curPos = SkipTmplDirective(lex, curPos);
+			tok->len = curPos - tok->pos;
+			lex->curPos = curPos;
+			return TRUE;
+		}
+		else if (charClass == CC_QUOTE)
+		{
+			curPos = SkipTmplString(lex, curPos);
+			atBol = FALSE;
+		}
+		else
+		{
+			curPos++;
+			atBol = FALSE;
+		}
+	}
+	lex->curPos = curPos;
+	return FALSE;
+}
+
+/* Skips whitespace, comments, and line continuations in a
+   preprocessor line */
+static unsigned SkipDirectiveSpace(const char* str, unsigned pos,
+								   unsigned end)
+{
+	while (pos < end)
+	{
+		if (CHAR_CLASS(str[pos]) & (CC_SPACE | CC_NL))
+			pos++;
+		else if (str[pos] == '\\' && pos + 1 < end &&
+				 CHAR_CLASS(str[pos+1]) == CC_NL)
+			pos++;
+		else if (str[pos] == '/' && pos + 1 < end && str[pos+1] == '*')
+		{
+			for (pos += 2; pos < end &&
+					 !(str[pos] == '*' && pos + 1 < end && str[pos+1] == '/');
+				 pos++);
+			pos += 2;
+		}
+		else
+			break;
+	}
+	return (pos < end) ? pos : end;
+}
+
+/* Splits a TOK_DIRECTIVE token into its parts */
+void ReadTmplDirective(const TmplToken* tok, TmplDirective* dir)
+{
+	const char* str;
+	unsigned pos, end;
+
+	str = tok->str;
+	end = tok->len;
+	while (end > 1 && (CHAR_CLASS(str[end-1]) & (CC_SPACE | CC_NL)))
+		end--;
+	pos = SkipDirectiveSpace(str, 1, end);
+	dir->name = &str[pos];
+	while (pos < end && (CHAR_CLASS(str[pos]) & CC_IDCHAR))
+		pos++;
+	dir->nameLen = &str[pos] - dir->name;
+	pos = SkipDirectiveSpace(str, pos, end);
+	dir->arg = &str[pos];
+	dir->argLen = end - pos;
+
+	dir->macro = &str[pos];
+	if (pos < end && CHAR_CLASS(str[pos]) == CC_ALPHA)
+	{
+		while (pos < end && (CHAR_CLASS(str[pos]) & CC_IDCHAR))
+			pos++;
+	}
+	dir->macroLen = &str[pos] - dir->macro;
+	dir->funcLike = (BOOL)(dir->macroLen > 0 && pos < end && str[pos] == '(');
+	if (dir->macroLen > 0)
+		pos = SkipDirectiveSpace(str, pos, end);
+	dir->value = &str[pos];
+	dir->valueLen = end - pos;
+}
@@ -0,0 +1,131 @@
+/* Dialog template lexer.  Splits a resource script buffer into
+   tokens, classifying each character with a lookup table and each
+   identifier against the resource statement keywords with a perfect
+   hash.  Comments and preprocessor lines are skipped like
+   whitespace. */
+
+#ifndef TMPLLEX_H
+#define TMPLLEX_H
+
+/* Include Windows data types (BOOL) */
+#include "subwindef.h"
+
+/* Character classes */
+#define CC_SPACE 0x01
+#define CC_NL 0x02
+#define CC_ALPHA 0x04 /* Letters and the underscore */
+#define CC_DIGIT 0x08
+#define CC_QUOTE 0x10
+#define CC_PUNCT 0x20 /* Single character tokens */
+#define CC_IDCHAR (CC_ALPHA | CC_DIGIT)
+
+extern const unsigned char tmplCharClass[256];
+#define CHAR_CLASS(c) (tmplCharClass[(unsigned char)(c)])
+
+enum TokType
+{
+	TOK_EOF,
+	TOK_IDENT, /* Identifiers and keywords */
+	TOK_NUMBER,
+	TOK_STRING, /* Includes the quotes */
+	TOK_PUNCT, /* One of: , | { } ( ) + - * / & ^ ~ ! */
+	TOK_OTHER, /* Any other single character */
+	TOK_DIRECTIVE /* A preprocessor line, see NextTmplDirective() */
+};
+
+/* Resource script keywords, in alphabetical order */
+enum RcKeyword
+{
+	KW_NONE,
+	KW_ACCELERATORS, KW_AUTO3STATE, KW_AUTOCHECKBOX, KW_AUTORADIOBUTTON,
+	KW_BEGIN, KW_BITMAP, KW_CAPTION, KW_CHARACTERISTICS, KW_CHECKBOX,
+	KW_CLASS, KW_COMBOBOX, KW_CONTROL, KW_CTEXT, KW_CURSOR,
+	KW_DEFPUSHBUTTON, KW_DIALOG, KW_DIALOGEX, KW_DISCARDABLE, KW_EDITTEXT,
+	KW_END, KW_EXSTYLE, KW_FIXED, KW_FONT, KW_GROUPBOX, KW_ICON,
+	KW_IMPURE, KW_LANGUAGE, KW_LISTBOX, KW_LOADONCALL, KW_LTEXT, KW_MENU,
+	KW_MENUEX, KW_MENUITEM, KW_MESSAGETABLE, KW_MOVEABLE, KW_NOT,
+	KW_POPUP, KW_PRELOAD, KW_PURE, KW_PUSHBOX, KW_PUSHBUTTON,
+	KW_RADIOBUTTON, KW_RCDATA, KW_RTEXT, KW_SCROLLBAR, KW_STATE3,
+	KW_STRINGTABLE, KW_STYLE, KW_VERSION, KW_VERSIONINFO,
+	NUM_RC_KEYWORDS
+};
+
+/* Token flags */
+#define TOKF_BOL 0x01 /* First token on its line */
+#define TOKF_UNTERMINATED 0x02 /* String without a closing quote */
+
+struct TmplToken_t
+{
+	int type;
+	int keyword; /* KW_NONE unless this is a keyword identifier */
+	const char* str; /* Points into the source buffer */
+	unsigned len;
+	unsigned pos; /* Offset of the token in the source buffer */
+	unsigned line; /* Line and column of the token, counting from one */
+	unsigned col;
+	unsigned flags;
+};
+
+typedef struct TmplToken_t TmplToken;
+
+#define IS_PUNCT(tok, ch) ((tok).type == TOK_PUNCT && (tok).str[0] == (ch))
+
+/* A range of the source that is skipped like whitespace, such as the
+   lines of an #if block whose condition is false.  Ranges start and
+   end at the start of a line. */
+struct TmplSkip_t
+{
+	unsigned start;
+	unsigned end;
+};
+
+typedef struct TmplSkip_t TmplSkip;
+
+/* The lexer state is small and holds no allocations, so it can be
+   copied to save a position and look ahead. */
+struct TmplLexer_t
+{
+	const char* buffer;
+	unsigned dataSize;
+	unsigned curPos;
+	unsigned curLine;
+	unsigned lineStart; /* Offset of the start of the current line */
+	/* Skipped ranges in source order, see SetTmplLexerSkips() */
+	const TmplSkip* skips;
+	unsigned numSkips;
+	unsigned nextSkip; /* First range that starts at or after "curPos" */
+};
+
+typedef struct TmplLexer_t TmplLexer;
+
+/* The parts of a preprocessor line, see ReadTmplDirective().  All of
+   the parts point into the source buffer. */
+struct TmplDirective_t
+{
+	const char* name; /* Such as "define", empty for a lone '#' */
+	unsigned nameLen;
+	const char* arg; /* The rest of the line */
+	unsigned argLen;
+	/* The identifier that starts "arg", such as the name of the macro
+	   of "#define" and "#ifdef", and what follows it */
+	const char* macro;
+	unsigned macroLen;
+	const char* value;
+	unsigned valueLen;
+	BOOL funcLike; /* A parenthesis follows "macro" right away */
+};
+
+typedef struct TmplDirective_t TmplDirective;
+
+void InitTmplLexer(TmplLexer* lex, const char* buffer, unsigned dataSize,
+				   unsigned curPos, unsigned curLine);
+void NextTmplToken(TmplLexer* lex, TmplToken* tok);
+void PeekTmplToken(TmplLexer* lex, TmplToken* tok);
+void SetTmplLexerSkips(TmplLexer* lex, const TmplSkip* skips,
+					   unsigned numSkips);
+BOOL NextTmplDirective(TmplLexer* lex, TmplToken* tok);
+void ReadTmplDirective(const TmplToken* tok, TmplDirective* dir);
+int LookupRcKeyword(const char* str, unsigned len);
+const char* RcKeywordName(int keyword);
+
+#endif /* not TMPLLEX_H */
@@ -8,9 +8,19 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 
 #include "xmalloc.h"
 #include "tmplparser.h"
+#include "tmpllex.h"
+#include "ctrlstyle.h"
+#include "rcexpr.h"
+#include "nlconv.h"
+#include "strintern.h"
+#include "ctrlgrid.h"
+#include "dlgprof.h"
+#include "symtab.h"
+#include "rcpp.h"
 
 /* Microsoft Visual C++ memory leak detection. (This program has NO
    memory leaks, but it is here just to be on the safe side.) */
@@ -38,21 +48,31 @@ const char* drawClasses[8][4] = {
 	{"GROUPBOX"}, /* Group box */
 	{"SCROLLBAR"}}; /* Scroll controls */
 
-/* Dialog variables */
-char* dlgHead;
-POINT dlgPos;
-long dlgWidth;
-long dlgHeight;
-BOOL dlgHasCaption;
-char dlgCaption[256];
-unsigned dlgPointSize;
-char* dlgFontFam;
-DlgItem_array dlgControls;
-
-/* Parser variables */
-unsigned curPos;
-unsigned curLine;
-char* errorDesc;
+/* The style of each control type when the style argument is empty,
+   as the resource compiler sets it.  WS_CHILD | WS_VISIBLE is added
+   to all of them. */
+#define CTRL_BASE_STYLE 0x50000000U /* WS_CHILD | WS_VISIBLE */
+static const unsigned defCtrlStyles[8][4] = {
+	{0}, /* CONTROL */
+	/* BS_AUTO3STATE, BS_3STATE, BS_AUTOCHECKBOX, BS_CHECKBOX, all with
+	   WS_TABSTOP */
+	{0x00010006U, 0x00010005U, 0x00010003U, 0x00010002U},
+	/* BS_AUTORADIOBUTTON, BS_RADIOBUTTON */
+	{0x00000009U, 0x00000004U},
+	/* ES_LEFT | WS_BORDER | WS_TABSTOP, LBS_NOTIFY | WS_BORDER,
+	   CBS_SIMPLE | WS_TABSTOP, SS_ICON */
+	{0x00810000U, 0x00800001U, 0x00010001U, 0x00000003U},
+	/* SS_LEFT | WS_GROUP, SS_CENTER | WS_GROUP, SS_RIGHT | WS_GROUP,
+	   BS_PUSHBOX | WS_TABSTOP */
+	{0x00020000U, 0x00020001U, 0x00020002U, 0x0001000AU},
+	/* BS_DEFPUSHBUTTON | WS_TABSTOP, BS_PUSHBUTTON | WS_TABSTOP */
+	{0x00010001U, 0x00010000U},
+	{0x00000007U}, /* BS_GROUPBOX */
+	{0x00000000U}}; /* SBS_HORZ */
+
+/* The style of a dialog box without a STYLE statement:
+   WS_POPUP | WS_BORDER | WS_SYSMENU */
+#define DEF_DLG_STYLE 0x80880000U
 
 /* Translates a text buffer to Unix line endings in place.  Returns
    the new size of the data, which may have shrunken.
@@ -61,21 +81,13 @@ char* errorDesc;
    null character. */
 unsigned SetUnixNlChars(char* buffer, unsigned dataSize)
 {
-	unsigned i, j;
-	for (i = 0, j = 0; i < dataSize; i++)
-	{
-		if (buffer[i] != '\r')
-			buffer[j] = buffer[i];
-		else
-		{
-			if (buffer[i+1] == '\n') /* CR+LF */
-				i++;
-			buffer[j] = '\n';
-		}
-		j++;
-	}
-	buffer[j] = '\0';
-	return j;
+	ProfMark mark;
+	unsigned newSize;
+	ProfBegin(&mark);
+	newSize = ConvCrlfToLf(buffer, buffer, dataSize);
+	buffer[newSize] = '\0';
+	ProfEnd(&mark, PROF_NL_NORM, dataSize);
+	return newSize;
 }
 
 /* The caller of this function MUST free the returned memory.
@@ -85,69 +97,198 @@ unsigned SetUnixNlChars(char* buffer, unsigned dataSize)
 heap_char GenWinNlChars(char* buffer, unsigned dataSize)
 {
 	char* winBuff;
-	unsigned i, j;
-	winBuff = (char*)xmalloc(dataSize + 1);
-	for (i = 0, j = 0; i < dataSize; i++)
-	{
-		if (buffer[i] == '\n')
-			winBuff[j++] = '\r';
-		if (j >= dataSize)
-			winBuff = (char*)xrealloc(winBuff, j + 2);
-		winBuff[j++] = buffer[i];
-		if (j >= dataSize)
-			winBuff = (char*)xrealloc(winBuff, j + 2);
-	}
-	winBuff[j] = '\0';
+	unsigned winSize;
+	/* Size the output exactly so that it is allocated only once */
+	winBuff = (char*)xmalloc(CountLfToCrlf(buffer, dataSize) + 1);
+	winSize = ConvLfToCrlf(winBuff, buffer, dataSize);
+	winBuff[winSize] = '\0';
 	return winBuff; /* This MUST be freed by the caller */
 }
 
-/* Translates escape codes in a string to characters.  Returns the new
-   data size.  This is not a fully featured escape code translator.
+/* Returns the value of a hexadecimal digit, or -1 if "c" is not
+   one. */
+static int HexDigitValue(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
 
-   "dataSize" specifies the length of the string, not including the
-   null character. */
-unsigned TransEscapeChars(char* buffer, unsigned dataSize)
+/* Decodes the escape codes of a resource script string: the simple
+   escapes (such as "\n" and "\\"), octal escapes of up to three
+   digits, "\x" hexadecimal escapes of up to two digits, and doubled
+   quotation marks.  Unknown escapes are kept as they are.  The output
+   is never longer than the input, and "dest" may be the same as "src"
+   to decode in place.  No null character is written.  Returns the
+   output size. */
+unsigned UnescapeText(char* dest, const char* src, unsigned srcLen)
 {
-	unsigned curPos;
-	unsigned newDataSize;
-	curPos = 0;
-	newDataSize = dataSize;
-	while (curPos < newDataSize)
+	unsigned i, j;
+	i = 0;
+	j = 0;
+	while (i < srcLen)
 	{
-		if (buffer[curPos] == '\\')
+		char c;
+		c = src[i];
+		if (c == '"' && i + 1 < srcLen && src[i+1] == '"')
 		{
-			BOOL foundEscChar;
-			foundEscChar = TRUE;
-			curPos++;
-			if (curPos >= newDataSize)
-				break;
-			switch (buffer[curPos])
+			dest[j++] = '"';
+			i += 2;
+			continue;
+		}
+		if (c != '\\' || i + 1 >= srcLen)
+		{
+			dest[j++] = c;
+			i++;
+			continue;
+		}
+		c = src[i+1];
+		switch (c)
+		{
+		case '\\': dest[j++] = '\\'; i += 2; break;
+		case 'a': dest[j++] = '\a'; i += 2; break;
+		case 'b': dest[j++] = '\b'; i += 2; break;
+		case 'f': dest[j++] = '\f'; i += 2; break;
+		case 'n': dest[j++] = '\n'; i += 2; break;
+		case 'r': dest[j++] = '\r'; i += 2; break;
+		case 'v': dest[j++] = '\v'; i += 2; break;
+		case 't': dest[j++] = '\t'; i += 2; break;
+		case '\'': dest[j++] = '\''; i += 2; break;
+		case '\"': dest[j++] = '\"'; i += 2; break;
+		case '?': dest[j++] = '?'; i += 2; break;
+		case '0': case '1': case '2': case '3':
+		case '4': case '5': case '6': case '7':
+		{
+			unsigned value;
+			unsigned numDigits;
+			value = 0;
+			i++;
+			for (numDigits = 0; numDigits < 3 && i < srcLen &&
+					 src[i] >= '0' && src[i] <= '7'; numDigits++)
+				value = value * 8 + (src[i++] - '0');
+			dest[j++] = (char)value;
+			break;
+		}
+		case 'x':
+		{
+			unsigned value;
+			unsigned numDigits;
+			int digit;
+			value = 0;
+			numDigits = 0;
+			while (numDigits < 2 && i + 2 + numDigits < srcLen &&
+				   (digit = HexDigitValue(src[i+2+numDigits])) >= 0)
 			{
-			case '\\': break;
-			case 'a': buffer[curPos] = '\a'; break;
-			case 'b': buffer[curPos] = '\b'; break;
-			case 'f': buffer[curPos] = '\f'; break;
-			case 'n': buffer[curPos] = '\n'; break;
-			case 'r': buffer[curPos] = '\r'; break;
-			case 'v': buffer[curPos] = '\v'; break;
-			case 't': buffer[curPos] = '\t'; break;
-			case '\'': break;
-			case '\"': break;
-			case '?': break;
-			default:
-				foundEscChar = FALSE;
-				break;
+				value = value * 16 + digit;
+				numDigits++;
 			}
-			if (foundEscChar == TRUE)
+			if (numDigits == 0)
 			{
-				memmove(&buffer[curPos-1], &buffer[curPos],
-					newDataSize - curPos);
-				curPos--;
-				newDataSize--;
+				/* Not an escape, keep the backslash */
+				dest[j++] = '\\';
+				i++;
+				break;
 			}
+			dest[j++] = (char)value;
+			i += 2 + numDigits;
+			break;
+		}
+		default:
+			/* Keep unknown escapes */
+			dest[j++] = '\\';
+			i++;
+			break;
+		}
+	}
+	return j;
+}
+
+/* Writes the escape code for a character into "seq" and returns its
+   length.  Characters that do not need an escape code are written as
+   they are.  A quotation mark is doubled, the way the resource
+   compiler expects it.  Control characters without a letter escape
+   are written as three-digit octal escapes, so that digits that follow
+   them cannot be taken as part of the escape. */
+static unsigned EscapeChar(char* seq, unsigned char c)
+{
+	char letter;
+	switch (c)
+	{
+	case '\\': letter = '\\'; break;
+	case '\a': letter = 'a'; break;
+	case '\b': letter = 'b'; break;
+	case '\f': letter = 'f'; break;
+	case '\n': letter = 'n'; break;
+	case '\r': letter = 'r'; break;
+	case '\v': letter = 'v'; break;
+	case '\t': letter = 't'; break;
+	case '\'': letter = '\''; break;
+	case '\"':
+		seq[0] = '\"';
+		seq[1] = '\"';
+		return 2;
+	default:
+		if (c < 0x20 || c == 0x7f)
+		{
+			seq[0] = '\\';
+			seq[1] = (char)('0' + (c >> 6));
+			seq[2] = (char)('0' + ((c >> 3) & 7));
+			seq[3] = (char)('0' + (c & 7));
+			return 4;
 		}
-		curPos++;
+		seq[0] = (char)c;
+		return 1;
 	}
+	seq[0] = '\\';
+	seq[1] = letter;
+	return 2;
+}
+
+/* Returns the exact size of the output of EscapeText(). */
+unsigned CountEscapedLen(const char* src, unsigned srcLen)
+{
+	char seq[4];
+	unsigned escLen;
+	unsigned i;
+	escLen = 0;
+	for (i = 0; i < srcLen; i++)
+	{
+		unsigned char c;
+		c = (unsigned char)src[i];
+		/* Most characters are printable and need no escape */
+		if (c >= 0x20 && c != 0x7f && c != '\\' && c != '\'' && c != '\"')
+			escLen++;
+		else
+			escLen += EscapeChar(seq, c);
+	}
+	return escLen;
+}
+
+/* Writes a string with special characters replaced by escape codes.
+   "dest" must have room for CountEscapedLen() characters and must not
+   overlap "src".  No null character is written.  Returns the output
+   size. */
+unsigned EscapeText(char* dest, const char* src, unsigned srcLen)
+{
+	unsigned i, j;
+	for (i = 0, j = 0; i < srcLen; i++)
+		j += EscapeChar(&dest[j], (unsigned char)src[i]);
+	return j;
+}
+
+/* Translates escape codes in a string to characters.  Returns the new
+   data size.  See UnescapeText() for the escape codes.
+
+   "dataSize" specifies the length of the string, not including the
+   null character. */
+unsigned TransEscapeChars(char* buffer, unsigned dataSize)
+{
+	unsigned newDataSize;
+	newDataSize = UnescapeText(buffer, buffer, dataSize);
 	buffer[newDataSize] = '\0';
 	return newDataSize;
 }
@@ -160,357 +301,657 @@ unsigned TransEscapeChars(char* buffer, unsigned dataSize)
    null character. */
 char* UntransEscChars(char* buffer, unsigned dataSize)
 {
-	char* newBuffer;
-	unsigned curPos;
 	unsigned newDataSize;
-	newBuffer = buffer;
-	curPos = 0;
-	newDataSize = dataSize;
-	while (curPos < newDataSize)
+	unsigned i, j;
+	newDataSize = CountEscapedLen(buffer, dataSize);
+	if (newDataSize != dataSize)
+		buffer = (char*)xrealloc(buffer, newDataSize + 1);
+	/* Work backwards so that the output never overwrites characters
+	   that have not been read yet.  Once the output catches up with
+	   the input, the rest of the string needs no escapes. */
+	i = dataSize;
+	j = newDataSize;
+	while (j > i)
 	{
-		BOOL foundEscChar;
-		char c;
-		foundEscChar = TRUE;
-		switch (newBuffer[curPos])
-		{
-		case '\\': c = '\\'; break;
-		case '\a': c = 'a'; break;
-		case '\b': c = 'b'; break;
-		case '\f': c = 'f'; break;
-		case '\n': c = 'n'; break;
-		case '\r': c = 'r'; break;
-		case '\v': c = 'v'; break;
-		case '\t': c = 't'; break;
-		case '\'': c = '\''; break;
-		case '\"': c = '\"'; break;
-		default:
-			foundEscChar = FALSE;
+		char seq[4];
+		unsigned seqLen;
+		seqLen = EscapeChar(seq, (unsigned char)buffer[--i]);
+		j -= seqLen;
+		memcpy(&buffer[j], seq, seqLen);
+	}
+	buffer[newDataSize] = '\0';
+	return buffer;
+}
+
+/* Clears a dialog template so that it holds no data.  Call this
+   before the first use of a template. */
+void InitDlgData(DlgTemplate* dlg)
+{
+	memset(dlg, 0, sizeof(DlgTemplate));
+	InitStrArena(&dlg->strings);
+}
+
+/* Prepares a parser context to write into the given dialog
+   template. */
+void InitParseCtx(ParseCtx* ctx, DlgTemplate* dlg)
+{
+	ctx->curPos = 0;
+	ctx->curLine = 0;
+	ctx->errorDesc = "";
+	ctx->dlg = dlg;
+	ctx->lazyFields = FALSE;
+	ctx->symLookup = NULL;
+	ctx->symParam = NULL;
+	ctx->skips = NULL;
+	ctx->numSkips = 0;
+	ctx->srcName = NULL;
+	ctx->includeDirs = NULL;
+	ctx->diags = NULL;
+}
+
+/* Reports a parse error at "pos" in "buffer".  Without recovery, the
+   error goes into the context, and FALSE is returned so that parsing
+   stops.  In recovery mode (ParseCtx.diags), the error is added to
+   the list, the cursor of the context is left alone, and TRUE is
+   returned so that parsing goes on. */
+BOOL AddParseDiag(ParseCtx* ctx, const char* buffer, unsigned pos,
+				  unsigned line, int code, const char* message)
+{
+	ParseDiag* diag;
+	unsigned lineStart;
+	if (ctx->diags == NULL)
+	{
+		ctx->curPos = pos;
+		ctx->curLine = line;
+		ctx->errorDesc = (char*)message;
+		return FALSE;
+	}
+	lineStart = pos;
+	while (lineStart > 0 && CHAR_CLASS(buffer[lineStart-1]) != CC_NL)
+		lineStart--;
+	diag = &EA_SR(*ctx->diags, ctx->diags->len);
+	diag->file = ctx->srcName;
+	diag->pos = pos;
+	diag->line = line;
+	diag->col = pos - lineStart + 1;
+	diag->code = code;
+	diag->message = message;
+	EA_ADD(ParseDiag, *ctx->diags);
+	return TRUE;
+}
+
+/* Returns the name of a kind of parse error, for messages */
+const char* ParseDiagName(int code)
+{
+	switch (code)
+	{
+	case PDIAG_PREPROC: return "preprocessor";
+	case PDIAG_HEAD: return "header";
+	case PDIAG_CONTROL: return "control";
+	case PDIAG_END: return "end";
+	}
+	return "error";
+}
+
+/* Starts a lexer on the source of the context, with the ranges that
+   the preprocessor left out */
+static void InitSrcLexer(ParseCtx* ctx, TmplLexer* lex, const char* buffer,
+						 unsigned dataSize, unsigned pos, unsigned line)
+{
+	InitTmplLexer(lex, buffer, dataSize, pos, line);
+	if (ctx->numSkips > 0)
+		SetTmplLexerSkips(lex, ctx->skips, ctx->numSkips);
+}
+
+/* Returns TRUE if "tok" cannot be part of the statement before it.
+   Statements end at keywords, braces, and the end of the buffer.
+   They also end at a line break, unless the line break comes right
+   after an operator or comma ("afterOp") or right before one, so that
+   long statements can be split over several lines. */
+static BOOL EndsStatement(TmplToken* tok, BOOL afterOp)
+{
+	if (tok->type == TOK_EOF || IS_PUNCT(*tok, '{') || IS_PUNCT(*tok, '}'))
+		return TRUE;
+	if (tok->keyword == KW_NOT)
+		return FALSE;
+	if (tok->keyword != KW_NONE)
+		return TRUE;
+	if ((tok->flags & TOKF_BOL) && afterOp == FALSE &&
+		tok->type != TOK_PUNCT)
+		return TRUE;
+	return FALSE;
+}
+
+/* Reads one argument of a statement: the tokens up to the next comma
+   outside of parentheses, or up to the end of the statement.  "tok"
+   holds the first token of the argument on entry and the token after
+   the argument on return.  The source range of the argument is
+   stored in "pStart" and "pEnd".  Returns FALSE if the argument is
+   empty. */
+static BOOL ReadStmtArg(TmplLexer* lex, TmplToken* tok,
+						unsigned* pStart, unsigned* pEnd)
+{
+	unsigned depth;
+	BOOL afterOp;
+	depth = 0;
+	/* A new argument always follows a keyword or a comma */
+	afterOp = TRUE;
+	*pStart = tok->pos;
+	*pEnd = tok->pos;
+	while (!EndsStatement(tok, (BOOL)(afterOp || depth > 0)))
+	{
+		if (depth == 0 && IS_PUNCT(*tok, ','))
 			break;
-		}
-		if (foundEscChar == TRUE)
+		if (IS_PUNCT(*tok, '('))
+			depth++;
+		else if (IS_PUNCT(*tok, ')') && depth > 0)
+			depth--;
+		afterOp = (tok->type == TOK_PUNCT && !IS_PUNCT(*tok, ')')) ||
+			tok->keyword == KW_NOT;
+		*pEnd = tok->pos + tok->len;
+		NextTmplToken(lex, tok);
+	}
+	return (BOOL)(*pEnd > *pStart);
+}
+
+/* Copies source text into "dest".  Line breaks and the whitespace
+   around them are replaced by a single space, so that an argument
+   that was split over several lines is kept on one line.  "dest"
+   must have room for "len" characters.  No null character is
+   written.  Returns the output size. */
+static unsigned CollapseSourceText(char* dest, const char* src,
+								   unsigned len)
+{
+	unsigned i, j;
+	for (i = 0, j = 0; i < len; i++)
+	{
+		if (CHAR_CLASS(src[i]) == CC_NL)
 		{
-			newBuffer[curPos] = '\\';
-			curPos++;
-			newDataSize++;
-			newBuffer = (char*)xrealloc(newBuffer, newDataSize + 1);
-			memmove(&newBuffer[curPos+1], &newBuffer[curPos],
-					(newDataSize - 1) - curPos);
-			newBuffer[curPos] = c;
+			while (j > 0 && CHAR_CLASS(dest[j-1]) == CC_SPACE)
+				j--;
+			while (i + 1 < len && (CHAR_CLASS(src[i+1]) & (CC_SPACE | CC_NL)))
+				i++;
+			dest[j++] = ' ';
 		}
-		curPos++;
-	}
-	newBuffer[newDataSize] = '\0';
-	return newBuffer;
-}
-
-#define CHECK_SIZE_ERROR(errLabel) \
-	if (curPos >= dataSize) \
-		goto errLabel;
-#define WHITESPACE (buffer[curPos] == ' ' || buffer[curPos] == '\t')
-#define CHECK_CHAR(chcode) (buffer[curPos] == chcode)
-#define SKIP_CHAR(chcode) \
-	if (!CHECK_CHAR(chcode)) \
-		goto headError; \
-	curPos++;
-#define SAVE_STRING() \
-	lastString = (char*)xrealloc(lastString, curPos - lastPos + 1); \
-	strncpy(lastString, &buffer[lastPos], curPos - lastPos); \
-	lastString[curPos-lastPos] = '\0';
-
-#define WS_AND_NL (WHITESPACE || buffer[curPos] == '\n')
-#define SKIP_WHITESPACE() \
-	while (curPos < dataSize && WHITESPACE) \
-		curPos++;
-#define CHECK_NO_NL_ERROR(label) \
-	if (CHECK_CHAR('\n')) \
-		goto label;
+		else
+			dest[j++] = src[i];
+	}
+	return j;
+}
+
+/* Returns TRUE if source text is a decimal number that is written
+   back the same way, without a sign, leading zeros, or spaces. */
+static BOOL IsPlainInt(const char* src, unsigned len)
+{
+	unsigned i;
+	if (len == 0 || (src[0] == '0' && len > 1))
+		return FALSE;
+	for (i = 0; i < len; i++)
+	{
+		if (CHAR_CLASS(src[i]) != CC_DIGIT)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* Returns the interned copy (see strintern.h) of source text (see
+   CollapseSourceText()).  At most "maxLen" characters are kept. */
+static const char* InternSourceText(const char* src, unsigned len,
+									unsigned maxLen)
+{
+	char textBuf[512];
+	char* text;
+	unsigned textLen;
+	const char* interned;
+	if (len == 0)
+		return InternStr("", 0);
+	text = textBuf;
+	if (len > sizeof(textBuf))
+		text = (char*)xmalloc(len);
+	textLen = CollapseSourceText(text, src, len);
+	if (textLen > maxLen)
+		textLen = maxLen;
+	interned = InternStr(text, textLen);
+	if (text != textBuf)
+		xfree(text);
+	return interned;
+}
+
+/* Copies source text into the dialog's string arena (see
+   CollapseSourceText()).  At most MAX_CTRL_TEXT characters are
+   kept. */
+static const char* ArenaSourceText(DlgTemplate* dlg, const char* src,
+								   unsigned len)
+{
+	char* text;
+	unsigned textLen;
+	text = StrArenaAlloc(&dlg->strings, len + 1);
+	textLen = CollapseSourceText(text, src, len);
+	if (textLen > MAX_CTRL_TEXT)
+		textLen = MAX_CTRL_TEXT;
+	text[textLen] = '\0';
+	StrArenaTrim(&dlg->strings, text, textLen + 1);
+	return text;
+}
+
+/* Decodes a string's source text (without the quotes) straight into
+   the dialog's string arena.  At most MAX_CTRL_TEXT characters are
+   kept. */
+static const char* ArenaStringText(DlgTemplate* dlg, const char* src,
+								   unsigned len)
+{
+	char* text;
+	unsigned textLen;
+	/* Decoding never makes the text longer */
+	text = StrArenaAlloc(&dlg->strings, len + 1);
+	textLen = UnescapeText(text, src, len);
+	if (textLen > MAX_CTRL_TEXT)
+		textLen = MAX_CTRL_TEXT;
+	text[textLen] = '\0';
+	StrArenaTrim(&dlg->strings, text, textLen + 1);
+	return text;
+}
+
+/* Evaluates a numeric argument, which may be a constant expression
+   with the symbols of the context.  Returns EXPR_OK or the error
+   (see rcexpr.h). */
+static int SourceIntValue(ParseCtx* ctx, const char* src, unsigned len,
+						  long* pValue)
+{
+	/* The symbols of the template fall back on those of the
+	   context */
+	if (ctx->dlg->syms != NULL)
+		return EvalConstExpr(src, len, LookupSym, ctx->dlg->syms, pValue,
+							 NULL);
+	return EvalConstExpr(src, len, ctx->symLookup, ctx->symParam, pValue,
+						 NULL);
+}
+
+/* Returns TRUE for the memory options that may follow DIALOG and
+   DIALOGEX. */
+static BOOL IsMemoryOption(int keyword)
+{
+	switch (keyword)
+	{
+	case KW_DISCARDABLE: case KW_FIXED: case KW_IMPURE:
+	case KW_LOADONCALL: case KW_MOVEABLE: case KW_PRELOAD: case KW_PURE:
+		return TRUE;
+	}
+	return FALSE;
+}
 
 /* This function stores dynamically allocated memory.  Therefore, you
    must make sure that you free the relevent memory before calling
    this function for recalculations.
 
-   "dataSize" specifies the length of the string, not including the
-   null character. */
-BOOL ParseDlgHead(char* buffer, unsigned dataSize)
+   "dataSize" specifies the length of the data in the buffer. */
+BOOL ParseDlgHead(ParseCtx* ctx, const char* buffer, unsigned dataSize)
 {
-	unsigned lastPos;
-	char* lastString;
-	BOOL foundHeadEnd;
+	DlgTemplate* dlg;
+	TmplLexer lex;
+	TmplToken tok;
+	char* errorDesc;
+	unsigned argStart, argEnd;
+	unsigned headEnd;
+	unsigned headLen;
+	unsigned idPos;
+	BOOL addNewline;
 	/* Temporary variables */
 	unsigned i;
-	lastPos = 0;
-	foundHeadEnd = FALSE;
+	dlg = ctx->dlg;
 
-	curPos = 0;
-	curLine = 1;
-	dlgHead = NULL;
-	dlgFontFam = NULL;
+	dlg->head = NULL;
+	dlg->fontFam = NULL;
 
-	lastString = (char*)xmalloc(9);
-
-	/* Always skip comments (not done right now) */
-
-	/* Skip whitespace and newlines */
-	while (curPos < dataSize && WS_AND_NL)
-	{
-		if (CHECK_CHAR('\n'))
-			curLine++;
-		curPos++;
-	}
+	InitSrcLexer(ctx, &lex, buffer, dataSize, 0, 1);
+	NextTmplToken(&lex, &tok);
 	errorDesc = "Missing dialog template data.";
-	CHECK_SIZE_ERROR(headError);
-	CHECK_NO_NL_ERROR(headError);
+	if (tok.type == TOK_EOF)
+		goto headError;
+	idPos = tok.pos;
 
 	/* Skip ID */
-	lastPos = curPos;
-	while (curPos < dataSize && !WS_AND_NL)
-		curPos++;
 	errorDesc = "Missing dialog ID.";
-	CHECK_SIZE_ERROR(headError);
-	CHECK_NO_NL_ERROR(headError);
-
-	errorDesc = "Missing space after dialog ID.";
-	SKIP_WHITESPACE();
-	CHECK_SIZE_ERROR(headError);
-	CHECK_NO_NL_ERROR(headError);
+	if (tok.type == TOK_PUNCT || tok.keyword != KW_NONE)
+		goto headError;
+	NextTmplToken(&lex, &tok);
 
 	/* Skip DIALOG or DIALOGEX */
-	lastPos = curPos;
-	while (curPos < dataSize && !WS_AND_NL)
-		curPos++;
 	errorDesc = "Missing dialog resource specifier.";
-	CHECK_SIZE_ERROR(headError);
-	CHECK_NO_NL_ERROR(headError);
-
-	errorDesc = "Missing space after DIALOG or DIALOGEX.";
-	SKIP_WHITESPACE();
-	CHECK_SIZE_ERROR(headError);
-	CHECK_NO_NL_ERROR(headError);
+	if (tok.type != TOK_IDENT)
+		goto headError;
+	NextTmplToken(&lex, &tok);
+	while (IsMemoryOption(tok.keyword))
+		NextTmplToken(&lex, &tok);
 
 	/* Read x, y, w, h */
 	for (i = 0; i < 4; i++)
 	{
-		lastPos = curPos;
-		while (curPos < dataSize && !CHECK_CHAR(',') && !WHITESPACE &&
-			!CHECK_CHAR('\n'))
-			curPos++;
 		if (i < 3)
 			errorDesc = "Missing dialog coordinates.";
 		else
 			errorDesc = "Missing dialog template data.";
-		CHECK_SIZE_ERROR(headError);
-		SAVE_STRING();
+		if (!ReadStmtArg(&lex, &tok, &argStart, &argEnd))
+			goto headError;
+		if (i < 3 && !IS_PUNCT(tok, ','))
+			goto headError;
 		/* Data processing hook */
 		{
-			int numVal;
-			numVal = atoi(lastString);
+			long numVal;
+			int result;
+			result = SourceIntValue(ctx, &buffer[argStart],
+									argEnd - argStart, &numVal);
+			if (result != EXPR_OK)
+			{
+				errorDesc = (char*)ExprErrorDesc(result);
+				goto headError;
+			}
 			switch (i)
 			{
-			case 0: dlgPos.x = numVal; break;
-			case 1: dlgPos.y = numVal; break;
-			case 2: dlgWidth = numVal; break;
-			case 3: dlgHeight = numVal; break;
+			case 0: dlg->pos.x = numVal; break;
+			case 1: dlg->pos.y = numVal; break;
+			case 2: dlg->width = numVal; break;
+			case 3: dlg->height = numVal; break;
 			}
 		}
 		if (i < 3)
-			curPos++; /* Skip the comma */
-		SKIP_WHITESPACE();
-		CHECK_SIZE_ERROR(headError);
-		if (i < 3)
-			CHECK_NO_NL_ERROR(headError);
+			NextTmplToken(&lex, &tok); /* Skip the comma */
+	}
+	/* Skip the help ID of DIALOGEX */
+	if (IS_PUNCT(tok, ','))
+	{
+		NextTmplToken(&lex, &tok);
+		ReadStmtArg(&lex, &tok, &argStart, &argEnd);
 	}
-	errorDesc = "Expected end of line.";
-	SKIP_CHAR('\n');
-	curLine++;
-	errorDesc = "Missing dialog template data.";
-	CHECK_SIZE_ERROR(headError);
 
-	/* Read only a CAPTION or a FONT statement */
+	/* Read only a CAPTION, FONT, STYLE, or EXSTYLE statement */
 	/* Otherwise, skip until "BEGIN" or '{' */
-	dlgHasCaption = FALSE;
+	dlg->hasCaption = FALSE;
+	dlg->style = DEF_DLG_STYLE;
+	dlg->exStyle = 0;
+	dlg->styleFlags = 0;
 	errorDesc = "Missing beginning marker of dialog control list.";
-	while (curPos < dataSize && foundHeadEnd == FALSE)
+	while (tok.type != TOK_EOF)
 	{
-		SKIP_WHITESPACE();
-		CHECK_SIZE_ERROR(headError);
-		if (strncmp("CAPTION", &buffer[curPos], 7) == 0)
+		if (tok.keyword == KW_CAPTION)
 		{
-			curPos += 7;
+			NextTmplToken(&lex, &tok);
 			errorDesc = "Missing dialog caption string.";
-			CHECK_SIZE_ERROR(headError);
-			SKIP_WHITESPACE();
-			CHECK_SIZE_ERROR(headError);
-			SKIP_CHAR('"');
-			CHECK_SIZE_ERROR(headError);
-			lastPos = curPos;
-			while (curPos < dataSize && !CHECK_CHAR('"'))
-			{
-				if (CHECK_CHAR('\\'))
-				{
-					/* Ignore escaped quotation marks */
-					curPos++;
-					CHECK_SIZE_ERROR(headError);
-				}
-				curPos++;
-			}
+			if (tok.type != TOK_STRING)
+				goto headError;
 			errorDesc = "Missing closing quote on dialog caption string.";
-			CHECK_SIZE_ERROR(headError);
-			/* Skip the quote after saving the string so not to include it */
-			SAVE_STRING();
-			SKIP_CHAR('"');
+			if (tok.flags & TOKF_UNTERMINATED)
+				goto headError;
 			/* Data processing hook */
 			{
+				char textBuf[512];
+				char* capText;
 				unsigned maxCpy;
-				maxCpy = strlen(lastString);
+				/* Do not include the quotes.  The decoded text is
+				   never longer than the source text. */
+				capText = textBuf;
+				if (tok.len - 2 > sizeof(textBuf))
+					capText = (char*)xmalloc(tok.len - 2);
+				maxCpy = UnescapeText(capText, tok.str + 1, tok.len - 2);
 				if (maxCpy > 255)
 					maxCpy = 255;
-				strncpy(dlgCaption, lastString, maxCpy);
-				dlgCaption[maxCpy] = '\0';
-				dlgHasCaption = TRUE;
+				memcpy(dlg->caption, capText, maxCpy);
+				dlg->caption[maxCpy] = '\0';
+				dlg->hasCaption = TRUE;
+				if (capText != textBuf)
+					xfree(capText);
 			}
+			NextTmplToken(&lex, &tok);
 			/* Reset the error description */
 			errorDesc = "Missing beginning marker of dialog control list.";
 		}
-		else if (strncmp("FONT", &buffer[curPos], 4) == 0)
+		else if (tok.keyword == KW_FONT)
 		{
-			curPos += 4;
+			NextTmplToken(&lex, &tok);
 			errorDesc = "Missing font point size.";
-			CHECK_SIZE_ERROR(headError);
-			SKIP_WHITESPACE();
-			/* Read the point size */
-			lastPos = curPos;
-			while (curPos < dataSize && !CHECK_CHAR(','))
-				curPos++;
-			CHECK_SIZE_ERROR(headError);
-			SAVE_STRING();
+			if (!ReadStmtArg(&lex, &tok, &argStart, &argEnd))
+				goto headError;
 			/* Data processing hook */
-			dlgPointSize = atoi(lastString);
-			errorDesc = "Missing font face name.";
-			curPos++; /* Skip the comma */
-			CHECK_SIZE_ERROR(headError);
-			SKIP_WHITESPACE();
-			CHECK_SIZE_ERROR(headError);
-			/* Read the font family */
-			CHECK_SIZE_ERROR(headError);
-			SKIP_CHAR('"');
-			CHECK_SIZE_ERROR(headError);
-			lastPos = curPos;
-			while (curPos < dataSize && !CHECK_CHAR('"'))
 			{
-				if (CHECK_CHAR('\\'))
+				long numVal;
+				int result;
+				result = SourceIntValue(ctx, &buffer[argStart],
+										argEnd - argStart, &numVal);
+				if (result != EXPR_OK)
 				{
-					/* Ignore escaped quotation marks */
-					curPos++;
-					CHECK_SIZE_ERROR(headError);
+					errorDesc = (char*)ExprErrorDesc(result);
+					goto headError;
 				}
-				curPos++;
+				dlg->pointSize = (unsigned)numVal;
 			}
+			errorDesc = "Missing font face name.";
+			if (!IS_PUNCT(tok, ','))
+				goto headError;
+			NextTmplToken(&lex, &tok); /* Skip the comma */
+			/* Read the font family */
+			if (tok.type != TOK_STRING)
+				goto headError;
 			errorDesc = "Missing closing quote on font face string.";
-			CHECK_SIZE_ERROR(headError);
-			/* Skip the quote after saving the string so not to include it */
-			SAVE_STRING();
-			SKIP_CHAR('"');
+			if (tok.flags & TOKF_UNTERMINATED)
+				goto headError;
 			/* Data processing hook */
-			dlgFontFam = (char*)xmalloc(strlen(lastString) + 1);
-			strcpy(dlgFontFam, lastString);
+			xfree(dlg->fontFam);
+			dlg->fontFam = (char*)xmalloc(tok.len - 2 + 1);
+			strncpy(dlg->fontFam, tok.str + 1, tok.len - 2);
+			dlg->fontFam[tok.len-2] = '\0';
+			NextTmplToken(&lex, &tok);
+			/* Skip the weight, italic, and character set */
+			while (IS_PUNCT(tok, ','))
+			{
+				NextTmplToken(&lex, &tok);
+				ReadStmtArg(&lex, &tok, &argStart, &argEnd);
+			}
 			/* Reset the error description */
 			errorDesc = "Missing beginning marker of dialog control list.";
 		}
-		else if (CHECK_CHAR('{') ||
-			strncmp("BEGIN", &buffer[curPos], 5) == 0)
+		else if (tok.keyword == KW_STYLE || tok.keyword == KW_EXSTYLE)
 		{
-			/* Quit at end of line */
-			foundHeadEnd = TRUE;
-			/* Read backwards so not to include the BEGIN line *
-			while (curPos > 0 && !CHECK_CHAR('\n'))
-				curPos--;
-			if (curPos == 0)
-				goto headError;
-			curPos++; /* Include the newline character *
-			headEndPos = curPos;
-			/* Continue to skip this line */
+			BOOL isStyle;
+			isStyle = (BOOL)(tok.keyword == KW_STYLE);
+			NextTmplToken(&lex, &tok);
+			ReadStmtArg(&lex, &tok, &argStart, &argEnd);
+			/* Data processing hook */
+			if (isStyle == TRUE)
+			{
+				/* STYLE replaces the default style */
+				dlg->style = 0;
+				dlg->styleFlags &= ~CSF_STYLE_UNRESOLVED;
+				if (!EvalStyleExpr(&buffer[argStart], argEnd - argStart,
+								   &dlg->style))
+					dlg->styleFlags |= CSF_STYLE_UNRESOLVED;
+			}
+			else
+			{
+				dlg->exStyle = 0;
+				dlg->styleFlags &= ~CSF_EXSTYLE_UNRESOLVED;
+				if (!EvalStyleExpr(&buffer[argStart], argEnd - argStart,
+								   &dlg->exStyle))
+					dlg->styleFlags |= CSF_EXSTYLE_UNRESOLVED;
+			}
+		}
+		else if (IS_PUNCT(tok, '{') || tok.keyword == KW_BEGIN)
+			break;
+		else
+		{
+			/* Skip any other statement */
+			NextTmplToken(&lex, &tok);
+			while (ReadStmtArg(&lex, &tok, &argStart, &argEnd),
+				   IS_PUNCT(tok, ','))
+				NextTmplToken(&lex, &tok);
+			/* Do not get stuck on stray braces */
+			if (IS_PUNCT(tok, '}'))
+				NextTmplToken(&lex, &tok);
 		}
-		while (curPos < dataSize && !CHECK_CHAR('\n'))
-			curPos++;
-		CHECK_SIZE_ERROR(headError);
-		SKIP_CHAR('\n');
-		curLine++;
-		CHECK_SIZE_ERROR(headError);
-	}
-	goto noHeadError;
+	}
+	if (tok.type == TOK_EOF)
+		goto headError;
+
+	/* The header ends with the line of the beginning marker, unless
+	   something else follows the marker on that line */
+	headEnd = tok.pos + tok.len;
+	while (headEnd < dataSize && CHAR_CLASS(buffer[headEnd]) == CC_SPACE)
+		headEnd++;
+	ctx->curLine = tok.line;
+	addNewline = FALSE;
+	if (headEnd < dataSize && CHAR_CLASS(buffer[headEnd]) == CC_NL)
+	{
+		if (buffer[headEnd] == '\r' && headEnd + 1 < dataSize &&
+			buffer[headEnd+1] == '\n')
+			headEnd++;
+		headEnd++;
+		ctx->curLine++;
+	}
+	else
+	{
+		headEnd = tok.pos + tok.len;
+		addNewline = TRUE;
+	}
+	ctx->curPos = headEnd;
+
+	/* Save the header, which is kept with Unix line endings */
+	dlg->head = (char*)xmalloc(headEnd + 2);
+	memcpy(dlg->head, buffer, headEnd);
+	dlg->head[headEnd] = '\0';
+	headLen = SetUnixNlChars(dlg->head, headEnd);
+	if (addNewline == TRUE)
+		strcpy(&dlg->head[headLen], "\n");
+	/* Find the ID in the converted header, which has lost the CR of
+	   every CR+LF in front of it */
+	dlg->headStart = idPos;
+	for (i = 1; i < idPos; i++)
+	{
+		if (buffer[i] == '\n' && buffer[i-1] == '\r')
+			dlg->headStart--;
+	}
+	return TRUE;
 headError:
-	xfree(lastString);
+	ctx->curPos = tok.pos;
+	ctx->curLine = tok.line;
+	ctx->errorDesc = errorDesc;
 	return FALSE;
-noHeadError:
-	/* Save the header */
-	lastPos = 0;
-	SAVE_STRING();
-	dlgHead = (char*)xmalloc(strlen(lastString) + 1);
-	strcpy(dlgHead, lastString);
-	xfree(lastString);
-	return TRUE;
 }
 
+/* Returns the statement keyword for the given control type, or an
+   empty string if there is no such type. */
+const char* CtrlTypeName(int rendClass, int rendType)
+{
+	if (rendClass < 0 || (unsigned)rendClass >= numClasses ||
+		rendType < 0 || (unsigned)rendType >= numEachClass[rendClass])
+		return "";
+	return drawClasses[rendClass][rendType];
+}
+
+/* Returns the control type index (see CTRL_TYPE_INDEX()) of a control
+   statement keyword, or -1 if the keyword is not a control
+   statement.  This must agree with "drawClasses". */
+static int CtrlTypeFromKeyword(int keyword)
+{
+	switch (keyword)
+	{
+	case KW_CONTROL: return 0 * 4 + 0;
+	case KW_AUTO3STATE: return 1 * 4 + 0;
+	case KW_STATE3: return 1 * 4 + 1;
+	case KW_AUTOCHECKBOX: return 1 * 4 + 2;
+	case KW_CHECKBOX: return 1 * 4 + 3;
+	case KW_AUTORADIOBUTTON: return 2 * 4 + 0;
+	case KW_RADIOBUTTON: return 2 * 4 + 1;
+	case KW_EDITTEXT: return 3 * 4 + 0;
+	case KW_LISTBOX: return 3 * 4 + 1;
+	case KW_COMBOBOX: return 3 * 4 + 2;
+	case KW_ICON: return 3 * 4 + 3;
+	case KW_LTEXT: return 4 * 4 + 0;
+	case KW_CTEXT: return 4 * 4 + 1;
+	case KW_RTEXT: return 4 * 4 + 2;
+	case KW_PUSHBOX: return 4 * 4 + 3;
+	case KW_DEFPUSHBUTTON: return 5 * 4 + 0;
+	case KW_PUSHBUTTON: return 5 * 4 + 1;
+	case KW_GROUPBOX: return 6 * 4 + 0;
+	case KW_SCROLLBAR: return 7 * 4 + 0;
+	}
+	return -1;
+}
+
+/* Records the source range [start, end) of a control field */
+#define SET_SRC_VIEW(pStrs, view, bit, start, end) \
+{ \
+	(pStrs)->view.pos = (start); \
+	(pStrs)->view.len = (end) - (start); \
+	(pStrs)->lazyMask |= (bit); \
+}
+
+static void DecodeCtrlFields(DlgTemplate* dlg, unsigned ctrlNum,
+							 const char* src, unsigned mask);
+
 /* If you call this function on a buffer that has a single control in
-   it and no dialog header, you will have to set "curPos" to zero
-   before calling this function.
+   it and no dialog header, you will have to set "ctx->curPos" to zero
+   before calling this function.  On return, "ctx->curPos" is at the
+   token that follows the control statement.  The statement may be
+   split over several lines.
 
    This function also stores dynamically allocated memory.  Therefore,
    you must make sure that you free the relevent memory before calling
    this function for recalculations.
 
-   "dataSize" specifies the length of the string, not including the
-   null character. */
-BOOL ParseControl(char* buffer, unsigned dataSize, unsigned ctrlNum)
+   "dataSize" specifies the length of the data in the buffer. */
+BOOL ParseControl(ParseCtx* ctx, const char* buffer, unsigned dataSize,
+				  unsigned ctrlNum)
 {
-	unsigned i, j;
-	BOOL foundType;
-	unsigned lastPos;
-	char* lastString;
+	TmplLexer lex;
+	TmplToken tok;
+	char* errorDesc;
+	unsigned argStart, argEnd;
+	/* Source ranges of the style and extended style arguments */
+	unsigned styleStart, styleEnd;
+	unsigned exStyleStart, exStyleEnd;
+	int typeIdx;
+	unsigned i;
 	DlgItem* pCtrl;
-
-	pCtrl = &dlgControls.d[ctrlNum];
-	pCtrl->id = NULL;
-	pCtrl->style = NULL;
-	pCtrl->exStyle = NULL;
-
-	foundType = FALSE;
-	lastString = (char*)xmalloc(9);
-
-	/* Assume "curPos" is directed to the beginning of the proper line */
-	SKIP_WHITESPACE();
+	DlgItemStrs* pStrs;
+
+	pCtrl = &ctx->dlg->controls.d[ctrlNum];
+	pStrs = &ctx->dlg->ctrlStrs.d[ctrlNum];
+	pCtrl->styleFlags = 0;
+	pCtrl->style = 0;
+	pCtrl->exStyle = 0;
+	styleStart = styleEnd = 0;
+	exStyleStart = exStyleEnd = 0;
+	pStrs->text = NULL;
+	pStrs->wndClass = NULL;
+	pStrs->id = NULL;
+	pStrs->style = NULL;
+	pStrs->exStyle = NULL;
+	for (i = 0; i < 4; i++)
+		pStrs->coordSrc[i] = NULL;
+	/* The data processing hooks only record where each string is in
+	   the source.  The strings are decoded at the end, or on first use
+	   if the context asks for lazy fields. */
+	pStrs->lazyMask = 0;
+	if (ctx->lazyFields == TRUE)
+		ctx->dlg->source = buffer;
+
+	InitSrcLexer(ctx, &lex, buffer, dataSize, ctx->curPos, ctx->curLine);
+	NextTmplToken(&lex, &tok);
 	errorDesc = "Missing control type statement.";
-	CHECK_SIZE_ERROR(ctrlError);
+	if (tok.type == TOK_EOF)
+		goto ctrlError;
 	/* Check the type of control */
-	for (i = 0; i < numClasses; i++)
-	{
-		for (j = 0; j < numEachClass[i]; j++)
-		{
-			if (strncmp(drawClasses[i][j], &buffer[curPos],
-				strlen(drawClasses[i][j])) == 0)
-			{
-				/* We have a match */
-				pCtrl->rendClass = i;
-				pCtrl->rendType = j;
-				curPos += strlen(drawClasses[i][j]);
-				errorDesc = "Missing control parameters.";
-				CHECK_SIZE_ERROR(ctrlError);
-				CHECK_NO_NL_ERROR(ctrlError);
-				SKIP_WHITESPACE();
-				CHECK_SIZE_ERROR(ctrlError);
-				CHECK_NO_NL_ERROR(ctrlError);
-				foundType = TRUE;
-				break;
-			}
-		}
-		if (foundType == TRUE)
-			break;
-	}
-	if (foundType == FALSE)
+	typeIdx = CtrlTypeFromKeyword(tok.keyword);
+	if (typeIdx < 0)
 	{
 		errorDesc = "Unrecognized control type.";
 		goto ctrlError;
 	}
+	pCtrl->rendClass = typeIdx / 4;
+	pCtrl->rendType = typeIdx % 4;
+	NextTmplToken(&lex, &tok);
+	errorDesc = "Missing control parameters.";
+	if (EndsStatement(&tok, TRUE))
+		goto ctrlError;
 
 	/* Read the caption */
 	/* Should SCROLLBAR really allow text? For now, no. */
@@ -526,340 +967,768 @@ BOOL ParseControl(char* buffer, unsigned dataSize, unsigned ctrlNum)
 		/* For ICON, "text" is actually the resource name and may not
 		   be a string */
 		/* Don't require quotes on the text entry */
-		unsigned maxCpy;
-
-		lastPos = curPos;
-		while (curPos < dataSize && !CHECK_CHAR('\n') && !CHECK_CHAR(','))
-			curPos++;
 		errorDesc = "Missing control parameters after icon resource ID.";
-		CHECK_SIZE_ERROR(ctrlError);
-		CHECK_NO_NL_ERROR(ctrlError);
-		SAVE_STRING();
-
+		if (!ReadStmtArg(&lex, &tok, &argStart, &argEnd) ||
+			!IS_PUNCT(tok, ','))
+			goto ctrlError;
 		/* Data processing hook */
-		maxCpy = curPos - lastPos;
-		if (maxCpy > 255)
-			maxCpy = 255;
-		strncpy(pCtrl->text, lastString, maxCpy);
-		pCtrl->text[maxCpy] = '\0';
-
-		curPos++; /* Skip the comma */
-		CHECK_SIZE_ERROR(ctrlError);
-		CHECK_NO_NL_ERROR(ctrlError);
-		SKIP_WHITESPACE();
-		CHECK_SIZE_ERROR(ctrlError);
-		CHECK_NO_NL_ERROR(ctrlError);
-
+		SET_SRC_VIEW(pStrs, textView, LAZY_TEXT, argStart, argEnd);
+		NextTmplToken(&lex, &tok); /* Skip the comma */
 		goto readID;
 	}
 
 	errorDesc = "Missing quotes around caption text.";
-	if (!CHECK_CHAR('"'))
+	if (tok.type != TOK_STRING || (tok.flags & TOKF_UNTERMINATED))
 		goto ctrlError;
-	curPos++; /* Skip the quote */
-	lastPos = curPos;
-	while (curPos < dataSize && !CHECK_CHAR('\n') && !CHECK_CHAR('"'))
-	{
-		if (CHECK_CHAR('\\'))
-		{
-			/* Ignore escaped quotation marks */
-			curPos++;
-			CHECK_SIZE_ERROR(ctrlError);
-			CHECK_NO_NL_ERROR(ctrlError);
-		}
-		curPos++;
-	}
-	CHECK_SIZE_ERROR(ctrlError);
-	CHECK_NO_NL_ERROR(ctrlError);
-
-	/* Skip the quote after saving the string so not to include it */
-	SAVE_STRING();
-	if (!CHECK_CHAR('"'))
-		goto ctrlError;
-	curPos++; /* Skip the quote */
-	errorDesc = "Missing control parameters after caption parameter.";
-	CHECK_SIZE_ERROR(ctrlError);
-	CHECK_NO_NL_ERROR(ctrlError);
-
 	/* Data processing hook */
-	{
-		unsigned maxCpy;
-		maxCpy = TransEscapeChars(lastString, strlen(lastString));
-		if (maxCpy > 255)
-			maxCpy = 255;
-		strncpy(pCtrl->text, lastString, maxCpy);
-		pCtrl->text[maxCpy] = '\0';
-	}
-
-	curPos++; /* Skip the comma */
-	CHECK_SIZE_ERROR(ctrlError);
-	CHECK_NO_NL_ERROR(ctrlError);
-	SKIP_WHITESPACE();
-	CHECK_SIZE_ERROR(ctrlError);
-	CHECK_NO_NL_ERROR(ctrlError);
+	/* Do not include the quotes */
+	SET_SRC_VIEW(pStrs, textView, LAZY_TEXT, tok.pos + 1,
+				 tok.pos + tok.len - 1);
+	NextTmplToken(&lex, &tok);
+	errorDesc = "Missing control parameters after caption parameter.";
+	if (!IS_PUNCT(tok, ','))
+		goto ctrlError;
+	NextTmplToken(&lex, &tok); /* Skip the comma */
 
 readID: /* Read the ID */
-	lastPos = curPos;
-	while (curPos < dataSize && !CHECK_CHAR('\n') && !CHECK_CHAR(','))
-		curPos++;
 	errorDesc = "Missing control parameters after ID parameter.";
-	CHECK_SIZE_ERROR(ctrlError);
-	CHECK_NO_NL_ERROR(ctrlError);
-	SAVE_STRING();
-
+	if (!ReadStmtArg(&lex, &tok, &argStart, &argEnd) || !IS_PUNCT(tok, ','))
+		goto ctrlError;
 	/* Data processing hook */
-	pCtrl->id = (char*)xmalloc(curPos - lastPos + 1);
-	strcpy(pCtrl->id, lastString);
-
-	curPos++; /* Skip the comma */
-	CHECK_SIZE_ERROR(ctrlError);
-	CHECK_NO_NL_ERROR(ctrlError);
-	SKIP_WHITESPACE();
-	CHECK_SIZE_ERROR(ctrlError);
-	CHECK_NO_NL_ERROR(ctrlError);
+	SET_SRC_VIEW(pStrs, idView, LAZY_ID, argStart, argEnd);
+	NextTmplToken(&lex, &tok); /* Skip the comma */
 
 	if (pCtrl->rendClass == 0) /* CONTROL */
 	{
 		/* Read the class */
-		lastPos = curPos;
-		while (curPos < dataSize && !CHECK_CHAR('\n') && !CHECK_CHAR(','))
-			curPos++;
 		errorDesc = "Missing control parameters after class parameter.";
-		CHECK_SIZE_ERROR(ctrlError);
-		CHECK_NO_NL_ERROR(ctrlError);
-		SAVE_STRING();
-
+		if (!ReadStmtArg(&lex, &tok, &argStart, &argEnd) ||
+			!IS_PUNCT(tok, ','))
+			goto ctrlError;
 		/* Data processing hook */
-		{
-			unsigned maxCpy;
-			maxCpy = curPos - lastPos;
-			if (maxCpy > 255)
-				maxCpy = 255;
-			strncpy(pCtrl->wndClass, lastString, maxCpy);
-			pCtrl->wndClass[maxCpy] = '\0';
-		}
-
-		curPos++; /* Skip the comma */
-		CHECK_SIZE_ERROR(ctrlError);
-		CHECK_NO_NL_ERROR(ctrlError);
-		SKIP_WHITESPACE();
-		CHECK_SIZE_ERROR(ctrlError);
-		CHECK_NO_NL_ERROR(ctrlError);
+		SET_SRC_VIEW(pStrs, classView, LAZY_CLASS, argStart, argEnd);
+		NextTmplToken(&lex, &tok); /* Skip the comma */
 
 		/* Read the style */
-		lastPos = curPos;
-		while (curPos < dataSize && !CHECK_CHAR('\n') && !CHECK_CHAR(','))
-			curPos++;
 		errorDesc = "Missing control parameters after style parameter.";
-		CHECK_SIZE_ERROR(ctrlError);
-		CHECK_NO_NL_ERROR(ctrlError);
-		SAVE_STRING();
-
+		if (!ReadStmtArg(&lex, &tok, &argStart, &argEnd) ||
+			!IS_PUNCT(tok, ','))
+			goto ctrlError;
 		/* Data processing hook */
-		pCtrl->style = (char*)xmalloc(curPos - lastPos + 1);
-		strcpy(pCtrl->style, lastString);
-
-		curPos++; /* Skip the comma */
-		CHECK_SIZE_ERROR(ctrlError);
-		CHECK_NO_NL_ERROR(ctrlError);
-		SKIP_WHITESPACE();
-		CHECK_SIZE_ERROR(ctrlError);
-		CHECK_NO_NL_ERROR(ctrlError);
+		SET_SRC_VIEW(pStrs, styleView, LAZY_STYLE, argStart, argEnd);
+		styleStart = argStart;
+		styleEnd = argEnd;
+		NextTmplToken(&lex, &tok); /* Skip the comma */
 	}
 
 	/* Read x, y, w, h */
+	errorDesc = "Missing control dimensions.";
 	for (i = 0; i < 4; i++)
 	{
-		lastPos = curPos;
-		while (curPos < dataSize && buffer[curPos] != ',' && !WHITESPACE &&
-			!CHECK_CHAR('\n'))
-			curPos++;
-		if (i < 3)
-			errorDesc = "Missing control dimensions.";
-		else
-			errorDesc = "Missing newline character.";
-		CHECK_SIZE_ERROR(ctrlError);
-		if (i < 3) CHECK_NO_NL_ERROR(ctrlError);
-		SAVE_STRING();
+		if (!ReadStmtArg(&lex, &tok, &argStart, &argEnd))
+			goto ctrlError;
+		if (i < 3 && !IS_PUNCT(tok, ','))
+			goto ctrlError;
 		/* Data processing hook */
 		{
-			int numVal;
-			numVal = atoi(lastString);
+			long numVal;
+			int result;
+			result = SourceIntValue(ctx, &buffer[argStart],
+									argEnd - argStart, &numVal);
+			if (result != EXPR_OK)
+			{
+				errorDesc = (char*)ExprErrorDesc(result);
+				goto ctrlError;
+			}
 			switch (i)
 			{
-			case 0: pCtrl->x = numVal; break;
-			case 1: pCtrl->y = numVal; break;
-			case 2: pCtrl->cx = numVal; break;
-			case 3: pCtrl->cy = numVal; break;
+			case 0: pCtrl->x = (int)numVal; break;
+			case 1: pCtrl->y = (int)numVal; break;
+			case 2: pCtrl->cx = (int)numVal; break;
+			case 3: pCtrl->cy = (int)numVal; break;
 			}
+			/* Keep the text of expressions and symbols for saving */
+			pStrs->coordVal[i] = (int)numVal;
+			if (!IsPlainInt(&buffer[argStart], argEnd - argStart))
+				pStrs->coordSrc[i] =
+					InternSourceText(&buffer[argStart],
+									 argEnd - argStart, UINT_MAX);
 		}
-		if (CHECK_CHAR(','))
-			curPos++;
-		SKIP_WHITESPACE();
-		CHECK_SIZE_ERROR(ctrlError);
-		if (i < 3) CHECK_NO_NL_ERROR(ctrlError);
+		if (i < 3)
+			NextTmplToken(&lex, &tok); /* Skip the comma */
 	}
 
 	/* Read the style and extended style */
-	/* Just save the entire line ending */
-	lastPos = curPos;
-	while (curPos < dataSize && !CHECK_CHAR('\n'))
-		curPos++;
-	CHECK_SIZE_ERROR(ctrlError);
-	SAVE_STRING();
+	/* Just save the rest of the statement */
+	argStart = tok.pos;
+	argEnd = tok.pos;
+	if (IS_PUNCT(tok, ','))
+	{
+		unsigned restStart;
+		unsigned numArgs;
+		errorDesc = "Missing control style.";
+		NextTmplToken(&lex, &tok); /* Skip the comma */
+		restStart = tok.pos;
+		numArgs = 0;
+		do
+		{
+			if (!ReadStmtArg(&lex, &tok, &argStart, &argEnd))
+				goto ctrlError;
+			/* CONTROL has only the extended style here.  The other
+			   types have the style and then the extended style. */
+			numArgs++;
+			if (numArgs == 1 && pCtrl->rendClass != 0)
+			{
+				styleStart = argStart;
+				styleEnd = argEnd;
+			}
+			else if (numArgs == 1 ||
+					 (numArgs == 2 && pCtrl->rendClass != 0))
+			{
+				exStyleStart = argStart;
+				exStyleEnd = argEnd;
+			}
+			if (!IS_PUNCT(tok, ','))
+				break;
+			NextTmplToken(&lex, &tok); /* Skip the comma */
+		} while (1);
+		argStart = restStart;
+	}
 	if (pCtrl->rendClass == 0)
 	{
 		/* Save in exStyle */
-		pCtrl->exStyle = (char*)xmalloc(curPos - lastPos + 1);
-		strcpy(pCtrl->exStyle, lastString);
+		SET_SRC_VIEW(pStrs, exStyleView, LAZY_EXSTYLE, argStart, argEnd);
 	}
 	else
 	{
 		/* Save in style */
-		pCtrl->style = (char*)xmalloc(curPos - lastPos + 1);
-		strcpy(pCtrl->style, lastString);
-		pCtrl->exStyle = NULL;
-	}
-	errorDesc = "Missing newline character.";
-	curPos++; /* Skip the newline character */
-	curLine++;
-	CHECK_SIZE_ERROR(ctrlError);
-	goto noCtrlError;
+		SET_SRC_VIEW(pStrs, styleView, LAZY_STYLE, argStart, argEnd);
+	}
+	/* Data processing hook */
+	/* Decode the masks now, since painting needs them for every
+	   control */
+	pCtrl->style = CTRL_BASE_STYLE |
+		defCtrlStyles[pCtrl->rendClass][pCtrl->rendType];
+	if (!EvalStyleExpr(&buffer[styleStart], styleEnd - styleStart,
+					   &pCtrl->style))
+		pCtrl->styleFlags |= CSF_STYLE_UNRESOLVED;
+	if (!EvalStyleExpr(&buffer[exStyleStart], exStyleEnd - exStyleStart,
+					   &pCtrl->exStyle))
+		pCtrl->styleFlags |= CSF_EXSTYLE_UNRESOLVED;
+	if (ctx->lazyFields == FALSE)
+		DecodeCtrlFields(ctx->dlg, ctrlNum, buffer, pStrs->lazyMask);
+	ctx->curPos = tok.pos;
+	ctx->curLine = tok.line;
+	return TRUE;
 ctrlError:
-	xfree(lastString);
+	if (ctx->lazyFields == FALSE)
+		DecodeCtrlFields(ctx->dlg, ctrlNum, buffer, pStrs->lazyMask);
+	ctx->curPos = tok.pos;
+	ctx->curLine = tok.line;
+	ctx->errorDesc = errorDesc;
 	return FALSE;
-noCtrlError:
-	xfree(lastString);
-	return TRUE;
+}
+
+/* Decodes the strings named in "mask" that have not been decoded yet
+   from the source text "src". */
+static void DecodeCtrlFields(DlgTemplate* dlg, unsigned ctrlNum,
+							 const char* src, unsigned mask)
+{
+	DlgItem* pCtrl;
+	DlgItemStrs* pStrs;
+	pCtrl = &dlg->controls.d[ctrlNum];
+	pStrs = &dlg->ctrlStrs.d[ctrlNum];
+	mask &= pStrs->lazyMask;
+	if (mask & LAZY_TEXT)
+	{
+		SrcView* view;
+		view = &pStrs->textView;
+		/* For ICON, "text" is the resource name and is not a string */
+		if (pCtrl->rendClass == 3 && pCtrl->rendType == 3)
+			pStrs->text = ArenaSourceText(dlg, &src[view->pos], view->len);
+		else
+			pStrs->text = ArenaStringText(dlg, &src[view->pos], view->len);
+	}
+	if (mask & LAZY_CLASS)
+		pStrs->wndClass = InternSourceText(&src[pStrs->classView.pos],
+										   pStrs->classView.len,
+										   MAX_CTRL_TEXT);
+	if (mask & LAZY_ID)
+		pStrs->id = InternSourceText(&src[pStrs->idView.pos],
+									 pStrs->idView.len, UINT_MAX);
+	if (mask & LAZY_STYLE)
+		pStrs->style = InternSourceText(&src[pStrs->styleView.pos],
+										pStrs->styleView.len, UINT_MAX);
+	if (mask & LAZY_EXSTYLE)
+		pStrs->exStyle = InternSourceText(&src[pStrs->exStyleView.pos],
+										  pStrs->exStyleView.len, UINT_MAX);
+	pStrs->lazyMask &= ~mask;
+}
+
+/* Field accessors.  These decode the string first if it was parsed
+   lazily, so they work for any dialog template. */
+
+/* Returns an empty string for controls without text. */
+const char* GetCtrlText(DlgTemplate* dlg, unsigned ctrlNum)
+{
+	DlgItemStrs* pStrs;
+	pStrs = &dlg->ctrlStrs.d[ctrlNum];
+	if (pStrs->lazyMask & LAZY_TEXT)
+		DecodeCtrlFields(dlg, ctrlNum, dlg->source, LAZY_TEXT);
+	return (pStrs->text != NULL) ? pStrs->text : "";
+}
+
+const char* GetCtrlClass(DlgTemplate* dlg, unsigned ctrlNum)
+{
+	DlgItemStrs* pStrs;
+	pStrs = &dlg->ctrlStrs.d[ctrlNum];
+	if (pStrs->lazyMask & LAZY_CLASS)
+		DecodeCtrlFields(dlg, ctrlNum, dlg->source, LAZY_CLASS);
+	return pStrs->wndClass;
+}
+
+const char* GetCtrlId(DlgTemplate* dlg, unsigned ctrlNum)
+{
+	DlgItemStrs* pStrs;
+	pStrs = &dlg->ctrlStrs.d[ctrlNum];
+	if (pStrs->lazyMask & LAZY_ID)
+		DecodeCtrlFields(dlg, ctrlNum, dlg->source, LAZY_ID);
+	return pStrs->id;
+}
+
+const char* GetCtrlStyle(DlgTemplate* dlg, unsigned ctrlNum)
+{
+	DlgItemStrs* pStrs;
+	pStrs = &dlg->ctrlStrs.d[ctrlNum];
+	if (pStrs->lazyMask & LAZY_STYLE)
+		DecodeCtrlFields(dlg, ctrlNum, dlg->source, LAZY_STYLE);
+	return pStrs->style;
+}
+
+/* Returns NULL for controls other than CONTROL, whose extended style
+   is part of "style". */
+const char* GetCtrlExStyle(DlgTemplate* dlg, unsigned ctrlNum)
+{
+	DlgItemStrs* pStrs;
+	pStrs = &dlg->ctrlStrs.d[ctrlNum];
+	if (pStrs->lazyMask & LAZY_EXSTYLE)
+		DecodeCtrlFields(dlg, ctrlNum, dlg->source, LAZY_EXSTYLE);
+	return pStrs->exStyle;
+}
+
+/* Evaluates the ID of a control with the symbols of the context.
+   Returns EXPR_OK or the error (see rcexpr.h). */
+int EvalCtrlId(ParseCtx* ctx, unsigned ctrlNum, long* pValue)
+{
+	const char* id;
+	id = GetCtrlId(ctx->dlg, ctrlNum);
+	return SourceIntValue(ctx, id, strlen(id), pValue);
+}
+
+/* Decodes all of the lazy fields of a dialog template, so that the
+   buffer that it was parsed from is no longer needed. */
+void DecodeDlgFields(DlgTemplate* dlg)
+{
+	unsigned i;
+	if (dlg->source == NULL)
+		return;
+	for (i = 0; i < dlg->controls.len; i++)
+	{
+		if (dlg->ctrlStrs.d[i].lazyMask != 0)
+			DecodeCtrlFields(dlg, i, dlg->source,
+							 dlg->ctrlStrs.d[i].lazyMask);
+	}
+	dlg->source = NULL;
+}
+
+/* Adds the control that was parsed into the first unused index of the
+   dialog template's control arrays.  The arrays always have room for
+   that one control. */
+void AddDlgItem(DlgTemplate* dlg)
+{
+	EA_ADD(DlgItem, dlg->controls);
+	EA_ADD(DlgItemStrs, dlg->ctrlStrs);
+	CtrlGridAdd(dlg);
+}
+
+/* Bytes of released control text after which the dialog's string
+   arena is rebuilt with only the text that is still in use */
+#define RECLAIM_TEXT_SIZE 4096
+
+/* Releases the interned strings of a control and leaves its string
+   fields empty.  The text is left in the string arena. */
+static void ReleaseCtrlStrs(DlgItemStrs* pStrs)
+{
+	unsigned i;
+	ReleaseStr(pStrs->wndClass);
+	ReleaseStr(pStrs->id);
+	ReleaseStr(pStrs->style);
+	ReleaseStr(pStrs->exStyle);
+	for (i = 0; i < 4; i++)
+	{
+		ReleaseStr(pStrs->coordSrc[i]);
+		pStrs->coordSrc[i] = NULL;
+	}
+	pStrs->text = NULL;
+	pStrs->wndClass = NULL;
+	pStrs->id = NULL;
+	pStrs->style = NULL;
+	pStrs->exStyle = NULL;
+	pStrs->lazyMask = 0;
+}
+
+/* Copies the text of the controls into a new string arena and frees
+   the old one, along with the text that controls no longer use. */
+static void ReclaimDlgText(DlgTemplate* dlg)
+{
+	StrArena strings;
+	unsigned i;
+	InitStrArena(&strings);
+	for (i = 0; i < dlg->ctrlStrs.len; i++)
+	{
+		DlgItemStrs* pStrs;
+		pStrs = &dlg->ctrlStrs.d[i];
+		if (pStrs->text != NULL)
+			pStrs->text = StrArenaDup(&strings, pStrs->text,
+									  strlen(pStrs->text));
+	}
+	FreeStrArena(&dlg->strings);
+	dlg->strings = strings;
+	dlg->deadText = 0;
+}
+
+/* Releases the interned strings of a control (see strintern.h) and
+   leaves its string fields empty.  This must be done before a control
+   is parsed again, or when a control that could not be parsed is not
+   added.  The text cannot be freed on its own, so it is counted, and
+   once enough of the string arena is unused, the text that is still
+   in use is moved to a new arena.  Pointers returned by GetCtrlText()
+   are not valid after this call. */
+void FreeDlgItemStrs(DlgTemplate* dlg, unsigned ctrlNum)
+{
+	DlgItemStrs* pStrs;
+	pStrs = &dlg->ctrlStrs.d[ctrlNum];
+	if (pStrs->text != NULL)
+		dlg->deadText += strlen(pStrs->text) + 1;
+	ReleaseCtrlStrs(pStrs);
+	if (dlg->deadText >= RECLAIM_TEXT_SIZE)
+		ReclaimDlgText(dlg);
+}
+
+/* Removes a control from the dialog template. */
+void RemoveDlgItem(DlgTemplate* dlg, unsigned ctrlNum)
+{
+	FreeDlgItemStrs(dlg, ctrlNum);
+	CtrlGridRemove(dlg, ctrlNum);
+	EA_REMOVE(DlgItem, dlg->controls, ctrlNum);
+	EA_REMOVE(DlgItemStrs, dlg->ctrlStrs, ctrlNum);
+}
+
+/* Call this after changing the position or size of a control, so
+   that the spatial index follows it. */
+void UpdateDlgItemRect(DlgTemplate* dlg, unsigned ctrlNum)
+{
+	CtrlGridMove(dlg, ctrlNum);
+}
+
+/* Keeps the text after the end marker of the control list, such as
+   the other resources of a resource script, so that it is written back
+   unchanged when the template is saved.  Like the header, it is kept
+   with Unix line endings.  If there is only whitespace, nothing is
+   kept, and a line break is written after the end marker. */
+static void SaveDlgTail(DlgTemplate* dlg, const char* buffer,
+						unsigned dataSize, unsigned tailStart)
+{
+	unsigned i;
+	unsigned tailLen;
+	for (i = tailStart; i < dataSize; i++)
+	{
+		if (!(CHAR_CLASS(buffer[i]) & (CC_SPACE | CC_NL)))
+			break;
+	}
+	if (i == dataSize)
+		return;
+	tailLen = dataSize - tailStart;
+	dlg->tail = (char*)xmalloc(tailLen + 1);
+	memcpy(dlg->tail, &buffer[tailStart], tailLen);
+	dlg->tail[tailLen] = '\0';
+	tailLen = SetUnixNlChars(dlg->tail, tailLen);
+	dlg->tail[tailLen] = '\0';
+}
+
+/* Puts the errors of a template in file order.  The preprocessor
+   lines are read first, so their errors come before the others.  The
+   lists are short, and the sort keeps the order of errors at the same
+   position. */
+static void SortParseDiags(ParseDiag* diags, unsigned numDiags)
+{
+	unsigned i, j;
+	for (i = 1; i < numDiags; i++)
+	{
+		ParseDiag diag;
+		diag = diags[i];
+		for (j = i; j > 0 && diags[j-1].pos > diag.pos; j--)
+			diags[j] = diags[j-1];
+		diags[j] = diag;
+	}
+}
+
+/* Moves the cursor of the context past a control statement that
+   could not be parsed, in recovery mode.  Parsing goes on at the token
+   where the statement broke off if that token starts a line after the
+   statement's first line, and otherwise at the next line. */
+static void SkipBadStatement(ParseCtx* ctx, const char* buffer,
+							 unsigned dataSize, unsigned stmtStart)
+{
+	TmplLexer lex;
+	TmplToken tok;
+	unsigned pos;
+	pos = ctx->curPos;
+	while (pos > 0 && CHAR_CLASS(buffer[pos-1]) == CC_SPACE)
+		pos--;
+	if (ctx->curPos > stmtStart &&
+		(pos == 0 || CHAR_CLASS(buffer[pos-1]) == CC_NL))
+		return;
+	InitSrcLexer(ctx, &lex, buffer, dataSize, ctx->curPos, ctx->curLine);
+	NextTmplToken(&lex, &tok); /* Where the statement broke off */
+	do
+		NextTmplToken(&lex, &tok);
+	while (tok.type != TOK_EOF && !(tok.flags & TOKF_BOL));
+	ctx->curPos = tok.pos;
+	ctx->curLine = tok.line;
+}
+
+/* Parses a complete dialog template (the header followed by the
+   control list) into the context's dialog template.  The buffer is
+   only read, need not be null terminated, and may have either Unix or
+   Windows line endings, so a memory mapped file can be parsed in
+   place.  On failure, the dialog template is freed and the context
+   holds the error.  In recovery mode (ParseCtx.diags), the parser
+   skips each statement that has an error and goes on, so that all of
+   the errors are recorded, and the context holds the first one.
+
+   "dataSize" specifies the length of the data in the buffer. */
+BOOL ParseDlgTemplate(ParseCtx* ctx, const char* buffer,
+					  unsigned dataSize)
+{
+	DlgTemplate* dlg;
+	TmplLexer lex;
+	TmplToken tok;
+	ProfMark mark;
+	TmplSkip_array skips;
+	unsigned headEnd;
+	unsigned numLines;
+	unsigned firstDiag;
+	BOOL retVal;
+	dlg = ctx->dlg;
+	firstDiag = (ctx->diags != NULL) ? ctx->diags->len : 0;
+	/* Remember the line endings so that they can be kept on save */
+	ProfBegin(&mark);
+	dlg->nlStyle = DetectNlStyle(buffer, dataSize);
+	/* Controls are written one to a line, so the number of lines is
+	   a close upper bound on the number of controls.  Allocating the
+	   arrays for that many up front saves regrowing them while
+	   parsing; EA_ADD() still grows them if a line holds more. */
+	numLines = CountNlChars(buffer, dataSize,
+						   (dlg->nlStyle == NL_CR) ? '\r' : '\n');
+	ProfEnd(&mark, PROF_NL_NORM, dataSize);
+	EA_INIT(DlgItem, dlg->controls, 16);
+	EA_INIT(DlgItemStrs, dlg->ctrlStrs, 16);
+	EA_RESERVE(DlgItem, dlg->controls, numLines);
+	EA_RESERVE(DlgItemStrs, dlg->ctrlStrs, numLines);
+	retVal = FALSE;
+	ProfBegin(&mark);
+	/* Only a source with a '#' can have preprocessor lines */
+	dlg->syms = NULL;
+	dlg->tail = NULL;
+	skips.d = NULL;
+	skips.len = 0;
+	if (dataSize > 0 && memchr(buffer, '#', dataSize) != NULL)
+	{
+		dlg->syms = (SymTable*)xmalloc(sizeof(SymTable));
+		InitSymTable(dlg->syms);
+		dlg->syms->parentLookup = ctx->symLookup;
+		dlg->syms->parentParam = ctx->symParam;
+		EA_INIT(TmplSkip, skips, 16);
+		if (!PreprocessTmpl(ctx, buffer, dataSize, dlg->syms, &skips))
+		{
+			ProfEnd(&mark, PROF_HEAD, ctx->curPos);
+			goto parseEnd;
+		}
+		ctx->skips = skips.d;
+		ctx->numSkips = skips.len;
+	}
+	if (!ParseDlgHead(ctx, buffer, dataSize))
+	{
+		/* Nothing can be parsed without the header */
+		AddParseDiag(ctx, buffer, ctx->curPos, ctx->curLine, PDIAG_HEAD,
+					 ctx->errorDesc);
+		ProfEnd(&mark, PROF_HEAD, ctx->curPos);
+		goto parseEnd;
+	}
+	headEnd = ctx->curPos;
+	ProfEnd(&mark, PROF_HEAD, headEnd);
+	ProfBegin(&mark);
+	while (1)
+	{
+		/* Check for "END" or '}' */
+		InitSrcLexer(ctx, &lex, buffer, dataSize, ctx->curPos,
+					 ctx->curLine);
+		PeekTmplToken(&lex, &tok);
+		if (tok.type == TOK_EOF)
+		{
+			AddParseDiag(ctx, buffer, tok.pos, tok.line, PDIAG_END,
+						 "Missing ending marker of dialog control list.");
+			ProfEnd(&mark, PROF_CONTROLS, tok.pos - headEnd);
+			goto parseEnd;
+		}
+		if (IS_PUNCT(tok, '}') || tok.keyword == KW_END)
+		{
+			SaveDlgTail(dlg, buffer, dataSize, tok.pos + tok.len);
+			break;
+		}
+		if (!ParseControl(ctx, buffer, dataSize, dlg->controls.len))
+		{
+			if (!AddParseDiag(ctx, buffer, ctx->curPos, ctx->curLine,
+							  PDIAG_CONTROL, ctx->errorDesc))
+			{
+				/* Do fully safe cleanup */
+				AddDlgItem(dlg);
+				ProfEnd(&mark, PROF_CONTROLS, ctx->curPos - headEnd);
+				goto parseEnd;
+			}
+			/* Leave the control out and go on */
+			FreeDlgItemStrs(dlg, dlg->controls.len);
+			SkipBadStatement(ctx, buffer, dataSize, tok.pos);
+			continue;
+		}
+		AddDlgItem(dlg);
+	}
+	/* Give back the room of the header, blank, and comment lines if
+	   it is a lot */
+	if (dlg->controls.ea_len_alloc > dlg->controls.len * 2 + 16)
+	{
+		EA_SHRINK_TO_FIT(DlgItem, dlg->controls);
+		EA_SHRINK_TO_FIT(DlgItemStrs, dlg->ctrlStrs);
+	}
+	ProfEnd(&mark, PROF_CONTROLS, ctx->curPos - headEnd);
+	/* Keep the symbols only if there are any */
+	if (dlg->syms != NULL && dlg->syms->entries.len == 0)
+	{
+		FreeSymTable(dlg->syms);
+		xfree(dlg->syms);
+		dlg->syms = NULL;
+	}
+	retVal = TRUE;
+parseEnd:
+	/* A template with recorded errors still fails, with the first
+	   error in the file in the context */
+	if (ctx->diags != NULL && ctx->diags->len > firstDiag)
+	{
+		SortParseDiags(&ctx->diags->d[firstDiag],
+					   ctx->diags->len - firstDiag);
+		ctx->curPos = ctx->diags->d[firstDiag].pos;
+		ctx->curLine = ctx->diags->d[firstDiag].line;
+		ctx->errorDesc = (char*)ctx->diags->d[firstDiag].message;
+		retVal = FALSE;
+	}
+	/* The skip ranges are only needed while parsing */
+	ctx->skips = NULL;
+	ctx->numSkips = 0;
+	if (skips.d != NULL)
+		EA_DESTROY(TmplSkip, skips);
+	if (retVal == FALSE)
+		FreeDlgData(dlg);
+	return retVal;
 }
 
 /* All we really do for this function is parse and update the relevant
    fields. */
-void FmtDlgHeader()
+void FmtDlgHeader(ParseCtx* ctx)
 {
-	char* buffer;
+	DlgTemplate* dlg;
+	TmplLexer lex;
+	TmplToken tok;
 	unsigned dataSize;
-	unsigned lastPos;
-	buffer = dlgHead;
-	dataSize = strlen(dlgHead);
-	curPos = 0;
-	lastPos = 0;
-	/* Skip whitespace and newlines */
-	while (curPos < dataSize && WS_AND_NL)
-	{
-		if (CHECK_CHAR('\n'))
-			curLine++;
-		curPos++;
-	}
-	CHECK_SIZE_ERROR(fmtHInternalErr);
-	if (CHECK_CHAR('\n'))
-		goto fmtHInternalErr;
+	unsigned coordStart, argStart, argEnd;
+	unsigned i;
+	dlg = ctx->dlg;
+	dataSize = strlen(dlg->head);
+	InitTmplLexer(&lex, dlg->head, dataSize, dlg->headStart, 1);
 
 	/* Skip ID */
-	lastPos = curPos;
-	while (curPos < dataSize && !WS_AND_NL)
-		curPos++;
-	CHECK_SIZE_ERROR(fmtHInternalErr);
-	if (CHECK_CHAR('\n'))
+	NextTmplToken(&lex, &tok);
+	if (tok.type == TOK_EOF)
 		goto fmtHInternalErr;
-
-	SKIP_WHITESPACE();
-	CHECK_SIZE_ERROR(fmtHInternalErr);
-	if (CHECK_CHAR('\n'))
-		goto fmtHInternalErr;
-
 	/* Skip DIALOG or DIALOGEX */
-	lastPos = curPos;
-	while (curPos < dataSize && !WS_AND_NL)
-		curPos++;
-	CHECK_SIZE_ERROR(fmtHInternalErr);
-	if (CHECK_CHAR('\n'))
+	NextTmplToken(&lex, &tok);
+	if (tok.type != TOK_IDENT)
 		goto fmtHInternalErr;
+	NextTmplToken(&lex, &tok);
+	while (IsMemoryOption(tok.keyword))
+		NextTmplToken(&lex, &tok);
 
-	SKIP_WHITESPACE();
-	CHECK_SIZE_ERROR(fmtHInternalErr);
-	if (CHECK_CHAR('\n'))
-		goto fmtHInternalErr;
-
-	/* Delete the old coordinates */
-	lastPos = curPos;
-	while (curPos < dataSize && !CHECK_CHAR('\n'))
-		curPos++;
-	CHECK_SIZE_ERROR(fmtHInternalErr);
-	/* (dataSize + 1) Move the null character too */
-	memmove(&dlgHead[lastPos], &dlgHead[curPos], (dataSize + 1) - curPos);
-	dataSize -= curPos - lastPos;
-	curPos = lastPos;
+	/* Find the old coordinates */
+	coordStart = tok.pos;
+	for (i = 0; i < 4; i++)
+	{
+		if (!ReadStmtArg(&lex, &tok, &argStart, &argEnd))
+			goto fmtHInternalErr;
+		if (i < 3)
+		{
+			if (!IS_PUNCT(tok, ','))
+				goto fmtHInternalErr;
+			NextTmplToken(&lex, &tok);
+		}
+	}
 
-	/* Write the updated ones */
+	/* Replace them with the updated ones */
 	{
 		char* outString;
+		unsigned outLen;
 		/* Per programming convention, data (as opposed to single
 		   variables) are always stored on the heap. */
 		/* Maximum buffer size assuming 32-bit integers */
 		outString = (char*)xmalloc(11 * 4 + 2 * 4 + 1);
 		sprintf(outString, "%li, %li, %li, %li",
-			dlgPos.x, dlgPos.y, dlgWidth, dlgHeight);
-
-		dlgHead = (char*)xrealloc(dlgHead, dataSize + strlen(outString) + 1);
-		memmove(&dlgHead[curPos+strlen(outString)], &dlgHead[curPos],
-			(strlen(dlgHead) + 1) - curPos); /* Move the null character too */
-		strncpy(&dlgHead[curPos], outString, strlen(outString));
-		dataSize += strlen(outString);
+			dlg->pos.x, dlg->pos.y, dlg->width, dlg->height);
+		outLen = strlen(outString);
+
+		if (outLen > argEnd - coordStart)
+			dlg->head = (char*)xrealloc(dlg->head, dataSize - (argEnd -
+				coordStart) + outLen + 1);
+		/* (dataSize + 1) Move the null character too */
+		memmove(&dlg->head[coordStart+outLen], &dlg->head[argEnd],
+			(dataSize + 1) - argEnd);
+		memcpy(&dlg->head[coordStart], outString, outLen);
 		xfree(outString);
 	}
 
 	/* TODO: Update the font, need to store font family for this to work. */
-fmtHInternalErr: ; /* This should never happen, but the label is here
-					  in case it ever does. */
+fmtHInternalErr: /* This should never happen, but the label is here
+				   in case it ever does. */
+	return;
 }
 
-#define WRITE_DLG_VAR_TEXT(varname) \
-	line = (char*)xrealloc(line, lineLen + strlen(pCtrl->varname) + 1); \
-	strcpy(&line[lineLen], pCtrl->varname); \
-	lineLen += strlen(pCtrl->varname);
+/* Output cursor for the serializer.  When "d" is NULL, nothing is
+   written and only the length is counted, so that the output buffer
+   can be sized exactly before anything is written to it. */
+struct TextOut_t
+{
+	char* d;
+	unsigned len;
+};
 
-#define WRITE_COMMA() \
-	line = (char*)xrealloc(line, lineLen + 3); \
-	strcpy(&line[lineLen], ", "); \
-	lineLen += 2;
+typedef struct TextOut_t TextOut;
 
-/* The caller of this function MUST xfree the returned memory. */
-heap_char FmtControlText(unsigned ctrlNum)
+static void PutText(TextOut* out, const char* text, unsigned len)
 {
-	char* line;
-	unsigned lineLen;
-	DlgItem* pCtrl;
-	/* Temporary variables */
-	unsigned i, j;
+	if (out->d != NULL)
+		memcpy(&out->d[out->len], text, len);
+	out->len += len;
+}
 
-	lineLen = 0;
-	pCtrl = &dlgControls.d[ctrlNum];
-	/* Write an initial tab */
-	line = (char*)xmalloc(2);
-	strcpy(&line[lineLen], "\t");
-	lineLen += 1;
+#define PutStr(out, str) PutText(out, str, strlen(str))
 
-	/* Write the control name */
-	for (i = 0; i < numClasses; i++)
+/* Writes text with special characters replaced by escape codes */
+static void PutEscaped(TextOut* out, const char* text)
+{
+	unsigned len;
+	len = strlen(text);
+	if (out->d != NULL)
+		out->len += EscapeText(&out->d[out->len], text, len);
+	else
+		out->len += CountEscapedLen(text, len);
+}
+
+/* Writes a decimal integer.  The digits are generated two at a time
+   from the end, which is much faster than sprintf(). */
+static void PutInt(TextOut* out, long value)
+{
+	static const char digitPairs[] =
+		"00010203040506070809101112131415161718192021222324"
+		"25262728293031323334353637383940414243444546474849"
+		"50515253545556575859606162636465666768697071727374"
+		"75767778798081828384858687888990919293949596979899";
+	char numText[24];
+	unsigned long mag;
+	unsigned i;
+	/* Negate as unsigned so that the most negative value works */
+	mag = (value < 0) ? 0UL - (unsigned long)value : (unsigned long)value;
+	i = sizeof(numText);
+	while (mag >= 100)
 	{
-		for (j = 0; j < numEachClass[i]; j++)
-		{
-			if (pCtrl->rendClass == i && pCtrl->rendType == j)
-			{
-				line = (char*)xrealloc(line, lineLen +
-					strlen(drawClasses[i][j]) + 1);
-				strcpy(&line[lineLen], drawClasses[i][j]);
-				lineLen += strlen(drawClasses[i][j]);
-				break;
-			}
-		}
+		unsigned pair;
+		pair = (unsigned)(mag % 100) * 2;
+		mag /= 100;
+		numText[--i] = digitPairs[pair+1];
+		numText[--i] = digitPairs[pair];
+	}
+	if (mag >= 10)
+	{
+		numText[--i] = digitPairs[mag*2+1];
+		numText[--i] = digitPairs[mag*2];
+	}
+	else
+		numText[--i] = (char)('0' + mag);
+	if (value < 0)
+		numText[--i] = '-';
+	PutText(out, &numText[i], sizeof(numText) - i);
+}
+
+/* Writes coordinate "i" of a control.  The source text is kept
+   unless the value was changed after parsing. */
+static void PutCoord(TextOut* out, DlgItemStrs* pStrs, unsigned i,
+					 int value)
+{
+	if (pStrs->coordSrc[i] != NULL && pStrs->coordVal[i] == value)
+		PutStr(out, pStrs->coordSrc[i]);
+	else
+		PutInt(out, value);
+}
+
+/* Writes a line break in the given style (see nlconv.h) */
+static void PutNewline(TextOut* out, int nlStyle)
+{
+	if (nlStyle == NL_CRLF)
+		PutText(out, "\r\n", 2);
+	else if (nlStyle == NL_CR)
+		PutText(out, "\r", 1);
+	else
+		PutText(out, "\n", 1);
+}
+
+/* Writes text that has Unix line endings in the given style */
+static void PutLines(TextOut* out, const char* text, unsigned len,
+					 int nlStyle)
+{
+	if (nlStyle == NL_CRLF)
+	{
+		if (out->d != NULL)
+			out->len += ConvLfToCrlf(&out->d[out->len], text, len);
+		else
+			out->len += CountLfToCrlf(text, len);
+		return;
 	}
+	PutText(out, text, len);
+	if (nlStyle == NL_CR && out->d != NULL)
+		ConvLfToCr(&out->d[out->len-len], len);
+}
 
-	/* Write a space */
-	line = (char*)xrealloc(line, lineLen + 2);
-	strcpy(&line[lineLen], " ");
-	lineLen += 1;
+/* Writes the statement for one control, including the line break at
+   the end. */
+static void PutControl(TextOut* out, DlgTemplate* dlg, unsigned ctrlNum,
+					   int nlStyle)
+{
+	DlgItem* pCtrl;
+	DlgItemStrs* pStrs;
+	pCtrl = &dlg->controls.d[ctrlNum];
+	pStrs = &dlg->ctrlStrs.d[ctrlNum];
+
+	/* Write an initial tab, the control name, and a space */
+	PutText(out, "\t", 1);
+	PutStr(out, CtrlTypeName(pCtrl->rendClass, pCtrl->rendType));
+	PutText(out, " ", 1);
 
 	/* Write the caption */
 	/* Should SCROLLBAR really allow text? For now, no. */
@@ -869,110 +1738,187 @@ heap_char FmtControlText(unsigned ctrlNum)
 	{
 		/* Don't write quotes for this part of the ICON control
 		   statement, because it is a resource identifier. */
-		WRITE_DLG_VAR_TEXT(text);
-		WRITE_COMMA();
+		PutStr(out, GetCtrlText(dlg, ctrlNum));
+		PutText(out, ", ", 2);
 	}
 	else if ((pCtrl->rendClass != 3 || /* Client boxes */
 		pCtrl->rendType == 3) && /* ICON */
 		pCtrl->rendClass != 7) /* Scrollbar */
 	{
-		char* untransLine;
-		unsigned oldLen;
-		unsigned untrLen;
-		/* Write a quote */
-		line = (char*)xrealloc(line, lineLen + 2);
-		strcpy(&line[lineLen], "\"");
-		lineLen += 1;
-
-		/* Translate special characters to escape codes */
-		oldLen = strlen(pCtrl->text);
-		untransLine = (char*)xmalloc(oldLen + 1);
-		strcpy(untransLine, pCtrl->text);
-		untransLine = UntransEscChars(untransLine, oldLen);
-		untrLen = strlen(untransLine);
-		line = (char*)xrealloc(line, lineLen + untrLen + 1);
-		strcpy(&line[lineLen], untransLine);
-		lineLen += untrLen;
-		xfree(untransLine);
-		/* WRITE_DLG_VAR_TEXT(text); */
-
-		/* Write a quote */
-		line = (char*)xrealloc(line, lineLen + 2);
-		strcpy(&line[lineLen], "\"");
-		lineLen += 1;
-		WRITE_COMMA();
+		PutText(out, "\"", 1);
+		PutEscaped(out, GetCtrlText(dlg, ctrlNum));
+		PutText(out, "\", ", 3);
 	}
 
 	/* Write the ID */
-	WRITE_DLG_VAR_TEXT(id);
-	WRITE_COMMA();
+	PutStr(out, GetCtrlId(dlg, ctrlNum));
+	PutText(out, ", ", 2);
 
 	if (pCtrl->rendClass == 0) /* CONTROL */
 	{
-		/* Write the class */
-		WRITE_DLG_VAR_TEXT(wndClass);
-		WRITE_COMMA();
-
-		/* Write the style */
-		WRITE_DLG_VAR_TEXT(style);
-		WRITE_COMMA();
+		/* Write the class and the style */
+		PutStr(out, GetCtrlClass(dlg, ctrlNum));
+		PutText(out, ", ", 2);
+		PutStr(out, GetCtrlStyle(dlg, ctrlNum));
+		PutText(out, ", ", 2);
 	}
 
 	/* Write x, y, w, h */
-	{
-		char* outString;
-		/* Per programming convention, data (as opposed to single
-		   variables) are always stored on the heap. */
-		/* Maximum buffer size assuming 32-bit integers */
-		outString = (char*)xmalloc(11 * 4 + 2 * 4 + 1);
-		sprintf(outString, "%i, %i, %i, %i",
-			pCtrl->x, pCtrl->y, pCtrl->cx, pCtrl->cy);
-
-		line = (char*)xrealloc(line, lineLen + strlen(outString) + 1);
-		strcpy(&line[lineLen], outString);
-		lineLen += strlen(outString);
-		xfree(outString);
-	}
+	PutCoord(out, pStrs, 0, pCtrl->x);
+	PutText(out, ", ", 2);
+	PutCoord(out, pStrs, 1, pCtrl->y);
+	PutText(out, ", ", 2);
+	PutCoord(out, pStrs, 2, pCtrl->cx);
+	PutText(out, ", ", 2);
+	PutCoord(out, pStrs, 3, pCtrl->cy);
 
 	/* Write the style and extended style */
 	if (pCtrl->rendClass == 0)
 	{
-		if (strlen(pCtrl->exStyle) != 0)
+		const char* exStyle;
+		exStyle = GetCtrlExStyle(dlg, ctrlNum);
+		if (exStyle[0] != '\0')
 		{
-			WRITE_COMMA();
-			/* Write exStyle */
-			WRITE_DLG_VAR_TEXT(exStyle);
+			PutText(out, ", ", 2);
+			PutStr(out, exStyle);
 		}
 	}
-	else if (strlen(pCtrl->style) != 0)
+	else
 	{
-		WRITE_COMMA();
-		/* Just write style, it contains exStyle too */
-		WRITE_DLG_VAR_TEXT(style);
+		const char* style;
+		style = GetCtrlStyle(dlg, ctrlNum);
+		if (style[0] != '\0')
+		{
+			/* Just write style, it contains exStyle too */
+			PutText(out, ", ", 2);
+			PutStr(out, style);
+		}
 	}
 
-	/* Write a newline character */
-	line = (char*)xrealloc(line, lineLen + 2);
-	strcpy(&line[lineLen], "\n");
-	lineLen += 1;
+	PutNewline(out, nlStyle);
+}
 
-	return line; /* This MUST be freed by the caller */
+/* The caller of this function MUST xfree the returned memory. */
+heap_char FmtControlText(ParseCtx* ctx, unsigned ctrlNum)
+{
+	TextOut out;
+	/* Measure first, then write into an exactly sized buffer */
+	out.d = NULL;
+	out.len = 0;
+	PutControl(&out, ctx->dlg, ctrlNum, NL_LF);
+	out.d = (char*)xmalloc(out.len + 1);
+	out.len = 0;
+	PutControl(&out, ctx->dlg, ctrlNum, NL_LF);
+	out.d[out.len] = '\0';
+	return out.d; /* This MUST be freed by the caller */
 }
 
-void FreeDlgData()
+/* Writes the complete dialog template */
+static void PutDlgTemplate(TextOut* out, DlgTemplate* dlg, int nlStyle)
 {
+	unsigned headLen;
 	unsigned i;
-	for (i = 0; i < dlgControls.len; i++)
-	{
-		xfree(dlgControls.d[i].id);
-		xfree(dlgControls.d[i].style);
-		xfree(dlgControls.d[i].exStyle);
-	}
-	xfree(dlgControls.d);
-	dlgControls.d = NULL;
-	dlgControls.len = 0;
-	xfree(dlgFontFam);
-	dlgFontFam = NULL;
-	xfree(dlgHead);
-	dlgHead = NULL;
+	headLen = strlen(dlg->head);
+	PutLines(out, dlg->head, headLen, nlStyle);
+	for (i = 0; i < dlg->controls.len; i++)
+		PutControl(out, dlg, i, nlStyle);
+	/* Write the end marker */
+	if (headLen >= 2 && dlg->head[headLen-2] == '{')
+		PutText(out, "}", 1);
+	else
+		PutText(out, "END", 3);
+	/* The rest of the file starts with the line break of the end
+	   marker's line */
+	if (dlg->tail != NULL)
+		PutLines(out, dlg->tail, strlen(dlg->tail), nlStyle);
+	else
+		PutNewline(out, nlStyle);
+}
+
+/* Formats the complete dialog template as text with the given line
+   endings (see nlconv.h).  The whole template is measured first and
+   then written into a single buffer of exactly the right size.  If
+   "pLen" is not NULL, the length of the text is stored there.
+
+   The caller of this function MUST xfree the returned memory. */
+heap_char FmtDlgTemplateNl(ParseCtx* ctx, int nlStyle, unsigned* pLen)
+{
+	TextOut out;
+	ProfMark mark;
+	ProfBegin(&mark);
+	out.d = NULL;
+	out.len = 0;
+	PutDlgTemplate(&out, ctx->dlg, nlStyle);
+	out.d = (char*)xmalloc(out.len + 1);
+	out.len = 0;
+	PutDlgTemplate(&out, ctx->dlg, nlStyle);
+	out.d[out.len] = '\0';
+	ProfEnd(&mark, PROF_FORMAT, out.len);
+	if (pLen != NULL)
+		*pLen = out.len;
+	return out.d; /* This MUST be freed by the caller */
+}
+
+/* Formats the complete dialog template as text with Unix line
+   endings.  If "pLen" is not NULL, the length of the text is stored
+   there.
+
+   The caller of this function MUST xfree the returned memory. */
+heap_char FmtDlgTemplate(ParseCtx* ctx, unsigned* pLen)
+{
+	return FmtDlgTemplateNl(ctx, NL_LF, pLen);
+}
+
+/* Writes the complete dialog template to the given file, with the
+   line endings that the template was loaded with.  The file should
+   be opened in binary mode.  The text is written with a single
+   fwrite() call.  Returns FALSE if there was a write error. */
+BOOL WriteDlgTemplate(ParseCtx* ctx, FILE* fp)
+{
+	char* text;
+	unsigned textLen;
+	int nlStyle;
+	BOOL retVal;
+	ProfMark mark;
+
+	nlStyle = ctx->dlg->nlStyle;
+	if (nlStyle == NL_UNKNOWN)
+		nlStyle = NL_NATIVE;
+	text = FmtDlgTemplateNl(ctx, nlStyle, &textLen);
+	ProfBegin(&mark);
+	retVal = (fwrite(text, 1, textLen, fp) == textLen);
+	ProfEnd(&mark, PROF_WRITE, textLen);
+	xfree(text);
+	return retVal && !ferror(fp);
+}
+
+void FreeDlgData(DlgTemplate* dlg)
+{
+	unsigned i;
+	/* Only the strings that were decoded hold references */
+	for (i = 0; i < dlg->ctrlStrs.len; i++)
+		ReleaseCtrlStrs(&dlg->ctrlStrs.d[i]);
+	/* The text of all controls is released at once */
+	FreeStrArena(&dlg->strings);
+	dlg->deadText = 0;
+	dlg->source = NULL;
+	FreeCtrlGrid(dlg);
+	xfree(dlg->controls.d);
+	dlg->controls.d = NULL;
+	dlg->controls.len = 0;
+	xfree(dlg->ctrlStrs.d);
+	dlg->ctrlStrs.d = NULL;
+	dlg->ctrlStrs.len = 0;
+	xfree(dlg->fontFam);
+	dlg->fontFam = NULL;
+	xfree(dlg->head);
+	dlg->head = NULL;
+	xfree(dlg->tail);
+	dlg->tail = NULL;
+	if (dlg->syms != NULL)
+	{
+		FreeSymTable(dlg->syms);
+		xfree(dlg->syms);
+		dlg->syms = NULL;
+	}
 }
@@ -4,62 +4,243 @@
 #ifndef TMPLPARSER_H
 #define TMPLPARSER_H
 
+#include <stdio.h>
+
 #include "xmalloc.h"
 #define ea_malloc xmalloc
 #define ea_realloc xrealloc
 #define ea_free xfree
 #include "exparray.h"
+#include "strarena.h"
 /* Include Windows data types (BOOL and POINT) */
 #include "subwindef.h"
+#include "rcexpr.h"
+
+/* A range of source text that a field has not been decoded from
+   yet */
+struct SrcView_t
+{
+	unsigned pos;
+	unsigned len;
+};
+
+typedef struct SrcView_t SrcView;
+
+/* Bits of DlgItemStrs.lazyMask */
+#define LAZY_TEXT		0x01
+#define LAZY_CLASS		0x02
+#define LAZY_ID			0x04
+#define LAZY_STYLE		0x08
+#define LAZY_EXSTYLE	0x10
+
+/* Bits of DlgItem.styleFlags and DlgTemplate.styleFlags.  They are
+   set when the style or the extended style has terms that could not
+   be decoded (see EvalStyleExpr()), so that the numeric mask only
+   holds the terms that could be. */
+#define CSF_STYLE_UNRESOLVED	0x01
+#define CSF_EXSTYLE_UNRESOLVED	0x02
+
+/* Windows only reads the first 255 characters of a control's text and
+   window class */
+#define MAX_CTRL_TEXT 255
 
 /* We define our own structures for the purpose of saving preprocessor
-   symbols in the dialog template. */
+   symbols in the dialog template.
+
+   A control is split into two records that share the same index.  The
+   DlgItem record is small and holds what hit testing and painting
+   need for every control.  The DlgItemStrs record holds the strings,
+   which are only read one control at a time. */
 struct DlgItem_t
 {
-	/*char* itemType;*/
-	char text[256];
-	char* id;
 	int x;
 	int y;
 	int cx;
 	int cy;
-	char* style;
-	char* exStyle;
-	char wndClass[256];
-	int rendClass; /* Special rendering for recognized types */
-	int rendType;
+	unsigned char rendClass; /* Special rendering for recognized types */
+	unsigned char rendType;
+	unsigned short styleFlags;
+	/* The style and extended style masks, decoded when the control is
+	   parsed.  The style includes the defaults of the control type.
+	   The symbolic text is kept in DlgItemStrs for saving. */
+	unsigned style;
+	unsigned exStyle;
 };
 
 typedef struct DlgItem_t DlgItem;
 
+struct DlgItemStrs_t
+{
+	/* Read the strings through the GetCtrl*() functions.  The text is
+	   mostly unique, so it is owned by the dialog's string arena. */
+	const char* text;
+	/* These are interned (see strintern.h), so they are shared between
+	   controls and must not be modified.  Each one holds a reference
+	   that FreeDlgItemStrs() releases. */
+	const char* id;
+	const char* style;
+	const char* exStyle;
+	const char* wndClass;
+	/* The fields named in "lazyMask" have not been decoded yet.
+	   Their source text is given by the matching views. */
+	unsigned lazyMask;
+	SrcView textView;
+	SrcView classView;
+	SrcView idView;
+	SrcView styleView;
+	SrcView exStyleView;
+	/* The source text of x, y, cx, and cy, interned, for the ones that
+	   are not plain numbers (such as "BASE_X*2"), and the values that
+	   they had when they were parsed.  A coordinate is written back as
+	   its source text until its value is changed. */
+	const char* coordSrc[4];
+	int coordVal[4];
+};
+
+typedef struct DlgItemStrs_t DlgItemStrs;
+
+/* Every control type has a unique index below NUM_CTRL_TYPES */
+#define NUM_CTRL_TYPES 32
+#define CTRL_TYPE_INDEX(pCtrl) ((pCtrl)->rendClass * 4 + (pCtrl)->rendType)
+
 EA_TYPE(DlgItem);
+EA_TYPE(DlgItemStrs);
+
+/* All of the data for one dialog template.  Nothing in here is
+   shared between templates, so several templates can be worked on at
+   the same time. */
+struct DlgTemplate_t
+{
+	char* head;
+	/* Where the template starts in "head", after the comments and
+	   preprocessor lines in front of it */
+	unsigned headStart;
+	/* The text after the end marker of the control list, such as the
+	   other resources of a resource script, or NULL if there is only
+	   whitespace.  It is written back unchanged. */
+	char* tail;
+	/* Decoded from the STYLE and EXSTYLE statements of the header,
+	   which stays in "head" as text */
+	unsigned style;
+	unsigned exStyle;
+	unsigned styleFlags;
+	POINT pos;
+	long width;
+	long height;
+	BOOL hasCaption;
+	char caption[256];
+	unsigned pointSize;
+	char* fontFam;
+	DlgItem_array controls;
+	DlgItemStrs_array ctrlStrs; /* Same length as "controls" */
+	StrArena strings; /* Holds the text of the controls */
+	/* Bytes of "strings" that no control uses any more (see
+	   FreeDlgItemStrs()) */
+	unsigned deadText;
+	/* Spatial index of the controls, or NULL until it is first used
+	   (see ctrlgrid.h) */
+	struct CtrlGrid_t* grid;
+	const char* source; /* Source of the lazy fields, or NULL */
+	int nlStyle; /* Line endings of the source, see nlconv.h */
+	/* The symbols that the preprocessor lines of the source defined,
+	   or NULL if there were none (see rcpp.h) */
+	struct SymTable_t* syms;
+};
+
+typedef struct DlgTemplate_t DlgTemplate;
+
+/* Kinds of parse errors, see ParseDiag.code */
+#define PDIAG_PREPROC	1 /* A preprocessor line */
+#define PDIAG_HEAD		2 /* The header of the template */
+#define PDIAG_CONTROL	3 /* A control statement */
+#define PDIAG_END		4 /* The end of the control list */
+
+/* One parse error, as recorded in recovery mode */
+struct ParseDiag_t
+{
+	const char* file; /* ParseCtx.srcName, which may be NULL */
+	unsigned pos;
+	unsigned line;
+	unsigned col;
+	int code;
+	const char* message; /* Static text, like ParseCtx.errorDesc */
+};
+
+typedef struct ParseDiag_t ParseDiag;
+
+EA_TYPE(ParseDiag);
+
+/* Parser state.  The context holds the cursor, the diagnostics, and
+   the dialog template that the parsed data is written into.  Use a
+   separate context for each template that is parsed at the same
+   time. */
+struct ParseCtx_t
+{
+	unsigned curPos;
+	unsigned curLine;
+	char* errorDesc;
+	DlgTemplate* dlg; /* Target dialog model */
+	/* If TRUE, control fields are only decoded when they are first
+	   read, and the parsed buffer must stay valid until the dialog
+	   template is freed or DecodeDlgFields() is called. */
+	BOOL lazyFields;
+	/* Looks up the symbols in numeric arguments, such as "BASE_X * 2",
+	   or NULL if only numbers are allowed (see rcexpr.h) */
+	ExprSymbolFunc symLookup;
+	void* symParam;
+	/* Ranges of the source that the lexer skips, which the
+	   preprocessor sets while a template is parsed */
+	const struct TmplSkip_t* skips;
+	unsigned numSkips;
+	/* The file being parsed, or NULL, and a NULL terminated list of
+	   the directories that "#include" files are looked for in, or
+	   NULL */
+	const char* srcName;
+	const char* const* includeDirs;
+	/* If not NULL, the parser records every error here and goes on
+	   with the next statement, so that one pass finds all of the
+	   errors of a template (see AddParseDiag()) */
+	ParseDiag_array* diags;
+};
+
+typedef struct ParseCtx_t ParseCtx;
 
 typedef char* heap_char; /* Designates data that must passed to free() */
 
 unsigned SetUnixNlChars(char* buffer, unsigned dataSize);
 heap_char GenWinNlChars(char* buffer, unsigned dataSize);
+unsigned UnescapeText(char* dest, const char* src, unsigned srcLen);
+unsigned CountEscapedLen(const char* src, unsigned srcLen);
+unsigned EscapeText(char* dest, const char* src, unsigned srcLen);
 unsigned TransEscapeChars(char* buffer, unsigned dataSize);
 char* UntransEscChars(char* buffer, unsigned dataSize);
-BOOL ParseDlgHead(char* buffer, unsigned dataSize);
-BOOL ParseControl(char* buffer, unsigned dataSize, unsigned ctrlNum);
-void FmtDlgHeader();
-heap_char FmtControlText(unsigned ctrlNum);
-void FreeDlgData();
-
-/* Dialog variables */
-extern char* dlgHead;
-extern POINT dlgPos;
-extern long dlgWidth;
-extern long dlgHeight;
-extern BOOL dlgHasCaption;
-extern char dlgCaption[256];
-extern unsigned dlgPointSize;
-extern char* dlgFontFam;
-extern DlgItem_array dlgControls;
-
-/* Parser variables */
-extern unsigned curPos;
-extern unsigned curLine;
-extern char* errorDesc;
+void InitDlgData(DlgTemplate* dlg);
+void InitParseCtx(ParseCtx* ctx, DlgTemplate* dlg);
+const char* CtrlTypeName(int rendClass, int rendType);
+BOOL AddParseDiag(ParseCtx* ctx, const char* buffer, unsigned pos,
+				  unsigned line, int code, const char* message);
+const char* ParseDiagName(int code);
+BOOL ParseDlgHead(ParseCtx* ctx, const char* buffer, unsigned dataSize);
+BOOL ParseControl(ParseCtx* ctx, const char* buffer, unsigned dataSize,
+				  unsigned ctrlNum);
+BOOL ParseDlgTemplate(ParseCtx* ctx, const char* buffer,
+					  unsigned dataSize);
+void AddDlgItem(DlgTemplate* dlg);
+void FreeDlgItemStrs(DlgTemplate* dlg, unsigned ctrlNum);
+void RemoveDlgItem(DlgTemplate* dlg, unsigned ctrlNum);
+void UpdateDlgItemRect(DlgTemplate* dlg, unsigned ctrlNum);
+const char* GetCtrlText(DlgTemplate* dlg, unsigned ctrlNum);
+const char* GetCtrlClass(DlgTemplate* dlg, unsigned ctrlNum);
+const char* GetCtrlId(DlgTemplate* dlg, unsigned ctrlNum);
+const char* GetCtrlStyle(DlgTemplate* dlg, unsigned ctrlNum);
+const char* GetCtrlExStyle(DlgTemplate* dlg, unsigned ctrlNum);
+int EvalCtrlId(ParseCtx* ctx, unsigned ctrlNum, long* pValue);
+void DecodeDlgFields(DlgTemplate* dlg);
+void FmtDlgHeader(ParseCtx* ctx);
+heap_char FmtControlText(ParseCtx* ctx, unsigned ctrlNum);
+heap_char FmtDlgTemplateNl(ParseCtx* ctx, int nlStyle, unsigned* pLen);
+heap_char FmtDlgTemplate(ParseCtx* ctx, unsigned* pLen);
+BOOL WriteDlgTemplate(ParseCtx* ctx, FILE* fp);
+void FreeDlgData(DlgTemplate* dlg);
 
 #endif
@@ -10,6 +10,7 @@
 #include <commdlg.h>
 
 /* We need g_hInstance and SaveDialogTemplate() */
+#include "tmplparser.h"
 #include "dlgedit.h"
 
 char curFilename[MAX_PATH];
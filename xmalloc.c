@@ -5,17 +5,451 @@
    "xalloc_die()" was inspired from gnulib
    <www.gnu.org/software/gnulib>.  Memory size checking in this code
    was inspired from the DJGPP <www.delorie.com/djgpp> xalloc
-   functions, courtesy of DJ Delorie.  */
+   functions, courtesy of DJ Delorie.
+
+   With XMALLOC_STATS defined, each block gets a small header that
+   records its size and the call site that allocated it, so that
+   xfree() and xrealloc() can keep the live byte count.  The
+   statistics are kept under one lock, which is fine for finding out
+   where memory goes, but not for timing.
+
+   With XMALLOC_POOL defined, blocks of up to 256 bytes come from
+   size-class pools instead of malloc().  Each thread keeps a free
+   list of each size class, so the small, short-lived strings of the
+   parser are allocated and freed without any locking.  A thread's
+   lists only go back to the shared depot when they grow too long or
+   when the thread calls xalloc_thread_flush() before it exits.  The
+   pool never returns memory to the system, so it suits batch tools
+   better than long-running programs.  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include "xthread.h"
+#include "xmalloc.h"
+
+/* The functions below are the real ones.  */
+#undef xmalloc
+#undef xrealloc
+
+/* Allocation totals of each thread, for profiling.  Only the owning
+   thread touches them, so they need no locking.  */
+static XTHREAD_LOCAL unsigned long threadAllocs = 0;
+static XTHREAD_LOCAL unsigned long threadBytes = 0;
+
+#ifdef XMALLOC_STATS
+/* Size of the block header.  This keeps the caller's data as aligned
+   as malloc() would.  */
+#define HDR_SIZE 16
+#define NUM_SITES 1024 /* Power of two */
+#define NUM_DUMP_SITES 30
+
+struct block_hdr
+{
+	size_t size;
+	unsigned site;
+};
+
+/* Totals of one call site.  Site zero collects the allocations whose
+   site is unknown or did not fit in the table.  */
+struct alloc_site
+{
+	const char *file;
+	int line;
+	unsigned long allocs;
+	unsigned long reallocs;
+	unsigned long grows;
+	size_t bytes;
+	size_t copy_bytes;
+	size_t slack_bytes;
+};
+
+static xmutex_t stats_lock;
+static xonce_t stats_once = XONCE_INIT;
+static struct xalloc_stats totals;
+static struct alloc_site sites[NUM_SITES];
+static unsigned num_sites = 1;
+#endif /* XMALLOC_STATS */
+
+#ifdef XMALLOC_POOL
+#ifdef XMALLOC_STATS
+#error "XMALLOC_POOL and XMALLOC_STATS cannot be used together."
+#endif
+#define NUM_CLASSES 8
+#define POOL_LARGE NUM_CLASSES /* Class of blocks from malloc() */
+#define MAX_POOL_SIZE 256
+#define SLAB_SIZE 65536
+#define MAX_CACHED 256 /* Blocks of each class that a thread keeps */
+#define REFILL_BLOCKS 64 /* Blocks taken from the depot at a time */
+
+/* Every block starts with its class.  The union keeps the caller's
+   data aligned for any basic type.  */
+union pool_hdr
+{
+	size_t cls;
+	double align_d;
+	void *align_p;
+};
+
+/* A free block, as it is kept on a free list */
+struct pool_block
+{
+	union pool_hdr hdr;
+	struct pool_block *next;
+};
+
+struct pool_slab
+{
+	struct pool_slab *next;
+};
+
+static const size_t class_sizes[NUM_CLASSES] =
+	{16, 32, 48, 64, 96, 128, 192, 256};
+/* Size class of each size, in units of 16 bytes rounded up */
+static const unsigned char size_classes[MAX_POOL_SIZE / 16 + 1] =
+	{0, 0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7};
+
+/* The current thread's free lists */
+static XTHREAD_LOCAL struct pool_block *cache[NUM_CLASSES];
+static XTHREAD_LOCAL unsigned num_cached[NUM_CLASSES];
+
+/* Shared by all threads, under "pool_lock" */
+static xmutex_t pool_lock;
+static xonce_t pool_once = XONCE_INIT;
+static struct pool_block *depot[NUM_CLASSES];
+static unsigned num_depot[NUM_CLASSES];
+static struct pool_slab *slabs = NULL;
+#endif /* XMALLOC_POOL */
 
 /* Private Declarations */
 static void xalloc_die();
+#ifdef XMALLOC_STATS
+static void init_stats_lock();
+static unsigned find_site(const char *file, int line);
+static int cmp_site_bytes(const void *a, const void *b);
+#endif
+#ifdef XMALLOC_POOL
+static void init_pool_lock();
+static void refill_cache(unsigned cls);
+static void drain_cache(unsigned cls, unsigned keep);
+static void pool_free(void *mem);
+#endif
+
+#ifdef XMALLOC_STATS
+
+static void init_stats_lock()
+{
+	xmutex_init(&stats_lock);
+}
+
+/* Returns the index of the call site, adding it to the table if
+   needed.  The lock must be held.  */
+static unsigned find_site(const char *file, int line)
+{
+	unsigned i;
+	if (file == NULL)
+		return 0;
+	i = ((unsigned)line * 2654435761u ^ (unsigned)strlen(file)) &
+		(NUM_SITES - 1);
+	while (sites[i].file != NULL)
+	{
+		if (sites[i].line == line &&
+			(sites[i].file == file || strcmp(sites[i].file, file) == 0))
+			return i;
+		i = (i + 1) & (NUM_SITES - 1);
+	}
+	/* Leave some room so that the probes stay short */
+	if (i == 0 || num_sites >= NUM_SITES * 3 / 4)
+		return 0;
+	num_sites++;
+	sites[i].file = file;
+	sites[i].line = line;
+	return i;
+}
+
+void *xmalloc_at(size_t num, const char *file, int line)
+{
+	struct block_hdr *hdr;
+	unsigned site;
+	threadAllocs++;
+	threadBytes += num;
+	hdr = (struct block_hdr *)malloc(HDR_SIZE + num);
+	if (hdr == NULL)
+		xalloc_die();
+	xthread_once(&stats_once, init_stats_lock);
+	xmutex_lock(&stats_lock);
+	site = find_site(file, line);
+	sites[site].allocs++;
+	sites[site].bytes += num;
+	totals.num_allocs++;
+	totals.total_bytes += num;
+	totals.live_bytes += num;
+	if (totals.live_bytes > totals.peak_bytes)
+		totals.peak_bytes = totals.live_bytes;
+	xmutex_unlock(&stats_lock);
+	hdr->size = num;
+	hdr->site = site;
+	return (char *)hdr + HDR_SIZE;
+}
+
+void *xrealloc_at(void *mem, size_t num, const char *file, int line)
+{
+	struct block_hdr *hdr;
+	struct block_hdr *new_hdr;
+	size_t old_size;
+	unsigned site;
+	if (mem == NULL)
+		return xmalloc_at(num, file, line);
+	threadAllocs++;
+	threadBytes += num;
+	hdr = (struct block_hdr *)((char *)mem - HDR_SIZE);
+	old_size = hdr->size;
+	new_hdr = (struct block_hdr *)realloc(hdr, HDR_SIZE + num);
+	if (new_hdr == NULL)
+		xalloc_die();
+	xthread_once(&stats_once, init_stats_lock);
+	xmutex_lock(&stats_lock);
+	site = find_site(file, line);
+	sites[site].reallocs++;
+	sites[site].bytes += num;
+	totals.num_reallocs++;
+	totals.total_bytes += num;
+	totals.live_bytes += num - old_size;
+	if (totals.live_bytes > totals.peak_bytes)
+		totals.peak_bytes = totals.live_bytes;
+	/* A block that moved had its contents copied */
+	if (new_hdr != hdr)
+	{
+		size_t copied;
+		copied = (old_size < num) ? old_size : num;
+		sites[site].copy_bytes += copied;
+		totals.realloc_copy_bytes += copied;
+	}
+	xmutex_unlock(&stats_lock);
+	new_hdr->size = num;
+	new_hdr->site = site;
+	return (char *)new_hdr + HDR_SIZE;
+}
+
+void *xmalloc(size_t num)
+{
+	return xmalloc_at(num, NULL, 0);
+}
+
+void *xrealloc(void *mem, size_t num)
+{
+	return xrealloc_at(mem, num, NULL, 0);
+}
+
+void xfree(void *mem)
+{
+	struct block_hdr *hdr;
+	if (mem == NULL)
+		return;
+	hdr = (struct block_hdr *)((char *)mem - HDR_SIZE);
+	xmutex_lock(&stats_lock);
+	totals.num_frees++;
+	totals.live_bytes -= hdr->size;
+	xmutex_unlock(&stats_lock);
+	free(hdr);
+}
+
+/* Records that an expandable array was reallocated from "oldAlloc" to
+   "newAlloc" elements while holding "len" elements.  */
+void xalloc_note_array(const char *file, int line, size_t tysize,
+					   unsigned len, unsigned oldAlloc, unsigned newAlloc)
+{
+	unsigned site;
+	size_t slack;
+	slack = (newAlloc > len) ? (newAlloc - len) * tysize : 0;
+	xthread_once(&stats_once, init_stats_lock);
+	xmutex_lock(&stats_lock);
+	site = find_site(file, line);
+	sites[site].grows++;
+	sites[site].slack_bytes += slack;
+	totals.array_grows++;
+	totals.array_slack_bytes += slack;
+	xmutex_unlock(&stats_lock);
+}
+
+#elif defined(XMALLOC_POOL)
+
+static void init_pool_lock()
+{
+	xmutex_init(&pool_lock);
+}
+
+/* Fills the current thread's free list of the given class, from the
+   depot if it has blocks, or else from a new slab.  */
+static void refill_cache(unsigned cls)
+{
+	size_t stride;
+	xthread_once(&pool_once, init_pool_lock);
+	xmutex_lock(&pool_lock);
+	if (depot[cls] != NULL)
+	{
+		unsigned i;
+		for (i = 0; i < REFILL_BLOCKS && depot[cls] != NULL; i++)
+		{
+			struct pool_block *block;
+			block = depot[cls];
+			depot[cls] = block->next;
+			block->next = cache[cls];
+			cache[cls] = block;
+		}
+		num_depot[cls] -= i;
+		num_cached[cls] += i;
+		xmutex_unlock(&pool_lock);
+		return;
+	}
+	xmutex_unlock(&pool_lock);
+
+	{
+		struct pool_slab *slab;
+		char *pos;
+		char *end;
+		slab = (struct pool_slab *)malloc(SLAB_SIZE);
+		if (slab == NULL)
+			xalloc_die();
+		xmutex_lock(&pool_lock);
+		slab->next = slabs;
+		slabs = slab;
+		xmutex_unlock(&pool_lock);
+		stride = sizeof(union pool_hdr) + class_sizes[cls];
+		pos = (char *)slab + sizeof(union pool_hdr);
+		end = (char *)slab + SLAB_SIZE;
+		for (; pos + stride <= end; pos += stride)
+		{
+			struct pool_block *block;
+			block = (struct pool_block *)pos;
+			block->hdr.cls = cls;
+			block->next = cache[cls];
+			cache[cls] = block;
+			num_cached[cls]++;
+		}
+	}
+}
+
+/* Moves all but "keep" blocks of the current thread's free list of
+   the given class to the depot.  */
+static void drain_cache(unsigned cls, unsigned keep)
+{
+	struct pool_block *first;
+	struct pool_block *last;
+	unsigned num_moved;
+	if (num_cached[cls] <= keep)
+		return;
+	first = cache[cls];
+	last = first;
+	num_moved = num_cached[cls] - keep;
+	while (--num_moved > 0)
+		last = last->next;
+	cache[cls] = last->next;
+	num_moved = num_cached[cls] - keep;
+	num_cached[cls] = keep;
+	xthread_once(&pool_once, init_pool_lock);
+	xmutex_lock(&pool_lock);
+	last->next = depot[cls];
+	depot[cls] = first;
+	num_depot[cls] += num_moved;
+	xmutex_unlock(&pool_lock);
+}
+
+void *xmalloc(size_t num)
+{
+	union pool_hdr *hdr;
+	threadAllocs++;
+	threadBytes += num;
+	if (num <= MAX_POOL_SIZE)
+	{
+		struct pool_block *block;
+		unsigned cls;
+		cls = size_classes[(num + 15) / 16];
+		if (cache[cls] == NULL)
+			refill_cache(cls);
+		block = cache[cls];
+		cache[cls] = block->next;
+		num_cached[cls]--;
+		return &block->hdr + 1;
+	}
+	hdr = (union pool_hdr *)malloc(sizeof(union pool_hdr) + num);
+	if (hdr == NULL)
+		xalloc_die();
+	hdr->cls = POOL_LARGE;
+	return hdr + 1;
+}
+
+void *xrealloc(void *mem, size_t num)
+{
+	union pool_hdr *hdr;
+	void *new_mem;
+	size_t cls;
+	if (mem == NULL)
+		return xmalloc(num);
+	hdr = (union pool_hdr *)mem - 1;
+	cls = hdr->cls;
+	if (cls == POOL_LARGE && num > MAX_POOL_SIZE)
+	{
+		threadAllocs++;
+		threadBytes += num;
+		hdr = (union pool_hdr *)realloc(hdr, sizeof(union pool_hdr) + num);
+		if (hdr == NULL)
+			xalloc_die();
+		return hdr + 1;
+	}
+	/* Stay in the same block if it is still the right class */
+	if (cls != POOL_LARGE && num <= class_sizes[cls] &&
+		(cls == 0 || num > class_sizes[cls-1]))
+	{
+		threadAllocs++;
+		threadBytes += num;
+		return mem;
+	}
+	new_mem = xmalloc(num);
+	if (cls == POOL_LARGE)
+		memcpy(new_mem, mem, num); /* Shrinking into the pool */
+	else
+		memcpy(new_mem, mem, (num < class_sizes[cls]) ?
+			   num : class_sizes[cls]);
+	pool_free(mem);
+	return new_mem;
+}
+
+static void pool_free(void *mem)
+{
+	union pool_hdr *hdr;
+	struct pool_block *block;
+	size_t cls;
+	hdr = (union pool_hdr *)mem - 1;
+	cls = hdr->cls;
+	if (cls == POOL_LARGE)
+	{
+		free(hdr);
+		return;
+	}
+	/* Blocks that were allocated by another thread are simply taken
+	   over by this one */
+	block = (struct pool_block *)hdr;
+	block->next = cache[cls];
+	cache[cls] = block;
+	if (++num_cached[cls] > MAX_CACHED * 2)
+		drain_cache(cls, MAX_CACHED);
+}
+
+void xfree(void *mem)
+{
+	if (mem != NULL)
+		pool_free(mem);
+}
+
+#else /* not XMALLOC_STATS, not XMALLOC_POOL */
 
 void *xmalloc(size_t num)
 {
 	void *mem;
+	threadAllocs++;
+	threadBytes += num;
 	mem = malloc(num ? num : 1);
 	if (mem == NULL)
 		xalloc_die();
@@ -24,6 +458,8 @@ void *xmalloc(size_t num)
 
 void *xrealloc(void *mem, size_t num)
 {
+	threadAllocs++;
+	threadBytes += num;
 	if (mem == NULL)
 		mem = malloc(num ? num : 1);
 	else
@@ -39,6 +475,125 @@ void xfree(void *mem)
 		free(mem);
 }
 
+#endif /* not XMALLOC_STATS, not XMALLOC_POOL */
+
+/* Hands the blocks that the current thread keeps for reuse back to
+   the other threads.  Threads that allocate memory should call this
+   before they exit.  This does nothing unless XMALLOC_POOL is
+   defined.  */
+void xalloc_thread_flush()
+{
+#ifdef XMALLOC_POOL
+	unsigned i;
+	for (i = 0; i < NUM_CLASSES; i++)
+		drain_cache(i, 0);
+#endif
+}
+
+/* Returns the number of xmalloc() and xrealloc() calls that the
+   calling thread has made, and the number of bytes that it asked for
+   in them.  Subtract two readings to get the totals of a piece of
+   code.  */
+void xalloc_thread_totals(unsigned long *numAllocs, unsigned long *numBytes)
+{
+	*numAllocs = threadAllocs;
+	*numBytes = threadBytes;
+}
+
+/* Copies the program's allocation statistics into "stats".  Returns
+   zero, and clears "stats", if the program was built without
+   XMALLOC_STATS.  */
+int xalloc_get_stats(struct xalloc_stats *stats)
+{
+#ifdef XMALLOC_STATS
+	xthread_once(&stats_once, init_stats_lock);
+	xmutex_lock(&stats_lock);
+	*stats = totals;
+	xmutex_unlock(&stats_lock);
+	return 1;
+#else
+	memset(stats, 0, sizeof(struct xalloc_stats));
+	return 0;
+#endif
+}
+
+#ifdef XMALLOC_STATS
+/* Sorts call sites by decreasing bytes allocated.  */
+static int cmp_site_bytes(const void *a, const void *b)
+{
+	const struct alloc_site *sa = *(const struct alloc_site **)a;
+	const struct alloc_site *sb = *(const struct alloc_site **)b;
+	if (sa->bytes + sa->slack_bytes != sb->bytes + sb->slack_bytes)
+		return (sa->bytes + sa->slack_bytes < sb->bytes + sb->slack_bytes) ?
+			1 : -1;
+	return 0;
+}
+#endif
+
+/* Prints the allocation statistics, followed by the call sites that
+   allocated the most.  */
+void xalloc_dump_stats(FILE *fp)
+{
+#ifdef XMALLOC_STATS
+	struct xalloc_stats stats;
+	struct alloc_site *order[NUM_SITES];
+	unsigned num_order;
+	unsigned i;
+
+	xalloc_get_stats(&stats);
+	fprintf(fp, "Allocations: %lu, reallocations: %lu, frees: %lu\n",
+			stats.num_allocs, stats.num_reallocs, stats.num_frees);
+	fprintf(fp, "Bytes requested: %lu, live: %lu, peak live: %lu\n",
+			(unsigned long)stats.total_bytes,
+			(unsigned long)stats.live_bytes,
+			(unsigned long)stats.peak_bytes);
+	fprintf(fp, "Bytes copied by reallocation: %lu\n",
+			(unsigned long)stats.realloc_copy_bytes);
+	fprintf(fp, "Array growths: %lu, unused capacity after them: %lu "
+			"bytes\n", stats.array_grows,
+			(unsigned long)stats.array_slack_bytes);
+
+	xmutex_lock(&stats_lock);
+	num_order = 0;
+	for (i = 0; i < NUM_SITES; i++)
+	{
+		if (sites[i].allocs + sites[i].reallocs + sites[i].grows != 0)
+			order[num_order++] = &sites[i];
+	}
+	qsort(order, num_order, sizeof(struct alloc_site *), cmp_site_bytes);
+	fprintf(fp, "%-24s %9s %9s %12s %12s %7s %12s\n", "call site",
+			"allocs", "reallocs", "bytes", "copied", "grows", "slack");
+	for (i = 0; i < num_order && i < NUM_DUMP_SITES; i++)
+	{
+		char name[64];
+		const char *file;
+		file = order[i]->file;
+		if (file == NULL)
+			strcpy(name, "(other)");
+		else
+		{
+			/* Only show the base name */
+			const char *base;
+			base = strrchr(file, '/');
+			if (base == NULL)
+				base = strrchr(file, '\\');
+			if (base != NULL)
+				file = base + 1;
+			sprintf(name, "%.50s:%d", file, order[i]->line);
+		}
+		fprintf(fp, "%-24s %9lu %9lu %12lu %12lu %7lu %12lu\n", name,
+				order[i]->allocs, order[i]->reallocs,
+				(unsigned long)order[i]->bytes,
+				(unsigned long)order[i]->copy_bytes, order[i]->grows,
+				(unsigned long)order[i]->slack_bytes);
+	}
+	xmutex_unlock(&stats_lock);
+#else
+	fputs("Allocation statistics are not available; build with "
+		  "XMALLOC_STATS defined.\n", fp);
+#endif
+}
+
 static void xalloc_die()
 {
 	fprintf(stderr, "Memory exhausted.\n");
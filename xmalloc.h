@@ -5,11 +5,49 @@
 #ifndef XMALLOC_H
 #define XMALLOC_H
 
+#include <stdio.h>
 #include <stdlib.h>
 
+/* Allocation statistics, see xalloc_get_stats().  Byte counts are the
+   sizes that were asked for.  */
+struct xalloc_stats
+{
+	unsigned long num_allocs;	/* xmalloc() calls */
+	unsigned long num_reallocs;	/* xrealloc() calls */
+	unsigned long num_frees;	/* xfree() calls with non-NULL memory */
+	size_t total_bytes;			/* Sum of all requested sizes */
+	size_t live_bytes;			/* Bytes allocated and not yet freed */
+	size_t peak_bytes;			/* Highest value of "live_bytes" */
+	size_t realloc_copy_bytes;	/* Bytes moved by xrealloc() */
+	unsigned long array_grows;	/* Expandable array reallocations */
+	size_t array_slack_bytes;	/* Unused array capacity after them */
+};
+
 void *xmalloc(size_t num);
 void *xrealloc(void *mem, size_t num);
 void xfree(void *mem);
+void xalloc_thread_totals(unsigned long *numAllocs, unsigned long *numBytes);
+void xalloc_thread_flush();
+int xalloc_get_stats(struct xalloc_stats *stats);
+void xalloc_dump_stats(FILE *fp);
+
+/* When XMALLOC_STATS is defined, every allocation is tagged with the
+   source file and line that made it, and xalloc_get_stats() and
+   xalloc_dump_stats() report the totals of the program and of each
+   call site.  The whole program must be built with the same setting,
+   because the statistics keep a header in front of each block.  */
+#ifdef XMALLOC_STATS
+void *xmalloc_at(size_t num, const char *file, int line);
+void *xrealloc_at(void *mem, size_t num, const char *file, int line);
+void xalloc_note_array(const char *file, int line, size_t tysize,
+					   unsigned len, unsigned oldAlloc, unsigned newAlloc);
+#define xmalloc(num) xmalloc_at((num), __FILE__, __LINE__)
+#define xrealloc(mem, num) xrealloc_at((mem), (num), __FILE__, __LINE__)
+/* Expandable array hook, see exparray.h */
+#define ea_grow_hook(tysize, len, oldAlloc, newAlloc)		\
+	xalloc_note_array(__FILE__, __LINE__, (tysize), (len),	\
+					  (oldAlloc), (newAlloc))
+#endif /* XMALLOC_STATS */
 
 /* Easy Free: free memory and nullify pointer.  */
 #define EFREE(mem)			\
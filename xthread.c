@@ -0,0 +1,109 @@
+/* Minimal portable threads.  See xthread.h for details.  */
+
+#include "xmalloc.h"
+#include "xthread.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+/* Private Declarations */
+struct xthread_start_tag
+{
+	xthread_func func;
+	void *arg;
+};
+
+#ifdef _WIN32
+static DWORD WINAPI xthread_trampoline(LPVOID param);
+#else
+static void *xthread_trampoline(void *param);
+#endif
+
+/* Starts a new thread that runs `func(arg)'.  Returns zero on
+   success.  */
+int xthread_create(xthread_t *thread, xthread_func func, void *arg)
+{
+	struct xthread_start_tag *start;
+	start = (struct xthread_start_tag *)
+		xmalloc(sizeof(struct xthread_start_tag));
+	start->func = func;
+	start->arg = arg;
+#ifdef _WIN32
+	*thread = CreateThread(NULL, 0, xthread_trampoline, start, 0, NULL);
+	if (*thread == NULL)
+	{
+		xfree(start);
+		return -1;
+	}
+	return 0;
+#else
+	if (pthread_create(thread, NULL, xthread_trampoline, start) != 0)
+	{
+		xfree(start);
+		return -1;
+	}
+	return 0;
+#endif
+}
+
+/* Waits for the given thread to finish.  */
+void xthread_join(xthread_t thread)
+{
+#ifdef _WIN32
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+#else
+	pthread_join(thread, NULL);
+#endif
+}
+
+/* Runs `func()' exactly once for the given control variable, which
+   must be statically initialized to `XONCE_INIT'.  Threads that call
+   this while `func()' is running wait for it to finish.  */
+void xthread_once(xonce_t *once, xonce_func func)
+{
+#ifdef _WIN32
+	/* 0: not run, 1: running, 2: done */
+	if (*once == 2)
+		return;
+	if (InterlockedCompareExchange(once, 1, 0) == 0)
+	{
+		func();
+		InterlockedExchange(once, 2);
+		return;
+	}
+	while (*once != 2)
+		Sleep(0);
+#else
+	pthread_once(once, func);
+#endif
+}
+
+/* Returns the number of processors that are online, or one if that
+   cannot be determined.  */
+unsigned xthread_num_cpus()
+{
+#ifdef _WIN32
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	return (si.dwNumberOfProcessors > 0) ? si.dwNumberOfProcessors : 1;
+#else
+	long num;
+	num = sysconf(_SC_NPROCESSORS_ONLN);
+	return (num > 0) ? (unsigned)num : 1;
+#endif
+}
+
+#ifdef _WIN32
+static DWORD WINAPI xthread_trampoline(LPVOID param)
+#else
+static void *xthread_trampoline(void *param)
+#endif
+{
+	struct xthread_start_tag start;
+	start = *(struct xthread_start_tag *)param;
+	xfree(param);
+	start.func(start.arg);
+	return 0;
+}
@@ -0,0 +1,48 @@
+/* Minimal portable threads: just enough to run a pool of worker
+   threads and protect shared data.  Uses Win32 threads on Windows and
+   POSIX threads everywhere else.  */
+
+#ifndef XTHREAD_H
+#define XTHREAD_H
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+typedef HANDLE xthread_t;
+typedef CRITICAL_SECTION xmutex_t;
+typedef volatile LONG xonce_t;
+#define XONCE_INIT 0
+#define xmutex_init(m)		InitializeCriticalSection(m)
+#define xmutex_destroy(m)	DeleteCriticalSection(m)
+#define xmutex_lock(m)		EnterCriticalSection(m)
+#define xmutex_unlock(m)	LeaveCriticalSection(m)
+#else
+#include <pthread.h>
+typedef pthread_t xthread_t;
+typedef pthread_mutex_t xmutex_t;
+typedef pthread_once_t xonce_t;
+#define XONCE_INIT PTHREAD_ONCE_INIT
+#define xmutex_init(m)		pthread_mutex_init((m), NULL)
+#define xmutex_destroy(m)	pthread_mutex_destroy(m)
+#define xmutex_lock(m)		pthread_mutex_lock(m)
+#define xmutex_unlock(m)	pthread_mutex_unlock(m)
+#endif
+
+/* Storage class for thread-local variables.  */
+#if defined(_MSC_VER)
+#define XTHREAD_LOCAL __declspec(thread)
+#else
+#define XTHREAD_LOCAL __thread
+#endif
+
+typedef void (*xthread_func)(void *arg);
+typedef void (*xonce_func)(void);
+
+int xthread_create(xthread_t *thread, xthread_func func, void *arg);
+void xthread_join(xthread_t thread);
+void xthread_once(xonce_t *once, xonce_func func);
+unsigned xthread_num_cpus();
+
+#endif /* not XTHREAD_H */